@@ -0,0 +1,266 @@
+#ifndef __DecimalStringEncoder_h
+#define __DecimalStringEncoder_h
+
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// -------------------------------------------------------------
+// DecimalStringEncoder: writes numbers as DICOM Decimal String (DS)
+// values, i.e. at most 16 characters among "0-9+-.eE".
+//
+// A value is rounded to the given precision (e.g. 0.001 mm gives 3
+// decimals) and written with the fewest characters: no trailing zeros,
+// no trailing point, no "-0". Decimals are only dropped when the value
+// would not fit in 16 characters otherwise, and the exponent notation is
+// only used for values that do not fit in 16 characters at all.
+//
+// The fixed notation is written digit by digit from the rounded value,
+// without going through a stream or printf.
+//
+// Shared by mask2contour (which writes the contour data files) and
+// export2RTSTRUCT (which writes the Contour Data (3006,0050)).
+// -------------------------------------------------------------
+class DecimalStringEncoder
+{
+public:
+  enum { MaximumLength = 16 };
+
+  explicit DecimalStringEncoder(double precision = 0.001)
+    : m_Decimals(3) { SetPrecision(precision); }
+
+  // Smallest difference kept between two values (the values are rounded
+  // to a multiple of a power of 10 not larger than "precision", with 15
+  // decimals at most). Returns false, leaving the precision unchanged,
+  // if "precision" is not a positive number.
+  static bool IsValidPrecision(double precision)
+    { return precision > 0.0 && precision - precision == 0.0; }
+
+  bool SetPrecision(double precision)
+    {
+    if ( ! IsValidPrecision(precision) )
+      {
+      return false;
+      }
+    m_Decimals = 0;
+    while ( m_Decimals < 15 && precision < 0.99999 * Power10(-static_cast<int>(m_Decimals)) )
+      {
+      m_Decimals++;
+      }
+    return true;
+    }
+
+  unsigned int GetNumberOfDecimals() const { return m_Decimals; }
+
+  // Writes "value" to "buffer" (of at least MaximumLength + 1 characters,
+  // null-terminated), and returns its length.
+  unsigned int Encode(double value, char* buffer) const;
+
+  std::string Encode(double value) const
+    {
+    char buffer[MaximumLength + 1];
+    return std::string(buffer, Encode(value, buffer));
+    }
+
+  // Whether "text" (not null-terminated) is a valid DS value: a fixed or
+  // floating point number ("-1.5", ".5", "2.", "1e-3"), possibly padded
+  // with spaces, of at most 16 characters.
+  static bool IsValid(const char* text, size_t length);
+
+private:
+  static double Power10(int n)
+    {
+    double p = 1.0;
+    for ( int i = 0; i < n; i++ )  { p *= 10.0; }
+    for ( int i = 0; i > n; i-- )  { p /= 10.0; }
+    return p;
+    }
+
+  // Fixed notation with "decimals" decimals; returns 0 if it would be
+  // longer than MaximumLength.
+  static unsigned int EncodeFixed(double value, unsigned int decimals, char* buffer);
+
+  unsigned int m_Decimals;
+};
+
+
+inline unsigned int DecimalStringEncoder::Encode(double value, char* buffer) const
+{
+  // NaN and the infinities have no DS.
+  if ( value != value || value - value != 0.0 )
+  {
+    value = 0.0;
+  }
+
+  for ( int decimals = m_Decimals; decimals >= 0; decimals-- )
+  {
+    const unsigned int length = EncodeFixed(value, decimals, buffer);
+    if ( length > 0 )
+    {
+      return length;
+    }
+  }
+
+  // Too large for the fixed notation: as many significant digits as fit.
+  for ( int digits = MaximumLength - 6; digits >= 0; digits-- )
+  {
+    int length = sprintf(buffer, "%.*E", digits, value);
+    if ( length > 0 && length <= MaximumLength )
+    {
+      // Trailing zeros of the mantissa are dropped.
+      char* exponent = buffer;
+      while ( *exponent != 'E' )
+      {
+        exponent++;
+      }
+      char* end = exponent;
+      while ( end[-1] == '0' )
+      {
+        end--;
+      }
+      if ( end[-1] == '.' )
+      {
+        end--;
+      }
+      memmove(end, exponent, buffer + length + 1 - exponent);
+      return length - ( exponent - end );
+    }
+  }
+  buffer[0] = '0';
+  buffer[1] = '\0';
+  return 1;
+}
+
+
+inline unsigned int DecimalStringEncoder::EncodeFixed(double       value,
+                                                      unsigned int decimals,
+                                                      char*        buffer)
+{
+  // The rounded value, scaled to an integer, must be exact in a double.
+  const double scaled = floor( fabs(value) * Power10(decimals) + 0.5 );
+  if ( ! ( scaled < 9007199254740992.0 ) ) // 2^53 (also false for infinity)
+  {
+    return 0;
+  }
+
+  // "n" holds an integer below 2^53, so that its digits are exact in
+  // double arithmetic (a long may only have 32 bits).
+  double n = scaled;
+
+  // Trailing zeros of the decimals are dropped.
+  while ( decimals > 0 && fmod(n, 10.0) == 0.0 )
+  {
+    n /= 10.0;
+    decimals--;
+  }
+
+  // Digits, from the last one.
+  char         digits[24];
+  unsigned int numberOfDigits = 0;
+  do
+  {
+    const double digit = fmod(n, 10.0);
+    digits[numberOfDigits++] = static_cast<char>( '0' + static_cast<int>( digit ) );
+    n = ( n - digit ) / 10.0;
+  } while ( n > 0.0 );
+
+  // At least one digit before the point.
+  while ( numberOfDigits <= decimals )
+  {
+    digits[numberOfDigits++] = '0';
+  }
+
+  const bool negative = value < 0.0 && scaled > 0.0;
+  const unsigned int length = negative + numberOfDigits + ( decimals > 0 );
+  if ( length > MaximumLength )
+  {
+    return 0;
+  }
+
+  char* c = buffer;
+  if ( negative )
+  {
+    *c++ = '-';
+  }
+  for ( unsigned int i = numberOfDigits; i > 0; i-- )
+  {
+    if ( i == decimals )
+    {
+      *c++ = '.';
+    }
+    *c++ = digits[i - 1];
+  }
+  *c = '\0';
+  return length;
+}
+
+
+inline bool DecimalStringEncoder::IsValid(const char* text, size_t length)
+{
+  if ( length == 0 || length > MaximumLength )
+  {
+    return false;
+  }
+
+  // Leading and trailing spaces are allowed.
+  size_t i   = 0;
+  size_t end = length;
+  while ( i < end && text[i] == ' ' )
+  {
+    i++;
+  }
+  while ( end > i && text[end - 1] == ' ' )
+  {
+    end--;
+  }
+
+  // [+-] digits [. digits] [(e|E) [+-] digits], with at least one digit
+  // in the mantissa, before or after the point.
+  if ( i < end && ( text[i] == '+' || text[i] == '-' ) )
+  {
+    i++;
+  }
+  size_t mantissaDigits = 0;
+  while ( i < end && text[i] >= '0' && text[i] <= '9' )
+  {
+    i++;
+    mantissaDigits++;
+  }
+  if ( i < end && text[i] == '.' )
+  {
+    i++;
+    while ( i < end && text[i] >= '0' && text[i] <= '9' )
+    {
+      i++;
+      mantissaDigits++;
+    }
+  }
+  if ( mantissaDigits == 0 )
+  {
+    return false;
+  }
+
+  if ( i < end && ( text[i] == 'e' || text[i] == 'E' ) )
+  {
+    i++;
+    if ( i < end && ( text[i] == '+' || text[i] == '-' ) )
+    {
+      i++;
+    }
+    size_t exponentDigits = 0;
+    while ( i < end && text[i] >= '0' && text[i] <= '9' )
+    {
+      i++;
+      exponentDigits++;
+    }
+    if ( exponentDigits == 0 )
+    {
+      return false;
+    }
+  }
+  return i == end;
+}
+
+#endif // __DecimalStringEncoder_h
@@ -0,0 +1,809 @@
+#include "CTSeriesScanner.h"
+#include "MappedTextFile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#include <itksys/Directory.hxx>
+#include <itksys/SystemTools.hxx>
+
+#include "itkMultiThreader.h"
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+
+// -------------------------------------------------------------
+// A minimal reader of the DICOM data elements, little endian only.
+// Every read is checked against the end of the file.
+// -------------------------------------------------------------
+struct DICOMCursor
+{
+  const unsigned char* current;
+  const unsigned char* end;
+  bool                 explicitVR;
+};
+
+struct DICOMElement
+{
+  unsigned int  group;
+  unsigned int  element;
+  char          vr[2];    // explicit VR only
+  unsigned long length;
+};
+
+const unsigned long UndefinedLength = 0xffffffffUL;
+
+// Sequences nested deeper than this are taken as a corrupted file.
+const unsigned int MaximumSequenceDepth = 32;
+
+static bool SkipElementValue(DICOMCursor& cursor, const DICOMElement& e,
+                             unsigned int depth);
+
+
+static bool ReadUInt16(DICOMCursor& cursor, unsigned int& value)
+{
+  if ( cursor.end - cursor.current < 2 )
+  {
+    return false;
+  }
+  value = cursor.current[0] | ( cursor.current[1] << 8 );
+  cursor.current += 2;
+  return true;
+}
+
+
+static bool ReadUInt32(DICOMCursor& cursor, unsigned long& value)
+{
+  if ( cursor.end - cursor.current < 4 )
+  {
+    return false;
+  }
+  value = static_cast<unsigned long>( cursor.current[0] )         |
+          ( static_cast<unsigned long>( cursor.current[1] ) << 8 )  |
+          ( static_cast<unsigned long>( cursor.current[2] ) << 16 ) |
+          ( static_cast<unsigned long>( cursor.current[3] ) << 24 );
+  cursor.current += 4;
+  return true;
+}
+
+
+// The VRs whose length takes 4 bytes (after 2 reserved ones) in explicit VR.
+static bool HasLongLength(const char vr[2])
+{
+  static const char longVRs[][3] =
+    { "OB", "OD", "OF", "OL", "OV", "OW", "SQ", "SV", "UC", "UN", "UR", "UT", "UV" };
+
+  for ( unsigned int i = 0; i < sizeof(longVRs) / sizeof(longVRs[0]); i++ )
+  {
+    if ( vr[0] == longVRs[i][0] && vr[1] == longVRs[i][1] )
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+// Tag, VR and value length of the next element (or item).
+static bool ReadElementHeader(DICOMCursor& cursor, DICOMElement& e)
+{
+  if ( ! ReadUInt16(cursor, e.group) || ! ReadUInt16(cursor, e.element) )
+  {
+    return false;
+  }
+
+  e.vr[0] = e.vr[1] = '\0';
+
+  // The items and delimiters (FFFE,xxxx) have no VR, whatever the syntax.
+  if ( ! cursor.explicitVR || e.group == 0xfffe )
+  {
+    return ReadUInt32(cursor, e.length);
+  }
+
+  if ( cursor.end - cursor.current < 2 )
+  {
+    return false;
+  }
+  e.vr[0] = static_cast<char>( cursor.current[0] );
+  e.vr[1] = static_cast<char>( cursor.current[1] );
+  cursor.current += 2;
+
+  if ( HasLongLength(e.vr) )
+  {
+    unsigned int reserved;
+    return ReadUInt16(cursor, reserved) && ReadUInt32(cursor, e.length);
+  }
+
+  unsigned int length;
+  if ( ! ReadUInt16(cursor, length) )
+  {
+    return false;
+  }
+  e.length = length;
+  return true;
+}
+
+
+// Skips the items of a sequence of undefined length, up to its Sequence
+// Delimitation Item (FFFE,E0DD).
+static bool SkipSequenceItems(DICOMCursor& cursor, unsigned int depth)
+{
+  if ( depth > MaximumSequenceDepth )
+  {
+    return false;
+  }
+
+  for (;;)
+  {
+    DICOMElement item;
+    if ( ! ReadElementHeader(cursor, item) || item.group != 0xfffe )
+    {
+      return false;
+    }
+    if ( item.element == 0xe0dd )
+    {
+      return true;
+    }
+    if ( item.element != 0xe000 )
+    {
+      return false;
+    }
+
+    if ( item.length != UndefinedLength )
+    {
+      if ( item.length > static_cast<unsigned long>( cursor.end - cursor.current ) )
+      {
+        return false;
+      }
+      cursor.current += item.length;
+      continue;
+    }
+
+    // The elements of the item, up to its Item Delimitation Item (FFFE,E00D).
+    for (;;)
+    {
+      DICOMElement e;
+      if ( ! ReadElementHeader(cursor, e) )
+      {
+        return false;
+      }
+      if ( e.group == 0xfffe && e.element == 0xe00d )
+      {
+        break;
+      }
+      if ( ! SkipElementValue(cursor, e, depth + 1) )
+      {
+        return false;
+      }
+    }
+  }
+}
+
+
+static bool SkipElementValue(DICOMCursor&        cursor,
+                             const DICOMElement& e,
+                             unsigned int        depth)
+{
+  if ( e.length != UndefinedLength )
+  {
+    if ( e.length > static_cast<unsigned long>( cursor.end - cursor.current ) )
+    {
+      return false;
+    }
+    cursor.current += e.length;
+    return true;
+  }
+
+  // Only a sequence can have an undefined length. An UN value of
+  // undefined length is a sequence encoded in implicit VR.
+  if ( e.vr[0] == 'U' && e.vr[1] == 'N' )
+  {
+    DICOMCursor implicitCursor = cursor;
+    implicitCursor.explicitVR = false;
+    const bool skipped = SkipSequenceItems(implicitCursor, depth);
+    cursor.current = implicitCursor.current;
+    return skipped;
+  }
+  return SkipSequenceItems(cursor, depth);
+}
+
+
+// Value of a string element, without its padding (space or null).
+static std::string ElementString(const DICOMCursor& cursor, unsigned long length)
+{
+  const char* value = reinterpret_cast<const char*>( cursor.current );
+  while ( length > 0 && ( value[length-1] == ' ' || value[length-1] == '\0' ) )
+  {
+    length--;
+  }
+  return std::string(value, length);
+}
+
+
+// Whether the value of "tag" is read into the header.
+static bool IsHeaderValueTag(unsigned long tag)
+{
+  switch ( tag )
+  {
+    case 0x00020010:  // Transfer Syntax UID
+    case 0x00080018:  // SOP Instance UID
+    case 0x0020000e:  // Series Instance UID
+    case 0x00200013:  // Instance Number
+    case 0x00200032:  // Image Position (Patient)
+    case 0x00200037:  // Image Orientation (Patient)
+    case 0x00200052:  // Frame of Reference UID
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+bool ReadCTSliceHeader(const std::string& fileName, CTSliceHeader& header)
+{
+  MappedTextFile file;
+  std::string    error;
+  if ( ! file.Open(fileName.c_str(), error) )
+  {
+    return false;
+  }
+
+  DICOMCursor cursor;
+  cursor.current = reinterpret_cast<const unsigned char*>( file.GetBegin() );
+  cursor.end     = reinterpret_cast<const unsigned char*>( file.GetEnd() );
+
+  // A DICOM file has a preamble of 128 bytes, "DICM" and the File Meta
+  // Information (group 0002), always in explicit VR little endian.
+  // Older files start directly with the data set, whose VR encoding is
+  // then guessed from the first element.
+  bool metaInformation = file.GetSize() >= 132 &&
+                         memcmp(file.GetBegin() + 128, "DICM", 4) == 0;
+  if ( metaInformation )
+  {
+    cursor.current   += 132;
+    cursor.explicitVR = true;
+  } else
+  {
+    cursor.explicitVR = file.GetSize() >= 6 &&
+                        isupper(cursor.current[4]) && isupper(cursor.current[5]);
+  }
+
+  header = CTSliceHeader();
+  header.fileName = fileName;
+
+  std::string transferSyntax;
+  bool        hasPosition = false;
+
+  while ( cursor.current != cursor.end )
+  {
+    const unsigned char* elementBegin = cursor.current;
+
+    DICOMElement e;
+    if ( ! ReadElementHeader(cursor, e) )
+    {
+      return false;
+    }
+
+    // The data set starts, in its own transfer syntax: its first element
+    // is read again.
+    if ( metaInformation && e.group != 0x0002 )
+    {
+      metaInformation = false;
+      if ( transferSyntax == "1.2.840.10008.1.2" )
+      {
+        cursor.explicitVR = false;
+      } else if ( transferSyntax == "1.2.840.10008.1.2.2" ||    // big endian
+                  transferSyntax == "1.2.840.10008.1.2.1.99" )  // deflated
+      {
+        return false;
+      }
+      cursor.current = elementBegin;
+      continue;
+    }
+
+    // Nothing is needed after the Frame of Reference UID, so the scan
+    // never gets near the pixel data.
+    if ( e.group > 0x0020 || ( e.group == 0x0020 && e.element > 0x0052 ) )
+    {
+      break;
+    }
+
+    const unsigned long tag = ( static_cast<unsigned long>( e.group ) << 16 ) | e.element;
+
+    // Only a sequence can have an undefined length: the values read are
+    // strings, which must lie within the file.
+    if ( e.length == UndefinedLength )
+    {
+      if ( IsHeaderValueTag(tag) )
+      {
+        return false;
+      }
+    } else if ( e.length > static_cast<unsigned long>( cursor.end - cursor.current ) )
+    {
+      return false;
+    }
+
+    switch ( tag )
+    {
+      case 0x00020010:
+        transferSyntax = ElementString(cursor, e.length);
+        break;
+      case 0x00080018:
+        header.sopInstanceUID = ElementString(cursor, e.length);
+        break;
+      case 0x0020000e:
+        header.seriesInstanceUID = ElementString(cursor, e.length);
+        break;
+      case 0x00200013:
+        header.instanceNumber = atoi( ElementString(cursor, e.length).c_str() );
+        break;
+      case 0x00200032:
+        hasPosition = sscanf( ElementString(cursor, e.length).c_str(), "%lf\\%lf\\%lf",
+                              &header.position[0], &header.position[1], &header.position[2] ) == 3;
+        break;
+      case 0x00200037:
+        if ( sscanf( ElementString(cursor, e.length).c_str(), "%lf\\%lf\\%lf\\%lf\\%lf\\%lf",
+                     &header.orientation[0], &header.orientation[1], &header.orientation[2],
+                     &header.orientation[3], &header.orientation[4], &header.orientation[5] ) != 6 )
+        {
+          for ( unsigned int i = 0; i < 6; i++ )
+          {
+            header.orientation[i] = 0.0;
+          }
+        }
+        break;
+      case 0x00200052:
+        header.frameOfReferenceUID = ElementString(cursor, e.length);
+        break;
+      default:
+        break;
+    }
+
+    if ( ! SkipElementValue(cursor, e, 0) )
+    {
+      return false;
+    }
+  }
+
+  return ! header.sopInstanceUID.empty() && hasPosition;
+}
+
+
+// -------------------------------------------------------------
+// Parallel scan of a series directory.
+// -------------------------------------------------------------
+typedef struct CTSeriesScan_struct
+{
+  std::vector<std::string>        names;      // in the directory
+  std::vector<std::string>        fileNames;  // with the directory
+  std::vector<unsigned long>      sizes;
+  std::vector<long>               modifiedTimes;
+  std::vector<CTSliceHeader>      headers;
+  std::vector<char>               read;       // per file (not vector<bool>,
+                                              // whose flags share words)
+
+  // The files not found unchanged in the cache, which are read.
+  std::vector<unsigned int>       toRead;
+} *CTSeriesScan_handle;
+
+
+static ITK_THREAD_RETURN_TYPE ScanCTSeriesThreadCallback(void* arg)
+{
+  itk::MultiThreader::ThreadInfoStruct* info =
+    static_cast<itk::MultiThreader::ThreadInfoStruct*>(arg);
+  CTSeriesScan_handle scan = static_cast<CTSeriesScan_handle>( info->UserData );
+
+  for ( unsigned int j = info->ThreadID; j < scan->toRead.size();
+        j += info->NumberOfThreads )
+  {
+    const unsigned int k = scan->toRead[j];
+    scan->read[k] = ReadCTSliceHeader(scan->fileNames[k], scan->headers[k]);
+  }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+// -------------------------------------------------------------
+// Series cache: the result of the scan of every file of the directory
+// (whether or not it is a slice of the series), with the size and the
+// modification time of the file. The files found unchanged are not read
+// again.
+//
+// The binary layout, in the byte order of the machine:
+//   "CTSERIES", version, byte order mark, size of a long, number of files
+//   per file: name, size, modification time, read flag, and if read:
+//             SOP Instance UID, Series Instance UID, Frame of Reference
+//             UID, Instance Number, Image Position (Patient), Image
+//             Orientation (Patient)
+// The strings are written as their length followed by their characters.
+// -------------------------------------------------------------
+const char         CTSeriesCacheMagic[8]  = { 'C', 'T', 'S', 'E', 'R', 'I', 'E', 'S' };
+const unsigned int CTSeriesCacheVersion   = 3;
+const unsigned int CTSeriesCacheByteOrder = 0x01020304;
+const unsigned int CTSeriesCacheLongSize  = sizeof(long);
+
+// Longer strings can only come from a corrupted cache.
+const unsigned int CTSeriesCacheMaximumString = 0xffff;
+
+struct CTSeriesCacheEntry
+{
+  unsigned long size;           // as given by itksys::SystemTools
+  long          modifiedTime;
+  char          read;
+  CTSliceHeader header;
+};
+
+typedef std::map<std::string, CTSeriesCacheEntry> CTSeriesCacheType;
+
+
+template <class T>
+static void WriteCacheValue(std::ostream& os, const T& value)
+{
+  os.write(reinterpret_cast<const char*>( &value ), sizeof(T));
+}
+
+
+template <class T>
+static bool ReadCacheValue(std::istream& is, T& value)
+{
+  return is.read(reinterpret_cast<char*>( &value ), sizeof(T)).good();
+}
+
+
+static void WriteCacheString(std::ostream& os, const std::string& value)
+{
+  WriteCacheValue(os, static_cast<unsigned int>( value.size() ));
+  os.write(value.data(), value.size());
+}
+
+
+static bool ReadCacheString(std::istream& is, std::string& value)
+{
+  unsigned int length;
+  if ( ! ReadCacheValue(is, length) || length > CTSeriesCacheMaximumString )
+  {
+    return false;
+  }
+  value.resize(length);
+  return length == 0 || is.read(&value[0], length).good();
+}
+
+
+// Returns false (with an empty "cache") if there is no valid cache.
+static bool ReadCTSeriesCache(const std::string& cacheFileName, CTSeriesCacheType& cache)
+{
+  cache.clear();
+
+  std::ifstream is(cacheFileName.c_str(), std::ios::in | std::ios::binary);
+  if ( ! is )
+  {
+    return false;
+  }
+
+  char         magic[8];
+  unsigned int version, byteOrder, longSize, numberOfFiles;
+  bool valid = is.read(magic, 8).good() &&
+               memcmp(magic, CTSeriesCacheMagic, 8) == 0 &&
+               ReadCacheValue(is, version)   && version == CTSeriesCacheVersion &&
+               ReadCacheValue(is, byteOrder) && byteOrder == CTSeriesCacheByteOrder &&
+               ReadCacheValue(is, longSize)  && longSize == CTSeriesCacheLongSize &&
+               ReadCacheValue(is, numberOfFiles);
+
+  for ( unsigned int k = 0; valid && k < numberOfFiles; k++ )
+  {
+    std::string        name;
+    CTSeriesCacheEntry entry;
+    valid = ReadCacheString(is, name) &&
+            ReadCacheValue(is, entry.size) &&
+            ReadCacheValue(is, entry.modifiedTime) &&
+            ReadCacheValue(is, entry.read);
+    if ( valid && entry.read )
+    {
+      CTSliceHeader& header = entry.header;
+      valid = ReadCacheString(is, header.sopInstanceUID) &&
+              ReadCacheString(is, header.seriesInstanceUID) &&
+              ReadCacheString(is, header.frameOfReferenceUID) &&
+              ReadCacheValue(is, header.instanceNumber) &&
+              ReadCacheValue(is, header.position[0]) &&
+              ReadCacheValue(is, header.position[1]) &&
+              ReadCacheValue(is, header.position[2]);
+      for ( unsigned int i = 0; valid && i < 6; i++ )
+      {
+        valid = ReadCacheValue(is, header.orientation[i]);
+      }
+    }
+    cache[name] = entry;
+  }
+
+  if ( ! valid )
+  {
+    cache.clear();
+  }
+  return valid;
+}
+
+
+// The cache is written to a temporary file first, so that an export
+// running at the same time never reads a partly written cache. The
+// temporary file is named after the process and the scan, so that the
+// exports of a batch, or several processes, scanning the same series at
+// the same time do not write into the same one.
+static bool WriteCTSeriesCache(const std::string& cacheFileName, const CTSeriesScan_struct& scan)
+{
+  char writer[64];
+  sprintf(writer, ".%lu-%lx", static_cast<unsigned long>( getpid() ),
+          static_cast<unsigned long>( reinterpret_cast<size_t>( &scan ) ));
+  const std::string temporaryFileName = cacheFileName + writer + ".tmp";
+
+  std::ofstream os(temporaryFileName.c_str(), std::ios::out | std::ios::binary);
+  if ( ! os )
+  {
+    return false;
+  }
+
+  os.write(CTSeriesCacheMagic, 8);
+  WriteCacheValue(os, CTSeriesCacheVersion);
+  WriteCacheValue(os, CTSeriesCacheByteOrder);
+  WriteCacheValue(os, CTSeriesCacheLongSize);
+  WriteCacheValue(os, static_cast<unsigned int>( scan.names.size() ));
+
+  for ( unsigned int k = 0; k < scan.names.size(); k++ )
+  {
+    WriteCacheString(os, scan.names[k]);
+    WriteCacheValue(os, scan.sizes[k]);
+    WriteCacheValue(os, scan.modifiedTimes[k]);
+    WriteCacheValue(os, scan.read[k]);
+    if ( scan.read[k] )
+    {
+      const CTSliceHeader& header = scan.headers[k];
+      WriteCacheString(os, header.sopInstanceUID);
+      WriteCacheString(os, header.seriesInstanceUID);
+      WriteCacheString(os, header.frameOfReferenceUID);
+      WriteCacheValue(os, header.instanceNumber);
+      WriteCacheValue(os, header.position[0]);
+      WriteCacheValue(os, header.position[1]);
+      WriteCacheValue(os, header.position[2]);
+      for ( unsigned int i = 0; i < 6; i++ )
+      {
+        WriteCacheValue(os, header.orientation[i]);
+      }
+    }
+  }
+
+  os.close();
+  if ( os.fail() )
+  {
+    remove( temporaryFileName.c_str() );
+    return false;
+  }
+
+  // rename() does not replace an existing file on Windows.
+  remove( cacheFileName.c_str() );
+  return rename( temporaryFileName.c_str(), cacheFileName.c_str() ) == 0;
+}
+
+
+static bool HasSuffix(const std::string& name, const std::string& suffix)
+{
+  return name.size() >= suffix.size() &&
+         name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+
+// Order of the slices in the series: by Instance Number, which is the
+// numbering of the slices in the parameter file, then by z.
+static bool IsBefore(const CTSliceHeader& a, const CTSliceHeader& b)
+{
+  if ( a.instanceNumber != b.instanceNumber )
+  {
+    return a.instanceNumber < b.instanceNumber;
+  }
+  return a.position[2] < b.position[2];
+}
+
+
+std::string CTSeriesCacheFileName(const std::string& directory,
+                                  const std::string& seriesInstanceUID)
+{
+  const std::string path = directory.empty() ? std::string(".") : directory;
+  return path + "/" + seriesInstanceUID + CTSeriesCacheExtension;
+}
+
+
+bool ScanCTSeries(const std::string&          directoryName,
+                  const std::string&          seriesInstanceUID,
+                  const std::string&          cacheFileName,
+                  unsigned int                numberOfThreads,
+                  std::vector<CTSliceHeader>& slices,
+                  std::string&                error)
+{
+  slices.clear();
+
+  const std::string path = directoryName.empty() ? std::string(".") : directoryName;
+
+  itksys::Directory directory;
+  if ( ! directory.Load( path.c_str() ) )
+  {
+    error = "Unable to read the directory:  " + path;
+    return false;
+  }
+
+  CTSeriesScan_struct scan;
+  for ( unsigned long i = 0; i < directory.GetNumberOfFiles(); i++ )
+  {
+    const std::string name = directory.GetFile(i);
+    const std::string fileName = path + "/" + name;
+    if ( ! HasSuffix(name, CTSeriesCacheExtension) &&
+         ! ( HasSuffix(name, ".tmp") &&
+             name.find(CTSeriesCacheExtension + std::string(".")) != std::string::npos ) &&
+         ! itksys::SystemTools::FileIsDirectory( fileName.c_str() ) )
+    {
+      scan.names.push_back(name);
+      scan.fileNames.push_back(fileName);
+      scan.sizes.push_back( itksys::SystemTools::FileLength( fileName.c_str() ) );
+      scan.modifiedTimes.push_back( itksys::SystemTools::ModifiedTime( fileName.c_str() ) );
+    }
+  }
+
+  scan.headers.resize(scan.fileNames.size());
+  scan.read.assign(scan.fileNames.size(), false);
+
+  // Only the files that are new, or whose size or modification time
+  // changed, are read.
+  CTSeriesCacheType cache;
+  if ( ! cacheFileName.empty() )
+  {
+    ReadCTSeriesCache(cacheFileName, cache);
+  }
+
+  for ( unsigned int k = 0; k < scan.fileNames.size(); k++ )
+  {
+    CTSeriesCacheType::const_iterator entry = cache.find( scan.names[k] );
+    if ( entry != cache.end() &&
+         entry->second.size == scan.sizes[k] &&
+         entry->second.modifiedTime == scan.modifiedTimes[k] )
+    {
+      scan.read[k]    = entry->second.read;
+      scan.headers[k] = entry->second.header;
+      scan.headers[k].fileName = scan.fileNames[k];
+    } else
+    {
+      scan.toRead.push_back(k);
+    }
+  }
+
+  if ( ! scan.toRead.empty() )
+  {
+    // Each file takes a few system calls and the reading of its first
+    // pages: the threads mostly wait for the disk.
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads( std::max( 1u, std::min( numberOfThreads,
+      static_cast<unsigned int>( scan.toRead.size() ) ) ) );
+    threader->SetSingleMethod(ScanCTSeriesThreadCallback, &scan);
+    threader->SingleMethodExecute();
+  }
+
+  // The cache is written again if a file was read, added or removed.
+  if ( ! cacheFileName.empty() &&
+       ( ! scan.toRead.empty() || cache.size() != scan.names.size() ) )
+  {
+    if ( ! WriteCTSeriesCache(cacheFileName, scan) )
+    {
+      std::cerr << "Unable to write the series cache:  " << cacheFileName << std::endl;
+    }
+  }
+
+  for ( unsigned int k = 0; k < scan.fileNames.size(); k++ )
+  {
+    if ( scan.read[k] && scan.headers[k].seriesInstanceUID == seriesInstanceUID )
+    {
+      slices.push_back(scan.headers[k]);
+    }
+  }
+
+  if ( slices.empty() )
+  {
+    error = "No slice of the series " + seriesInstanceUID + " in the directory:  " + path;
+    return false;
+  }
+
+  std::stable_sort(slices.begin(), slices.end(), IsBefore);
+  return true;
+}
+
+
+bool CTSliceHeader::IsAxial() const
+{
+  // The normal of the slice (the cross product of the direction cosines
+  // of its rows and columns) must be along z.
+  const double* row    = orientation;
+  const double* column = orientation + 3;
+  const double  normalZ = row[0] * column[1] - row[1] * column[0];
+  return fabs(normalZ) > 0.999;
+}
+
+
+bool CTSliceLocator::Initialize(const std::vector<CTSliceHeader>& slices, double tolerance)
+{
+  m_Positions.clear();
+  m_Tolerance = 0.0;
+  for ( unsigned int k = 0; k < slices.size(); k++ )
+  {
+    if ( ! slices[k].IsAxial() )
+    {
+      return false;
+    }
+  }
+
+  m_Positions.resize(slices.size());
+  for ( unsigned int k = 0; k < slices.size(); k++ )
+  {
+    m_Positions[k] = std::make_pair( slices[k].position[2], k );
+  }
+  std::sort(m_Positions.begin(), m_Positions.end());
+
+  m_Tolerance = tolerance;
+  if ( m_Tolerance < 0.0 )
+  {
+    // Slices at the same z (e.g. of several acquisitions) are not taken
+    // into account.
+    double smallestDistance = 0.0;
+    for ( unsigned int k = 1; k < m_Positions.size(); k++ )
+    {
+      const double distance = m_Positions[k].first - m_Positions[k-1].first;
+      if ( distance > 0.0 && ( smallestDistance == 0.0 || distance < smallestDistance ) )
+      {
+        smallestDistance = distance;
+      }
+    }
+    if ( smallestDistance == 0.0 )
+    {
+      m_Positions.clear();
+      return false;
+    }
+    m_Tolerance = 0.25 * smallestDistance;
+  }
+  return true;
+}
+
+
+bool CTSliceLocator::FindSlice(double z, unsigned int& index) const
+{
+  // The first slice at or above z, and the one below it.
+  std::vector< std::pair<double, unsigned int> >::const_iterator above =
+    std::lower_bound( m_Positions.begin(), m_Positions.end(),
+                      std::make_pair( z, 0u ) );
+
+  double nearestDistance = m_Tolerance;
+  bool   found = false;
+  if ( above != m_Positions.end() && above->first - z <= nearestDistance )
+  {
+    nearestDistance = above->first - z;
+    index = above->second;
+    found = true;
+  }
+  if ( above != m_Positions.begin() && z - (above - 1)->first <= nearestDistance )
+  {
+    // Among slices at the same z, the first one of the series.
+    const double belowZ = (above - 1)->first;
+    while ( above != m_Positions.begin() && (above - 1)->first == belowZ )
+    {
+      --above;
+    }
+    index = above->second;
+    found = true;
+  }
+  return found;
+}
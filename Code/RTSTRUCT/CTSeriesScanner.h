@@ -0,0 +1,105 @@
+#ifndef __CTSeriesScanner_h
+#define __CTSeriesScanner_h
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// -------------------------------------------------------------
+// CTSliceHeader: the attributes of a CT slice that a structure set
+// needs in order to reference it.
+// -------------------------------------------------------------
+struct CTSliceHeader
+{
+  std::string fileName;
+  std::string sopInstanceUID;       // (0008,0018)
+  std::string seriesInstanceUID;    // (0020,000e)
+  std::string frameOfReferenceUID;  // (0020,0052)
+  int         instanceNumber;       // (0020,0013), 0 if not given
+  double      position[3];          // Image Position (Patient) (0020,0032)
+  double      orientation[6];       // Image Orientation (Patient) (0020,0037),
+                                    // 0 if not given
+
+  CTSliceHeader() : instanceNumber(0)
+    {
+    position[0] = position[1] = position[2] = 0.0;
+    for ( unsigned int i = 0; i < 6; i++ )
+      {
+      orientation[i] = 0.0;
+      }
+    }
+
+  // Whether the slice is axial (its rows and columns in the x-y plane of
+  // the patient), which is needed for its z to locate contours.
+  bool IsAxial() const;
+};
+
+
+// Reads the attributes of CTSliceHeader from a DICOM file. The data set
+// is scanned only up to the Frame of Reference UID (0020,0052): the rest
+// of the header, and the pixel data, are never read.
+// Only the little endian transfer syntaxes (implicit or explicit VR) are
+// read. Returns false if the file is not such a DICOM file, or if it has
+// no SOP Instance UID or no Image Position (Patient).
+bool ReadCTSliceHeader(const std::string& fileName, CTSliceHeader& header);
+
+
+// Reads the headers of all the files of a directory with (at most)
+// "numberOfThreads" threads, and returns in "slices" those of the series
+// "seriesInstanceUID", sorted by Instance Number (then by z).
+//
+// Unless "cacheFileName" is empty, the headers are also kept in this
+// cache file, and are only read again from the files whose size or
+// modification time changed. A repeated scan of an unchanged series
+// then reads no DICOM file at all.
+//
+// Returns false and fills "error" if the directory can not be read or
+// holds no slice of the series.
+bool ScanCTSeries(const std::string&          directory,
+                  const std::string&          seriesInstanceUID,
+                  const std::string&          cacheFileName,
+                  unsigned int                numberOfThreads,
+                  std::vector<CTSliceHeader>& slices,
+                  std::string&                error);
+
+
+// Cache of a series kept in "directory":
+// "<directory>/<seriesInstanceUID>.ctseries". The cache files are skipped
+// by the scan.
+const char* const CTSeriesCacheExtension = ".ctseries";
+
+std::string CTSeriesCacheFileName(const std::string& directory,
+                                  const std::string& seriesInstanceUID);
+
+
+// -------------------------------------------------------------
+// CTSliceLocator: finds the slice of a series at a given z, by binary
+// search over the sorted z of the Image Positions (Patient) of the
+// slices. A lookup is O(log n), and gapped or unevenly spaced series
+// are handled as well as regular ones.
+// -------------------------------------------------------------
+class CTSliceLocator
+{
+public:
+  CTSliceLocator() : m_Tolerance(0.0) {}
+
+  // A slice is found at a z if its own z is within "tolerance" of it.
+  // A negative tolerance stands for a quarter of the smallest distance
+  // between two slices. Returns false, and finds no slice, if a slice is
+  // not axial, or if the tolerance is negative and all the slices are at
+  // the same z (e.g. a single slice).
+  bool Initialize(const std::vector<CTSliceHeader>& slices, double tolerance = -1.0);
+
+  // Index in "slices" of the slice nearest to "z"; false if no slice is
+  // within the tolerance.
+  bool FindSlice(double z, unsigned int& index) const;
+
+  double GetTolerance() const { return m_Tolerance; }
+  bool   IsEmpty() const      { return m_Positions.empty(); }
+
+private:
+  std::vector< std::pair<double, unsigned int> > m_Positions;  // sorted z, index
+  double                                         m_Tolerance;
+};
+
+#endif // __CTSeriesScanner_h
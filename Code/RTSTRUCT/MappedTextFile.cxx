@@ -0,0 +1,224 @@
+#include "MappedTextFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+MappedTextFile::MappedTextFile()
+  : m_Begin(0), m_Size(0)
+#ifdef _WIN32
+  , m_File(INVALID_HANDLE_VALUE), m_Mapping(0)
+#endif
+{
+}
+
+
+#ifdef _WIN32
+
+bool MappedTextFile::Open(const char* fileName, std::string& error)
+{
+  Close();
+
+  m_File = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if ( m_File == INVALID_HANDLE_VALUE )
+  {
+    error = std::string("Unable to open the file:  ") + fileName;
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if ( ! GetFileSizeEx(m_File, &size) )
+  {
+    error = std::string("Unable to get the size of the file:  ") + fileName;
+    Close();
+    return false;
+  }
+
+  // An empty file can not be mapped, and needs not be.
+  m_Size = static_cast<size_t>( size.QuadPart );
+  if ( m_Size == 0 )
+  {
+    return true;
+  }
+
+  m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+  if ( m_Mapping )
+  {
+    m_Begin = static_cast<const char*>( MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0) );
+  }
+  if ( ! m_Begin )
+  {
+    error = std::string("Unable to map the file:  ") + fileName;
+    Close();
+    return false;
+  }
+  return true;
+}
+
+
+void MappedTextFile::Close()
+{
+  if ( m_Begin )
+  {
+    UnmapViewOfFile(m_Begin);
+  }
+  if ( m_Mapping )
+  {
+    CloseHandle(m_Mapping);
+  }
+  if ( m_File != INVALID_HANDLE_VALUE )
+  {
+    CloseHandle(m_File);
+  }
+  m_Begin   = 0;
+  m_Size    = 0;
+  m_Mapping = 0;
+  m_File    = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedTextFile::Open(const char* fileName, std::string& error)
+{
+  Close();
+
+  const int fd = open(fileName, O_RDONLY);
+  if ( fd < 0 )
+  {
+    error = std::string("Unable to open the file:  ") + fileName;
+    return false;
+  }
+
+  struct stat status;
+  if ( fstat(fd, &status) != 0 )
+  {
+    error = std::string("Unable to get the size of the file:  ") + fileName;
+    close(fd);
+    return false;
+  }
+
+  // An empty file can not be mapped, and needs not be.
+  m_Size = static_cast<size_t>( status.st_size );
+  if ( m_Size > 0 )
+  {
+    void* mapping = mmap(0, m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if ( mapping == MAP_FAILED )
+    {
+      error = std::string("Unable to map the file:  ") + fileName;
+      m_Size = 0;
+      close(fd);
+      return false;
+    }
+    m_Begin = static_cast<const char*>( mapping );
+
+    // The file is read once, from the start to the end.
+    madvise(mapping, m_Size, MADV_SEQUENTIAL);
+  }
+
+  // The mapping stays valid once the file is closed.
+  close(fd);
+  return true;
+}
+
+
+void MappedTextFile::Close()
+{
+  if ( m_Begin )
+  {
+    munmap(const_cast<char*>( m_Begin ), m_Size);
+  }
+  m_Begin = 0;
+  m_Size  = 0;
+}
+
+#endif
+
+
+void ContourTextTokenizer::SkipHeaders(TextView& header)
+{
+  header = TextView();
+
+  for (;;)
+  {
+    while ( m_Current != m_End && IsSpace(*m_Current) )
+    {
+      ++m_Current;
+    }
+    if ( m_Current == m_End || *m_Current != '[' )
+    {
+      return;
+    }
+
+    // The header is the rest of the line, whatever its length.
+    const char* nameBegin = ++m_Current;
+    while ( m_Current != m_End && *m_Current != '\n' && *m_Current != ']' )
+    {
+      ++m_Current;
+    }
+    header = TextView( nameBegin, m_Current - nameBegin );
+
+    while ( m_Current != m_End && *m_Current != '\n' )
+    {
+      ++m_Current;
+    }
+  }
+}
+
+
+bool ContourTextTokenizer::NextToken(TextView& token)
+{
+  while ( m_Current != m_End && IsSpace(*m_Current) )
+  {
+    ++m_Current;
+  }
+
+  const char* tokenBegin = m_Current;
+  while ( m_Current != m_End && ! IsSpace(*m_Current) )
+  {
+    ++m_Current;
+  }
+
+  token = TextView( tokenBegin, m_Current - tokenBegin );
+  return token.length > 0;
+}
+
+
+bool ContourTextTokenizer::NextUnsigned(unsigned int& value)
+{
+  size_t size;
+  if ( ! NextSize(size) || size > static_cast<unsigned int>(-1) )
+  {
+    return false;
+  }
+  value = static_cast<unsigned int>( size );
+  return true;
+}
+
+
+bool ContourTextTokenizer::NextSize(size_t& value)
+{
+  TextView token;
+  if ( ! NextToken(token) )
+  {
+    return false;
+  }
+
+  value = 0;
+  for ( size_t i = 0; i < token.length; i++ )
+  {
+    const char c = token.data[i];
+    if ( c < '0' || c > '9' )
+    {
+      return false;
+    }
+    value = 10 * value + ( c - '0' );
+  }
+  return true;
+}
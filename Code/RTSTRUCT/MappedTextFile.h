@@ -0,0 +1,99 @@
+#ifndef __MappedTextFile_h
+#define __MappedTextFile_h
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+// -------------------------------------------------------------
+// TextView: a piece of text that is not owned (typically a token inside
+// a MappedTextFile). The text is not null-terminated.
+// -------------------------------------------------------------
+struct TextView
+{
+  const char* data;
+  size_t      length;
+
+  TextView() : data(0), length(0) {}
+  TextView(const char* d, size_t n) : data(d), length(n) {}
+
+  bool Equals(const char* str) const
+    { return strlen(str) == length && strncmp(data, str, length) == 0; }
+
+  std::string ToString() const { return std::string(data, length); }
+};
+
+
+// -------------------------------------------------------------
+// MappedTextFile: a read-only file mapped into memory (mmap, or
+// MapViewOfFile on Windows), so that it can be parsed in place.
+// The views handed out by the tokenizer stay valid until the file is
+// closed.
+// -------------------------------------------------------------
+class MappedTextFile
+{
+public:
+  MappedTextFile();
+  ~MappedTextFile() { Close(); }
+
+  // Returns false and fills "error" on failure.
+  bool Open(const char* fileName, std::string& error);
+  void Close();
+
+  const char* GetBegin() const { return m_Begin; }
+  const char* GetEnd() const   { return m_Begin + m_Size; }
+  size_t      GetSize() const  { return m_Size; }
+
+private:
+  const char* m_Begin;
+  size_t      m_Size;
+
+#ifdef _WIN32
+  void*       m_File;
+  void*       m_Mapping;
+#endif
+
+  // Not copyable: the mapping is owned.
+  MappedTextFile(const MappedTextFile&);
+  void operator=(const MappedTextFile&);
+};
+
+
+// -------------------------------------------------------------
+// ContourTextTokenizer: scans the text written by mask2contour, i.e.
+// values separated by white space (CR/LF line ends included) and
+// "[Section Name]" header lines of any length.
+// -------------------------------------------------------------
+class ContourTextTokenizer
+{
+public:
+  ContourTextTokenizer(const char* begin, const char* end)
+    : m_Current(begin), m_End(end) {}
+
+  // Skips the white space and the header lines. The name of the last
+  // header skipped (without the brackets) is returned in "header",
+  // which is left empty when no header is found.
+  void SkipHeaders(TextView& header);
+  void SkipHeaders() { TextView header; SkipHeaders(header); }
+
+  // Next token, up to the next white space; false at the end of the text.
+  bool NextToken(TextView& token);
+
+  // Next token as an unsigned integer; false if it is not one.
+  bool NextUnsigned(unsigned int& value);
+
+  // Same for a byte offset or a size.
+  bool NextSize(size_t& value);
+
+  const char* GetPosition() const { return m_Current; }
+  bool        AtEnd() const       { return m_Current == m_End; }
+
+private:
+  static bool IsSpace(char c)
+    { return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\v'; }
+
+  const char* m_Current;
+  const char* m_End;
+};
+
+#endif // __MappedTextFile_h
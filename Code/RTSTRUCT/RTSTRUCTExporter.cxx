@@ -0,0 +1,1226 @@
+#include "RTSTRUCTExporter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "itkGDCMImageIO.h" //for reading the reference DICOM-CT-image-slice
+#include "itkRTSTRUCTIO.h" //for writing the output RTSTRUCT
+
+#include "itkImage.h"
+#include "itkImageFileWriter.h"
+
+#include "itkMetaDataObject.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleMutexLock.h"
+
+#include "MappedTextFile.h" //for TextView
+
+using std::endl;
+using std::string;
+using std::stringstream;
+using std::vector;
+
+typedef itk::MetaDataDictionary       DictionaryType;
+typedef itk::MetaDataObject< string > MetaDataStringType;
+
+// Following two values are fixed and are defined in the DICOM standards.
+const string StudyComponentManagementSOPClass = "1.2.840.10008.3.1.2.3.2";
+const string CTImageSOPClassUID = "1.2.840.10008.5.1.4.1.1.2";
+
+const string roiGenAlgorithm = "ITK-GDCM based algorithm";
+
+//---------------------------------------------------
+typedef signed short PixelType; //for the (dummy) writer input
+const unsigned int   Dimension = 2; //for the (dummy) writer input
+
+typedef itk::Image< PixelType, Dimension > ImageType;
+typedef itk::ImageFileWriter < ImageType > WriterType;
+
+typedef itk::GDCMImageIO ImageInType;
+typedef itk::RTSTRUCTIO  STRUCTOutType;
+//---------------------------------------------------
+
+// gdcm is not thread-safe (its dictionaries, its parser and the making of
+// UIDs share state): all the exporters of the process read and write
+// DICOM under this lock, one at a time.
+static itk::SimpleMutexLock GDCMLock;
+
+
+static bool IsTagPresent(DictionaryType::ConstIterator& tagItr,
+                         DictionaryType::ConstIterator& end)
+{
+    if( tagItr == end)
+      return false;
+    
+    return true;
+}
+
+
+// Returns false, after printing it to "log", if the tag is not present.
+static bool CheckTagPresent(const string&                  entryId,
+                            DictionaryType::ConstIterator& tagItr,
+                            DictionaryType::ConstIterator& end,
+                            std::ostream&                  log)
+{
+  if (IsTagPresent(tagItr, end) == false)
+  {
+    log << "Tag: " << entryId;
+    log << " not found in the DICOM header" << endl;
+    return false;
+  }
+  return true;
+}
+
+
+// Empty, after printing it to "log", if the value is not a string.
+static string GetTagValue(DictionaryType::ConstIterator& tagItr,
+                          std::ostream&                  log)
+{
+  MetaDataStringType::ConstPointer entryValue;
+  entryValue =
+           dynamic_cast<const MetaDataStringType *>
+           ( tagItr->second.GetPointer() );
+
+  if( !entryValue )
+  {
+    log << "Tag: " << tagItr->first << " was not of string type" << endl;
+    return string();
+  }
+  return entryValue->GetMetaDataObjectValue();
+}
+
+
+// Returns false if a tag is missing from "dictReader" (all the tags
+// present are still written).
+static bool WriteCompulsoryTags(const vector<string>& mandatoryModule,
+                                const DictionaryType& dictReader,
+                                DictionaryType&       dictWriter,
+                                std::ostream&         log)
+{
+  bool allPresent = true;
+  string tagID;
+  string tagValue;
+
+  vector<string>::const_iterator stringItr;
+  DictionaryType::ConstIterator  tagItr;
+  DictionaryType::ConstIterator  end = dictReader.End();
+
+  for (stringItr = mandatoryModule.begin(); stringItr != mandatoryModule.end(); stringItr++)
+  {
+    tagID  = *stringItr;
+
+    tagItr = dictReader.Find( tagID );
+    if ( ! CheckTagPresent( tagID, tagItr, end, log ) )
+    {
+      allPresent = false;
+      continue;
+    }
+
+    tagValue = GetTagValue( tagItr, log );
+
+    itk::EncapsulateMetaData<string>(dictWriter, tagID, tagValue);
+  }
+  return allPresent;
+}
+
+
+static void WriteOptionalTags(const vector<string>& optionalModule,
+                              const DictionaryType& dictReader,
+                              DictionaryType&       dictWriter,
+                              std::ostream&         log)
+{
+  string tagID;
+  string tagValue;
+
+  vector<string>::const_iterator stringItr;
+  DictionaryType::ConstIterator  tagItr;
+  DictionaryType::ConstIterator  end = dictReader.End();
+
+  for (stringItr = optionalModule.begin(); stringItr != optionalModule.end(); stringItr++)
+  {
+    tagID  = *stringItr;
+
+    tagItr = dictReader.Find( tagID );
+
+    if (IsTagPresent( tagItr, end ) )
+    {
+      tagValue = GetTagValue( tagItr, log );
+      itk::EncapsulateMetaData<string>(dictWriter, tagID, tagValue);
+    }
+  }
+}
+
+
+static string itos(int i)	// convert int to string
+{
+  stringstream s;
+  s << i;
+  return s.str();
+}
+
+
+// z of the first point of a Contour Data (x1\\y1\\z1\\x2\\...), all the points
+// of a planar contour of mask2contour having the same z.
+static bool ContourZ(const TextView& data, double& z)
+{
+  const char* const end = data.data + data.length;
+  const char*       value = data.data;
+  for ( unsigned int i = 0; i < 2; i++ )
+  {
+    value = static_cast<const char*>( memchr(value, '\\', end - value) );
+    if ( ! value )
+    {
+      return false;
+    }
+    value++;
+  }
+
+  const char* valueEnd = static_cast<const char*>( memchr(value, '\\', end - value) );
+  if ( ! valueEnd )
+  {
+    valueEnd = end;
+  }
+  if ( valueEnd == value || valueEnd - value > 64 )
+  {
+    return false;
+  }
+
+  char number[65];
+  memcpy(number, value, valueEnd - value);
+  number[valueEnd - value] = '\0';
+
+  char* numberEnd;
+  z = strtod(number, &numberEnd);
+  return *numberEnd == '\0';
+}
+
+
+// True if all the values of a Contour Data are valid DICOM Decimal Strings.
+static bool IsConformantContourData(const TextView& data)
+{
+  const char* const end = data.data + data.length;
+
+  bool conformant = true;
+  for ( const char* value = data.data; conformant && value < end; )
+  {
+    const char* valueEnd = static_cast<const char*>( memchr(value, '\\', end - value) );
+    if ( ! valueEnd )
+    {
+      valueEnd = end;
+    }
+    conformant = DecimalStringEncoder::IsValid(value, valueEnd - value);
+    value = valueEnd + 1;
+  }
+  return conformant;
+}
+
+
+// Contour Data (x1\\y1\\z1\\x2\\...) whose values are all valid DICOM
+// Decimal Strings. The values are copied as they are, except those that
+// are not valid DS (e.g. written with 16 significant digits and a sign),
+// which are re-encoded.
+static string ConformContourData(const TextView& data, const DecimalStringEncoder& encoder)
+{
+  // Most often, every value is already valid.
+  if ( IsConformantContourData(data) )
+  {
+    return data.ToString();
+  }
+
+  const char* const end = data.data + data.length;
+
+  string conformed;
+  conformed.reserve(data.length);
+
+  char   buffer[DecimalStringEncoder::MaximumLength + 1];
+  string number;
+  for ( const char* value = data.data; value <= end; )
+  {
+    const char* valueEnd = static_cast<const char*>( memchr(value, '\\', end - value) );
+    if ( ! valueEnd )
+    {
+      valueEnd = end;
+    }
+
+    if ( value != data.data )
+    {
+      conformed += '\\';
+    }
+    if ( DecimalStringEncoder::IsValid(value, valueEnd - value) )
+    {
+      conformed.append(value, valueEnd - value);
+    } else
+    {
+      number.assign(value, valueEnd - value);
+      conformed.append(buffer, encoder.Encode( atof( number.c_str() ), buffer ));
+    }
+    value = valueEnd + 1;
+  }
+  return conformed;
+}
+
+
+RTSTRUCTExporter::RTSTRUCTExporter()
+  : m_FirstSlice(1), m_NumberOfSlices(0), m_PlaceContoursByZ(false),
+    m_ZTolerance(-1.0), m_Encoder(0.001),
+    m_NumberOfThreads( static_cast<unsigned int>(
+                         itk::MultiThreader::GetGlobalDefaultNumberOfThreads() ) )
+{
+}
+
+
+void RTSTRUCTExporter::Initialize()
+{
+  GDCMLock.Lock();
+  ImageInType::New();
+  STRUCTOutType::New();
+  GDCMLock.Unlock();
+}
+
+
+bool RTSTRUCTExporter::ReadReferenceHeader(const string& fileName, std::ostream& log)
+{
+  ImageInType::Pointer gdcmIO1 = ImageInType::New(); // for DICOM reader
+
+  // the tags and keys of interest are read from the input DICOM file
+  // and are written to the output RTSTRUCT DICOM file.
+  //
+  // Only the header is read: the pixel data (7fe0,0010), larger than the
+  // "MaxSizeLoadEntry" of the reader, is skipped and never loaded nor
+  // decoded, which matters for compressed CT slices.
+  gdcmIO1->SetFileName(fileName.c_str());
+
+  bool read = true;
+  GDCMLock.Lock();
+  try
+  {
+    gdcmIO1->ReadImageInformation();
+  }
+  catch (itk::ExceptionObject &ex)
+  {
+    log << "Exception caught while reading the i/p DICOM file: " << endl;
+    log << ex << endl;
+    read = false;
+  }
+  GDCMLock.Unlock();
+
+  m_ReferenceHeader = gdcmIO1->GetMetaDataDictionary();
+  return read;
+}
+
+
+string RTSTRUCTExporter::GetReferenceValue(const string& tag, std::ostream& log) const
+{
+  DictionaryType::ConstIterator tagItr = m_ReferenceHeader.Find( tag );
+  DictionaryType::ConstIterator end = m_ReferenceHeader.End();
+  if ( ! IsTagPresent( tagItr, end ) )
+  {
+    return string();
+  }
+  return GetTagValue( tagItr, log );
+}
+
+
+void RTSTRUCTExporter::SetSlices(const string& sopInstanceUIDPrefix, unsigned int firstSlice,
+                                 unsigned int numberOfSlices)
+{
+  m_SOPInstanceUIDPrefix = sopInstanceUIDPrefix;
+  m_FirstSlice           = firstSlice;
+  m_NumberOfSlices       = numberOfSlices;
+}
+
+
+unsigned int RTSTRUCTExporter::AddROI(const string& name, const string& interpretedType,
+                                      const string& displayColor)
+{
+  m_StructureSet.ROIs.push_back( itk::RTROI() );
+  m_Placements.push_back( vector<ContourPlacement>() );
+
+  itk::RTROI& roi = m_StructureSet.ROIs.back();
+  roi.Name            = name;
+  roi.InterpretedType = interpretedType;
+  roi.DisplayColor    = displayColor;
+
+  return static_cast<unsigned int>( m_StructureSet.ROIs.size() - 1 );
+}
+
+
+void RTSTRUCTExporter::ReserveContours(unsigned int roi, unsigned int numberOfContours)
+{
+  m_StructureSet.ROIs[roi].Contours.reserve( numberOfContours );
+  m_Placements[roi].reserve( numberOfContours );
+}
+
+
+itk::RTContour& RTSTRUCTExporter::NewContour(unsigned int roi, const string& geometricType,
+                                             unsigned int numberOfPoints, unsigned int sliceNumber)
+{
+  ContourPlacement placement;
+  placement.z               = 0.0;
+  placement.zValid          = false;
+  placement.textToCheck     = false;
+  placement.sliceNumber     = sliceNumber;
+  placement.referencedSlice = 0;
+  m_Placements[roi].push_back( placement );
+
+  vector<itk::RTContour>& contours = m_StructureSet.ROIs[roi].Contours;
+  contours.push_back( itk::RTContour() );
+
+  itk::RTContour& contour = contours.back();
+  contour.GeometricType  = geometricType;
+  contour.NumberOfPoints = numberOfPoints;
+  return contour;
+}
+
+
+void RTSTRUCTExporter::AddContour(unsigned int roi, const string& geometricType,
+                                  const double* points, unsigned int numberOfPoints,
+                                  unsigned int sliceNumber)
+{
+  itk::RTContour& contour = NewContour( roi, geometricType, numberOfPoints, sliceNumber );
+
+  char buffer[DecimalStringEncoder::MaximumLength + 1];
+  contour.Data.reserve( 3 * numberOfPoints * 8 );
+  for ( unsigned int i = 0; i < 3 * numberOfPoints; i++ )
+  {
+    if ( i > 0 )
+    {
+      contour.Data += '\\';
+    }
+    contour.Data.append( buffer, m_Encoder.Encode( points[i], buffer ) );
+  }
+
+  if ( numberOfPoints > 0 )
+  {
+    m_Placements[roi].back().z      = points[2];
+    m_Placements[roi].back().zValid = true;
+  }
+}
+
+
+void RTSTRUCTExporter::AddContour(unsigned int roi, const string& geometricType,
+                                  unsigned int numberOfPoints, const char* data, size_t length,
+                                  unsigned int sliceNumber, const itk::LightObject* owner)
+{
+  itk::RTContour& contour = NewContour( roi, geometricType, numberOfPoints, sliceNumber );
+
+  if ( owner )
+  {
+    contour.ShareData( data, length, owner );
+  } else
+  {
+    contour.Data.assign( data, length );
+  }
+  m_Placements[roi].back().textToCheck = true;
+}
+
+
+void RTSTRUCTExporter::AddContour(unsigned int roi, const string& geometricType,
+                                  unsigned int numberOfPoints, string& data,
+                                  unsigned int sliceNumber)
+{
+  itk::RTContour& contour = NewContour( roi, geometricType, numberOfPoints, sliceNumber );
+
+  contour.SwapData( data );
+  data.clear();
+  m_Placements[roi].back().textToCheck = true;
+}
+
+
+// Reads the z of the contours of an ROI given as text, and re-encodes
+// those whose values are not all valid Decimal Strings. The text of the
+// other contours, shared or not, is left as it is.
+void RTSTRUCTExporter::CheckContourData(unsigned int roi)
+{
+  vector<itk::RTContour>&   contours   = m_StructureSet.ROIs[roi].Contours;
+  vector<ContourPlacement>& placements = m_Placements[roi];
+
+  for ( unsigned int i = 0; i < contours.size(); i++ )
+  {
+    if ( ! placements[i].textToCheck )
+    {
+      continue;
+    }
+    placements[i].textToCheck = false;
+
+    const TextView text( contours[i].GetDataPointer(), contours[i].GetDataLength() );
+    placements[i].zValid = ContourZ( text, placements[i].z );
+
+    if ( ! IsConformantContourData( text ) )
+    {
+      string conformed = ConformContourData( text, m_Encoder );
+      contours[i].SwapData( conformed );
+    }
+  }
+}
+
+
+// SOP Instance UID of the slice "sliceNumber" (numbered from 1) of the CT
+// series, or made up from the prefix if there is no series.
+string RTSTRUCTExporter::SliceSOPInstanceUID(const vector<CTSliceHeader>& series,
+                                             unsigned int sliceNumber) const
+{
+  if ( sliceNumber >= 1 && sliceNumber <= series.size() )
+  {
+    return series[sliceNumber-1].sopInstanceUID;
+  }
+  return m_SOPInstanceUIDPrefix + itos( sliceNumber );
+}
+
+
+// Whether the slice "sliceNumber" (numbered from 1) is one of the CT
+// series, or, if there is no series, one of the segmented image.
+bool RTSTRUCTExporter::IsSliceInSeries(const vector<CTSliceHeader>& series,
+                                       unsigned int sliceNumber) const
+{
+  if ( ! series.empty() )
+  {
+    return sliceNumber >= 1 && sliceNumber <= series.size();
+  }
+  return sliceNumber >= m_FirstSlice && sliceNumber < m_FirstSlice + m_NumberOfSlices;
+}
+
+
+// Slice of the series (numbered from 1, as for SliceSOPInstanceUID) of
+// each contour of an ROI, found from the z of the contour.
+// Returns false (with "slices" empty) if a contour is on no slice.
+bool RTSTRUCTExporter::LocateContourSlices(unsigned int          roi,
+                                           const CTSliceLocator& locator,
+                                           vector<unsigned int>& slices) const
+{
+  const vector<ContourPlacement>& placements = m_Placements[roi];
+
+  slices.resize(placements.size());
+  for ( unsigned int i = 0; i < placements.size(); i++ )
+  {
+    unsigned int index;
+    if ( ! placements[i].zValid || ! locator.FindSlice( placements[i].z, index ) )
+    {
+      slices.clear();
+      return false;
+    }
+    slices[i] = index + 1;
+  }
+  return true;
+}
+
+
+// Contour Image Sequence of each contour of an ROI: the CT slice of the
+// contour is found from its z, unless "locator" is empty (the contours
+// are not placed by z). The slice numbers given to AddContour() are used
+// otherwise, and if some contour of the ROI lies on no slice of the
+// series (the contours are then not in the coordinates of the CT series,
+// e.g. for a mask written without its origin); returns false in the
+// latter case. A contour whose slice number is beyond the series
+// references no CT slice (its referencedSlice is 0).
+bool RTSTRUCTExporter::PlaceContours(unsigned int roi, const vector<CTSliceHeader>& series,
+                                     const CTSliceLocator& locator)
+{
+  vector<unsigned int> contourSlices;
+  const bool located = series.empty() || locator.IsEmpty() ||
+                       LocateContourSlices( roi, locator, contourSlices );
+
+  vector<itk::RTContour>& contours = m_StructureSet.ROIs[roi].Contours;
+  for ( unsigned int count = 1; count <= contours.size(); count++ )
+  {
+    itk::RTContour& contour = contours[count-1];
+
+    // 1.3.1.1
+    // Referenced SOP Class UID:
+    // Uniquely identifies the referenced image SOP instance
+    // It's value is constant = CTImageSOPClassUID
+    contour.ContourImage.ReferencedSOPClassUID = CTImageSOPClassUID;
+
+    // 1.3.1.2
+    // Finding the Referenced SOP Instance UID, from the position of the
+    // contour or else from its slice Number
+    ContourPlacement& placement = m_Placements[roi][count-1];
+    if ( ! contourSlices.empty() )
+    {
+      placement.referencedSlice = contourSlices[count-1];
+    } else
+    {
+      placement.referencedSlice = m_FirstSlice + placement.sliceNumber;
+    }
+    if ( ! IsSliceInSeries( series, placement.referencedSlice ) )
+    {
+      placement.referencedSlice = 0;
+      contour.ContourImage = itk::RTReferencedImage();
+      continue;
+    }
+    contour.ContourImage.ReferencedSOPInstanceUID =
+      SliceSOPInstanceUID( series, placement.referencedSlice );
+  }
+  return located;
+}
+
+
+// The ROIs of an export, shared by the threads of Write(): each thread
+// takes the next ROI until there is none left, so that large and small
+// ROIs balance out. A thread only writes the contours of its ROIs, in
+// place, so the structure set is the same whatever the threads.
+typedef struct BuildROIs_struct
+{
+  RTSTRUCTExporter*                  exporter;
+  const vector<CTSliceHeader>*       series;
+  const CTSliceLocator*              locator;
+  unsigned int                       numberOfROIs;
+  unsigned int                       nextROI;   // under "lock"
+  vector<char>                       located;   // per ROI
+  itk::SimpleMutexLock               lock;
+} *BuildROIs_handle;
+
+ITK_THREAD_RETURN_TYPE RTSTRUCTExporter::BuildROIsThreadCallback(void* arg)
+{
+  itk::MultiThreader::ThreadInfoStruct* info =
+    static_cast<itk::MultiThreader::ThreadInfoStruct*>(arg);
+  BuildROIs_handle build = static_cast<BuildROIs_handle>( info->UserData );
+
+  for (;;)
+  {
+    build->lock.Lock();
+    const unsigned int roi = build->nextROI++;
+    build->lock.Unlock();
+
+    if ( roi >= build->numberOfROIs )
+    {
+      break;
+    }
+
+    build->exporter->CheckContourData( roi );
+    build->located[roi] =
+      build->exporter->PlaceContours( roi, *build->series, *build->locator );
+  }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+bool RTSTRUCTExporter::Write(const string& fileName, std::ostream& log)
+{
+  const DictionaryType& dictReader = m_ReferenceHeader;
+
+  //       |------------------------------|
+  //       | RT STRUCTURE SET IOD MODULES |
+  //       |------------------------------|
+  //
+  // Only the mandatory(M) IOD modules of RTSTRUCT are created by this program.
+  // Those manadatory modules are as follows:
+  //
+  // |--------------------|----------------------|
+  // | Information-Entity |  Mandatory Modules   |
+  // |--------------------|----------------------|
+  // |                    |                      |
+  // | Patient            | Patient              |
+  // |                    |                      |
+  // |--------------------|----------------------|
+  // |                    |                      |
+  // | Study              | General Study        |
+  // |                    |                      |
+  // |--------------------|----------------------|
+  // |                    |                      |
+  // | Series             | RT Series            |
+  // |                    |                      |
+  // |--------------------|----------------------|
+  // |                    |                      |
+  // | Equipment          | General Equipment    |
+  // |                    |                      |
+  // |--------------------|----------------------|
+  // |                    |                      |
+  // | Structure Set      | Structure Set        |
+  // |                    | ROI Contour          |
+  // |                    | RT ROI Observations  |
+  // |                    | SOP Common           |
+  // |                    |                      |
+  // |--------------------|----------------------|
+  //
+  // Each individual module is described in detail below....
+  //
+  
+  
+  STRUCTOutType::Pointer gdcmIO2 = STRUCTOutType::New(); // for DICOM writer
+  DictionaryType& dictWriter = gdcmIO2->GetMetaDataDictionary();
+
+  // The sequences are built in the typed model, which the writer
+  // serializes directly; the other attributes go to "dictWriter".
+  itk::RTStructureSet& structureSet = m_StructureSet;
+
+  vector<string> mandatoryModule;
+  vector<string> optioalModule;
+
+  DictionaryType::ConstIterator  tagItr;
+  DictionaryType::ConstIterator  end = dictReader.End();
+  string tagValue;
+
+  //                  |--------------------|
+  //                  | Patient Module (M) |
+  //                  |--------------------|
+  //
+  // Only the following tags of this module are written!
+  //
+  // |-------|----------------------|-------------|------|
+  // | S.No. | Attribute Name       | Tag         | Type |
+  // |-------|----------------------|-------------|------|
+  // | 1     | Patient's Name       | (0010,0010) | 2    |
+  // | 2     | Patient ID           | (0010,0020) | 2    |
+  // | 3     | Patient's Birth Date | (0010,0030) | 2    |
+  // | 4     | Patient's Sex        | (0010,0040) | 2    |
+  // |-------|----------------------|-------------|------|
+  //
+  // This information is extracted from the input CT-Slice.
+
+  mandatoryModule.push_back("0010|0010");
+  mandatoryModule.push_back("0010|0020");
+  mandatoryModule.push_back("0010|0030");
+  mandatoryModule.push_back("0010|0040");
+
+
+  //                  |--------------------------|
+  //                  | General Study Module (M) |
+  //                  |--------------------------|
+  //
+  // Only the following tags of this module are written!
+  // 
+  //
+  // |-------|--------------------------------|-------------|------|
+  // | S.No. | Attribute Name                 | Tag         | Type |
+  // |-------|--------------------------------|-------------|------|
+  // | 1     | Study Inst. UID                | (0020|000d) | 1    | 
+  // | 2     | Study Date                     | (0008|0020) | 2    |
+  // | 3     | Study Time                     | (0008|0030) | 2    |
+  // | 4     | Ref. Phys. Name                | (0008|0090) | 2    |
+  // | 5     | Study ID                       | (0020|0010) | 2    |
+  // | 6     | Accession Number               | (0008|0050) | 2    |
+  // |-------|--------------------------------|-------------|------|
+  // | 7     | Study Description              | (0008|1030) | 3    |
+  // | 8     | Physician(s) of Record         | (0008|1048) | 3    |
+  // |-------|--------------------------------|-------------|------|
+  // | 9     | Referenced Study Sequence      | (0008|1110) | 3    |
+  // | 9.1   |  > Referenced SOP Class UID    | (0008|1150) | 1C   |
+  // | 9.2   |  > Referenced SOP Instance UID | (0008|1155) | 1C   |
+  // |-------|--------------------------------|-------------|------|
+  //
+  // This information is extracted from the input CT-Slice.
+
+  mandatoryModule.push_back("0020|000d");
+  mandatoryModule.push_back("0008|0020");
+  mandatoryModule.push_back("0008|0030");
+  mandatoryModule.push_back("0008|0090");
+  mandatoryModule.push_back("0020|0010");
+  mandatoryModule.push_back("0008|0050");
+
+  optioalModule.push_back("0008|1030");
+  optioalModule.push_back("0008|1048");
+
+  // 9.1
+  // StudyComponentManagementSOPClass = 1.2.840.10008.3.1.2.3.2
+  structureSet.ReferencedStudySOPClassUID = StudyComponentManagementSOPClass;
+
+  // Reference SOP instance UID:
+  // This value is same as that of (0020|000d)
+  // The same value will also be used latter in Structure-Set module.
+
+  string sopInstUID;
+  tagItr = dictReader.Find( "0020|000d" );
+
+  if (IsTagPresent( tagItr, end ) )
+  {
+    sopInstUID = GetTagValue( tagItr, log );
+  } else
+  {
+    log << "Unable to find the (0020,000d) tag in the input CT image!" << endl;
+  }
+
+  // 9.2
+  structureSet.ReferencedStudySOPInstanceUID = sopInstUID;
+
+
+  //                  |----------------------|
+  //                  | RT Series Module (M) |
+  //                  |----------------------|
+  //
+  // Only the following tags of this module are written!
+  //
+  // |-------|--------------------|-------------|------|
+  // | S.No. | Attribute Name     | Tag         | Type |
+  // |-------|--------------------|-------------|------|
+  // | 1     | Modality           | (0008|0060) | 1    | 
+  // | 2     | Series Inst. UID   | (0020|000e) | 1    |
+  // | 3     | Series Number      | (0020|0011) | 2    |
+  // |-------|--------------------|-------------|------|
+  // | 4     | Series Description | (0008|103e) | 3    |
+  // |-------|------------------  |-------------|------|
+  //
+
+  // Modality: "RTSTRUCT"
+  itk::EncapsulateMetaData<string>(dictWriter, "0008|0060", "RTSTRUCT");
+
+  // Series Inst. UID: The default value assigned by GDCM is used!!!
+
+  // Series Number: A number that identifies this series
+  // No value is set for this tag at this moment
+  itk::EncapsulateMetaData<string>(dictWriter, "0020|0011", "");
+
+  itk::EncapsulateMetaData<string>(dictWriter, "0008|103e", "ITK/GDCM ROI");
+
+
+
+  //             |------------------------------|
+  //             | General Equipment Module (M) |
+  //             |------------------------------|
+  //
+  // Only the following tags of this module are written!
+  //
+  // |-------|------------------|-------------|------|
+  // | S.No. | Attribute Name   | Tag         | Type |
+  // |-------|------------------|-------------|------|
+  // | 1     | Manufacturer     | (0008|0070) | 2    | 
+  // |-------|------------------|-------------|------|
+  // | 2     | Station Name     | (0008|1010) | 3    |
+  // |-------|------------------|-------------|------|
+
+
+  // The default manufacturer name for this output is: "GDCM Factory"
+  // and the same name is retained.
+  //
+
+  // (0x0008,0x1010) SH Station Name
+  itk::EncapsulateMetaData<string>(dictWriter, "0008|1010", "ITK/GDCM PC");
+
+  //                 |------------------------|
+  //                 |  SOP Common Module (M) |
+  //                 |------------------------|
+  //
+  // Only the following tags of this module are written!
+  //
+  // |-------|--------------------------|-------------|------|
+  // | S.No. | Attribute Name           | Tag         | Type |
+  // |-------|--------------------------|-------------|------|
+  // | 1     | SOP Class UID            | (0008|0016) | --   |
+  // | 2     | SOP Instance UID         | (0008|0018) | --   |
+  // | 3     | Instance Creation Date   | (0008|0012) | 3    |
+  // | 4     | Instance Creation Time   | (0008|0013) | 3    |
+  // | 5     | Timezone Offset From UTC | (0008|0201) | 3    |
+  // |-------|--------------------------|-------------|------|
+  //
+
+  // SOP Class UID is written in gdcmFileHelper.cxx
+  // SOP Instance UID is written in gdcmFileHelper.cxx
+  // Instance Creation Date is Set in gdcmFileHelper.cxx
+  // Instance Creation Time is Set in gdcmFileHelper.cxx
+  //
+
+  optioalModule.push_back("0008|0201");
+
+  // (0x0002,0x0016) AE Source Application Entity Title
+  optioalModule.push_back("0002|0016");
+
+  if ( ! WriteCompulsoryTags(mandatoryModule, dictReader, dictWriter, log) )
+  {
+    log << "The reference DICOM header lacks mandatory tags of the structure set." << endl;
+    return false;
+  }
+  WriteOptionalTags(optioalModule, dictReader, dictWriter, log);
+
+
+  //                 |--------------------------|
+  //                 | Structure Set Module (M) |
+  //                 |--------------------------|
+  //
+  // Only the following tags of this module are written!
+  //
+  // A structure set defines a set of areas of significance.
+  // Each area can be associated with a Frame of Reference and zero or more
+  // images. Information which can be transferred with each region of
+  // interest (ROI) includes geometrical and display parameters, 
+  // and generation technique.
+  //
+  // We will write only those attributes listed in the following table.
+  //
+  //
+  // |-----------|--------------------------------------|-------------|------|
+  // | S.No.     |           Attribute Name             |    Tag      | Type |
+  // |-----------|--------------------------------------|-------------|------|
+  // | 1         | Structure Set Label                  | (3006|0002) | 1    |
+  // |-----------|--------------------------------------|-------------|------|
+  // | 2         | Structure Set Name                   | (3006|0004) | 3    |
+  // |-----------|--------------------------------------|-------------|------|
+  // | 3         | Structure Set Date                   | (3006|0008) | 2    |
+  // |-----------|--------------------------------------|-------------|------|
+  // | 4         | Structure Set Time                   | (3006|0009) | 2    |
+  // |-----------|--------------------------------------|-------------|------|
+  // | 5         | Referenced frame of Ref. Sequence    | (3006|0010) | 3    |
+  // | 5.1       |  > Frame of Ref. UID                 | (0020|0052) | 1C   |
+  // |           |                                      |             |      |
+  // | 5.2       |  > RT Referenced Study Sequence      | (3006|0012) | 3    |
+  // | 5.2.1     |    >> Referenced SOP Class UID       | (0008|1150) | 1C   |
+  // | 5.2.2     |    >> Referenced SOP Instance UID    | (0008|1155) | 1C   |
+  // |           |                                      |             |      |
+  // | 5.2.3     |    >> RT Referenced Series Sequence  | (3006|0014) | 1C   |
+  // | 5.2.3.1   |       >>> Series Instance UID        | (0020|000E) | 1C   |
+  // |           |                                      |             |      |
+  // | 5.2.3.2   |       >>> Contour Image Sequence     | (3006|0016) | 1C   |
+  // | 5.2.3.2.1 |           >>>> Ref. SOP Class UID    | (0008|1150) | 1C   |
+  // | 5.2.3.2.2 |           >>>> Ref. SOP Instance UID | (0008|1155) | 1C   |
+  // |-----------|--------------------------------------|-------------|------|
+  // | 6         | Structure Set ROI Sequence           | (3006|0020) | 3    |
+  // | 6.1       |  > ROI Number                        | (3006|0022) | 1C   |
+  // | 6.2       |  > Referenced Frame of ref. UID      | (3006|0024) | 1C   |
+  // | 6.3       |  > ROI Name                          | (3006|0026) | 2C   |
+  // | 6.4       |  > ROI Generation Algorithm          | (3006|0036) | 2C   |
+  // |-----------|--------------------------------------|-------------|------|
+  //
+  //
+
+  // 1
+  // Structure Set Label = Study Description name (0008,1030)
+  // If study description name does not exist, set it to "test-structure"
+  tagItr = dictReader.Find( "0008|1030" );
+  tagValue = "test-structure";
+  if (IsTagPresent( tagItr, end ) )
+    tagValue = GetTagValue( tagItr, log );
+  itk::EncapsulateMetaData<string>(dictWriter, "3006|0002", tagValue);
+
+  // 2
+  // Structure Set Name = "ROI"
+  itk::EncapsulateMetaData<string>(dictWriter, "3006|0004", "ROI");
+
+  // 3
+  // Structure Set Time = Initially set it's value to an empty string;
+  // set it's value correctly, latter in "gdcmFileHelper.cxx"
+  itk::EncapsulateMetaData<string>(dictWriter, "3006|0008", "");
+
+  // 4
+  // Structure Set Date = Initially set it's value to an empty string;
+  // set it's value correctly, latter in "gdcmFileHelper.cxx"
+  itk::EncapsulateMetaData<string>(dictWriter, "3006|0009", "");
+
+  // The Frame of Reference UID (0020,0052) shall be used to uniquely identify
+  // a frame of reference for a series. Each series shall have 
+  // a single Frame of Reference UID. However, multiple Series
+  // within a Study may share a Frame of Reference UID.
+  // All images in a Series that share the same Frame of Reference UID
+  // shall be spatially related to each other.
+  // 
+  // We assume here that there is a single frame of reference and,
+  // we will extract that value from the CT-DICOM image.
+  //
+  string frameOfReferenceUID;
+  tagItr = dictReader.Find( "0020|0052" );
+
+  if (IsTagPresent( tagItr, end ) )
+  {
+    frameOfReferenceUID = GetTagValue( tagItr, log );
+  } else
+  {
+    log << "Unable to find the Frame of Reference UID in the CT image!"
+         << endl;
+  }
+  // 5.1
+  structureSet.FrameOfReferenceUID = frameOfReferenceUID;
+
+  // 5.2.1, 5.2.2
+  // The RT Referenced Study is the Referenced Study (9.1, 9.2) above:
+  // Referenced SOP class UID = StudyComponentManagementSOPClass
+  // Referenced SOP Instance UID = sopInstUID
+
+  // Series Instance UID: Unique Identifier of the series containing the image
+  //It's value = (0020,000e) tag value of the CT image
+  string refSeriesInstUID;
+  tagItr = dictReader.Find( "0020|000e" );
+
+  if (IsTagPresent( tagItr, end ) )
+  {
+    refSeriesInstUID = GetTagValue( tagItr, log );
+  } else
+  {
+    log << "Unable to find (0020|000e) tag in the CT image!" << endl;
+  }
+  // 5.2.3.1
+  structureSet.ReferencedSeriesInstanceUID = refSeriesInstUID;
+
+  // The slices of the CT series, in the order of their numbers, give the
+  // Referenced SOP Instance UIDs. The UIDs are only made up from the
+  // prefix when there is no series, or when it does not have all the
+  // slices of the segmented image.
+  const vector<CTSliceHeader> noSeries;
+  const bool seriesComplete = m_Series.size() + 1 >= m_FirstSlice + m_NumberOfSlices;
+  if ( ! m_Series.empty() && ! seriesComplete )
+  {
+    log << "The CT series has " << m_Series.size() << " slices, fewer than the "
+        << m_FirstSlice + m_NumberOfSlices - 1
+        << " of the segmented image." << endl;
+  }
+  const vector<CTSliceHeader>& series = seriesComplete ? m_Series : noSeries;
+
+  if ( series.empty() )
+  {
+    log << "The Referenced SOP Instance UIDs are made up from the prefix "
+        << m_SOPInstanceUIDPrefix << endl;
+  }
+
+  unsigned int otherFrameSlices = 0;
+  for ( unsigned int i = 0; i < series.size(); i++ )
+  {
+    if ( series[i].frameOfReferenceUID != frameOfReferenceUID )
+    {
+      otherFrameSlices++;
+    }
+  }
+  if ( otherFrameSlices > 0 )
+  {
+    log << otherFrameSlices << " slices of the CT series are not in the Frame of"
+        << " Reference of the input DICOM slice." << endl;
+  }
+
+  // The slices of the series by z, for the contours placed by z.
+  CTSliceLocator sliceLocator;
+  if ( m_PlaceContoursByZ && ! series.empty() &&
+       ! sliceLocator.Initialize( series, m_ZTolerance ) )
+  {
+    log << "The contours can not be placed by z (the CT series is not axial, or"
+        << " has no two slices at different z to set the tolerance): their"
+        << " slice numbers are used." << endl;
+  }
+
+
+  // 5.2.3.2
+  // Contour Image Sequence: filled once the contours are placed on their
+  // slices (ROI Contour Module, below)
+  //-------------------------------------------------------------------------------
+
+  // 6, 1 (ROI Contour Module), 1 (RT ROI Observations Module)
+  // One ROI of the model per ROI added, filled below
+
+  // 6.2
+  // Referenced Frame of ref. UID = frameOfReferenceUID
+  //
+  // Uniquely identifies Frame of Reference in which ROI is defined, specified by Frame
+  // of Reference UID (0020,0052) in Referenced Frame of Reference Sequence
+  // (3006,0010). Required if Structure Set ROI Sequence (3006,0020) is sent.
+   
+  for (unsigned int roiNumber = 1; roiNumber <= structureSet.ROIs.size(); roiNumber++)
+  {
+    itk::RTROI& roi = structureSet.ROIs[roiNumber-1];
+
+    // 6.1, 6.4
+    // (6.2 is structureSet.FrameOfReferenceUID for every ROI, 6.3 is
+    // given to AddROI())
+    roi.Number              = roiNumber;
+    roi.GenerationAlgorithm = roiGenAlgorithm;
+  }
+
+
+
+  //                       |------------------------|
+  //                       | ROI Contour Module (M) |
+  //                       |------------------------|
+  //
+  // Only the following tags of this module are written!
+  //
+  // This module is used to define the ROI as a set of contours.
+  // Each ROI contains a sequence of one or more contours, where a contour
+  // is either a single point (for a point ROI) or more than one point
+  // (representing an open or closed polygon).
+  // 
+  //
+  // We will write only those attributes listed in the following table.
+  //
+  //
+  // |---------|---------------------------------------|-------------|------|
+  // | S.No.   |           Attribute Name              |    Tag      | Type |
+  // |---------|---------------------------------------|-------------|------|
+  // | 1       | ROI Contour Sequence                  | (3006|0039) | 1    |
+  // | 1.1     |  > Referenced ROI Number              | (3006|0084) | 1    |
+  // | 1.2     |  > ROI Display Color                  | (3006|002a) | 3    |
+  // |         |                                       |             |      |
+  // | 1.3     |  > Contour Sequence                   | (3006|0040) | 3    |
+  // |         |                                       |             |      |
+  // | 1.3.1   |    >> Contour Image Sequence          | (3006|0016) | 3    |
+  // | 1.3.1.1 |       >>> Referenced SOP Class UID    | (0008|1150) | 1C   |
+  // | 1.3.1.2 |       >>> Referenced SOP Instance UID | (0008|1155) | 1C   |
+  // |         |                                       |             |      |
+  // | 1.3.2   |    >> Contour Geometric Type          | (3006|0042) | 1C   |
+  // | 1.3.3   |    >> Number of Contour Points        | (3006|0046) | 1C   |
+  // | 1.3.4   |    >> Contour Data                    | (3006|0050) | 1C   |
+  // |---------|---------------------------------------|-------------|------|
+
+  //1.1 Referenced ROI Number
+  //ROIs are successively numberd starting from 1 (roi.Number)
+
+  //1.2 ROI Display Color (given to AddROI())
+
+  //1.3 Contour Sequence: the contours were added in place. Their text
+  //(1.3.4 Contour Data) is checked and their CT slices (1.3.1) found in
+  //parallel over the ROIs; 1.3.2 Contour Geometric Type and 1.3.3 Number
+  //of Contour Points were given to AddContour().
+  BuildROIs_struct build;
+  build.exporter     = this;
+  build.series       = &series;
+  build.locator      = &sliceLocator;
+  build.numberOfROIs = static_cast<unsigned int>( structureSet.ROIs.size() );
+  build.nextROI      = 0;
+  build.located.assign( structureSet.ROIs.size(), true );
+
+  if ( build.numberOfROIs > 0 )
+  {
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads( std::max( 1u, std::min( m_NumberOfThreads,
+                                                          build.numberOfROIs ) ) );
+    threader->SetSingleMethod( BuildROIsThreadCallback, &build );
+    threader->SingleMethodExecute();
+  }
+
+  for ( unsigned int contourItem = 1; contourItem <= structureSet.ROIs.size(); contourItem++ )
+  {
+    if ( ! build.located[contourItem-1] )
+    {
+      log << "The contours of the ROI " << contourItem << " are not all on a slice"
+          << " of the CT series: their slice numbers are used." << endl;
+    }
+
+    const vector<ContourPlacement>& placements = m_Placements[contourItem-1];
+    unsigned int                    beyondSeries = 0;
+    for ( unsigned int i = 0; i < placements.size(); i++ )
+    {
+      beyondSeries += ( placements[i].referencedSlice == 0 );
+    }
+    if ( beyondSeries > 0 )
+    {
+      log << beyondSeries << " contours of the ROI " << contourItem << " have a slice"
+          << " number beyond the " << ( series.empty() ? "segmented image" : "CT series" )
+          << ": they reference no CT slice." << endl;
+    }
+  }
+
+  // 5.2.3.2
+  // Contour Image Sequence: one item per slice that carries a contour of
+  // some ROI, each slice once, in the order of the slice numbers. Without
+  // any contour on a slice, the slices of the segmented image are all
+  // referenced (the sequence has at least one item).
+  vector<unsigned int> referencedSlices;
+  for ( unsigned int roi = 0; roi < m_Placements.size(); roi++ )
+  {
+    for ( unsigned int i = 0; i < m_Placements[roi].size(); i++ )
+    {
+      if ( m_Placements[roi][i].referencedSlice > 0 )
+      {
+        referencedSlices.push_back( m_Placements[roi][i].referencedSlice );
+      }
+    }
+  }
+  std::sort( referencedSlices.begin(), referencedSlices.end() );
+  referencedSlices.erase( std::unique( referencedSlices.begin(), referencedSlices.end() ),
+                          referencedSlices.end() );
+
+  if ( referencedSlices.empty() )
+  {
+    for ( unsigned int count = 0; count < m_NumberOfSlices; count++ )
+    {
+      referencedSlices.push_back( m_FirstSlice + count );
+    }
+  }
+
+  structureSet.ContourImages.resize( referencedSlices.size() );
+  for ( unsigned int count = 0; count < referencedSlices.size(); count++ )
+  {
+    itk::RTReferencedImage& image = structureSet.ContourImages[count];
+
+    // 5.2.3.2.1
+    // Referenced SOP Class UID:
+    // Uniquely identifies the referenced image SOP instance
+    // It's value is constant = CTImageSOPClassUID
+    image.ReferencedSOPClassUID = CTImageSOPClassUID;
+
+    // 5.2.3.2.2
+    // Referenced SOP Instance UID
+    image.ReferencedSOPInstanceUID = SliceSOPInstanceUID( series, referencedSlices[count] );
+  }
+
+
+
+  //                 |--------------------------------|
+  //                 | RT ROI Observations Module (M) |
+  //                 |--------------------------------|
+  //
+  // Only the following tags of this module are written!
+  //
+  // The RT ROI Observations module specifies the identification and
+  // interpretation of an ROI specified in the Structure Set and ROI 
+  // Contour modules.
+  //
+  //
+  // We will write only those attributes listed in the following table.
+  //
+
+  // |-------|------------------------------|-------------|------|
+  // | S.No. |           Attribute Name     |    Tag      | Type |
+  // |-------|------------------------------|-------------|------|
+  // | 1     | RT ROI Observations Sequence | (3006|0080) | 1    |
+  // | 1.1   |  > Observation Number        | (3006|0082) | 1    |
+  // | 1.2   |  > Referenced ROI Number     | (3006|0084) | 1    |
+  // | 1.3   |  > RT ROI Interpreted Type   | (3006|00a4) | 2    |
+  // | 1.4   |  > ROI Interpreter           | (3006|00a6) | 2    |
+  // |-------|------------------------------|-------------|------|
+
+
+  for (unsigned int observeItem = 1; observeItem <= structureSet.ROIs.size(); observeItem++)
+  {
+    itk::RTROI& roi = structureSet.ROIs[observeItem-1];
+
+    // Referenced roi number itself is used as the observation number
+    //1.1 Observation Number, 1.2 Referenced ROI Number (roi.Number)
+
+    //1.3 RT ROI Interpreted Type (given to AddROI())
+
+    //1.4 XXX Currently an empty string is used for ROI Interpreter
+    roi.Interpreter = "";
+  }
+  //-------------------------------------------------------------------------------
+
+  WriterType::Pointer writer = WriterType::New();
+
+  // We now need to not only explicitly set the proper image IO (GDCMImageIO), but also
+  // we must tell the ImageFileWriter NOT to use the MetaDataDictionary from the
+  // input but from the GDCMImageIO since this is the one that contains the DICOM
+  // specific information
+  //
+  writer->UseInputMetaDataDictionaryOff ();
+
+  writer->SetFileName(fileName.c_str());
+
+  // RTSTRUCTIO writes the dictionary only, but the writer needs an input
+  // image: a 1x1 image stands for the CT slice, whose pixels were not read.
+  ImageType::Pointer dummyImage = ImageType::New();
+  ImageType::SizeType dummySize;
+  dummySize.Fill(1);
+  dummyImage->SetRegions(dummySize);
+  dummyImage->Allocate();
+  dummyImage->FillBuffer(0);
+
+  writer->SetInput(dummyImage);
+
+  writer->SetImageIO(gdcmIO2);
+
+  // The sequences, from the model
+  gdcmIO2->SetStructureSet(&structureSet);
+
+  // gdcm also makes the UIDs of the new instance
+  bool written = true;
+  GDCMLock.Lock();
+  try
+  {
+      writer->Update();
+  }
+  catch (itk::ExceptionObject & excp)
+  {
+      log << "Exception is thrown while writing the DICOM file: " << endl;
+      log << excp << endl;
+      written = false;
+  }
+  GDCMLock.Unlock();
+
+  return written;
+}
@@ -0,0 +1,191 @@
+#ifndef __RTSTRUCTExporter_h
+#define __RTSTRUCTExporter_h
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "itkLightObject.h"
+#include "itkMetaDataDictionary.h"
+#include "itkMultiThreader.h"
+#include "itkRTStructureSet.h"
+
+#include "CTSeriesScanner.h"
+#include "DecimalStringEncoder.h"
+
+// -------------------------------------------------------------
+// RTSTRUCTExporter: writes an RT Structure Set from the header of a
+// reference CT slice, the slices of its series, and the ROIs with their
+// contours, given in memory.
+//
+// An exporter holds all the state of one export, and uses no global
+// variable: several exporters can run at the same time in one process
+// (gdcm, which is not thread-safe, is only used under a lock shared by
+// all the exporters). An exporter is not meant to be used by several
+// threads at the same time.
+//
+// Typical use:
+//   RTSTRUCTExporter exporter;
+//   exporter.ReadReferenceHeader("ct.dcm", log);
+//   exporter.SetSlices(prefix, 1, numberOfSlices);
+//   exporter.SetSeries(series);
+//   unsigned int roi = exporter.AddROI("bones", "ORGAN", "255\\0\\0");
+//   exporter.AddContour(roi, "CLOSED_PLANAR", points, numberOfPoints);
+//   exporter.Write("rtstruct.dcm", log);
+// -------------------------------------------------------------
+class RTSTRUCTExporter
+{
+public:
+  RTSTRUCTExporter();
+
+  // Sets up ITK's object factories and the gdcm dictionaries. To be
+  // called once, before exporters run in several threads.
+  static void Initialize();
+
+  // The header of the reference CT slice gives the patient, the study,
+  // the series and the frame of reference. Only the header of the file
+  // is read. Returns false (after printing the reason to "log") if the
+  // file can not be read.
+  bool ReadReferenceHeader(const std::string& fileName, std::ostream& log);
+
+  // Same, for a header already read (e.g. by itk::GDCMImageIO).
+  void SetReferenceHeader(const itk::MetaDataDictionary& header)
+    { m_ReferenceHeader = header; }
+  const itk::MetaDataDictionary& GetReferenceHeader() const
+    { return m_ReferenceHeader; }
+
+  // Value of a tag ("gggg|eeee") of the reference header; empty if the
+  // header has no such tag, or (reported to "log") if it is no string.
+  std::string GetReferenceValue(const std::string& tag, std::ostream& log) const;
+
+  // The segmented image covers the slices [firstSlice, firstSlice +
+  // numberOfSlices) of the CT series (numbered from 1). Only those that
+  // carry a contour are referenced by the Contour Image Sequence (all of
+  // them if there is no contour). Without a series, their SOP Instance
+  // UIDs are made up as "sopInstanceUIDPrefix" followed by their number.
+  void SetSlices(const std::string& sopInstanceUIDPrefix, unsigned int firstSlice,
+                 unsigned int numberOfSlices);
+
+  // The slices of the CT series, in the order of their numbers, which
+  // give the Referenced SOP Instance UIDs. The series is not used if it
+  // has fewer slices than the segmented image.
+  void SetSeries(const std::vector<CTSliceHeader>& series) { m_Series = series; }
+
+  // By default, a contour is put on the slice given by its slice number.
+  // With "placeByZ", it is put on the slice of the series at its z, which
+  // requires the Contour Data in the patient coordinates of the series
+  // (the slice numbers are then only used for the ROIs whose contours are
+  // not all on a slice, or if the series is not axial).
+  void SetPlaceContoursByZ(bool placeByZ) { m_PlaceContoursByZ = placeByZ; }
+
+  // Largest distance between the z of a contour and that of its slice,
+  // when the contours are placed by z (a negative tolerance stands for a
+  // quarter of the smallest distance between two slices).
+  void SetZTolerance(double tolerance) { m_ZTolerance = tolerance; }
+
+  // The coordinates are rounded to this precision when they are not
+  // valid DICOM Decimal Strings as given, or are given as numbers.
+  // Returns false (and keeps the precision) if it is not positive.
+  bool SetPrecision(double precision) { return m_Encoder.SetPrecision(precision); }
+
+  // Number of threads among which Write() shares the ROIs to check their
+  // Contour Data and find the CT slices of their contours (default: the
+  // ITK default number of threads).
+  void SetNumberOfThreads(unsigned int numberOfThreads)
+    { m_NumberOfThreads = numberOfThreads; }
+
+  // Adds an ROI, numbered after the ROIs already added; returns its index
+  // for AddContour().
+  unsigned int AddROI(const std::string& name, const std::string& interpretedType,
+                      const std::string& displayColor);
+
+  // Room for "numberOfContours" contours of an ROI, so that adding them
+  // never moves the contours already added.
+  void ReserveContours(unsigned int roi, unsigned int numberOfContours);
+
+  // Adds a contour of "numberOfPoints" points (x1, y1, z1, x2, ...) to an
+  // ROI. "sliceNumber" is the slice of the segmented image (from 0) the
+  // contour is on; it is only used for the ROIs whose contours are not
+  // all on a slice of the series.
+  void AddContour(unsigned int roi, const std::string& geometricType,
+                  const double* points, unsigned int numberOfPoints,
+                  unsigned int sliceNumber = 0);
+
+  // Same, for the text of a Contour Data ("x1\y1\z1\x2\..."), which is
+  // copied as it is unless some value is not a valid Decimal String.
+  // Given an "owner" that keeps the text valid (e.g. the mapped contour
+  // data file), a valid text is not copied at all: the contour shares it,
+  // and holds a reference to the owner until the exporter is destroyed.
+  // The text is only checked (and re-encoded if need be) by Write(), in
+  // parallel over the ROIs.
+  void AddContour(unsigned int roi, const std::string& geometricType,
+                  unsigned int numberOfPoints, const char* data, size_t length,
+                  unsigned int sliceNumber = 0, const itk::LightObject* owner = NULL);
+
+  // Same, but the text is taken from "data" (which is left empty) rather
+  // than copied.
+  void AddContour(unsigned int roi, const std::string& geometricType,
+                  unsigned int numberOfPoints, std::string& data,
+                  unsigned int sliceNumber = 0);
+
+  unsigned int GetNumberOfROIs() const
+    { return static_cast<unsigned int>( m_StructureSet.ROIs.size() ); }
+
+  // Writes the RT Structure Set. Returns false (after printing the reason
+  // to "log") if it could not be written. The messages about the series
+  // also go to "log".
+  bool Write(const std::string& fileName, std::ostream& log);
+
+private:
+  // Where a contour is, to find its CT slice. The z of a contour given
+  // as text is only read by Write(), with the check of its text.
+  struct ContourPlacement
+  {
+    double       z;
+    bool         zValid;
+    bool         textToCheck;
+    unsigned int sliceNumber;
+    unsigned int referencedSlice;  // slice of the series, found by Write()
+                                   // (0 if beyond the series)
+  };
+
+  static ITK_THREAD_RETURN_TYPE BuildROIsThreadCallback(void* arg);
+
+  void CheckContourData(unsigned int roi);
+
+  bool PlaceContours(unsigned int roi, const std::vector<CTSliceHeader>& series,
+                     const CTSliceLocator& locator);
+
+  itk::RTContour& NewContour(unsigned int roi, const std::string& geometricType,
+                             unsigned int numberOfPoints, unsigned int sliceNumber);
+
+  std::string SliceSOPInstanceUID(const std::vector<CTSliceHeader>& series,
+                                  unsigned int sliceNumber) const;
+
+  bool IsSliceInSeries(const std::vector<CTSliceHeader>& series,
+                       unsigned int sliceNumber) const;
+
+  bool LocateContourSlices(unsigned int roi, const CTSliceLocator& locator,
+                           std::vector<unsigned int>& slices) const;
+
+  itk::MetaDataDictionary    m_ReferenceHeader;
+  std::vector<CTSliceHeader> m_Series;
+  std::string                m_SOPInstanceUIDPrefix;
+  unsigned int               m_FirstSlice;
+  unsigned int               m_NumberOfSlices;
+  bool                       m_PlaceContoursByZ;
+  double                     m_ZTolerance;
+  DecimalStringEncoder       m_Encoder;
+  unsigned int               m_NumberOfThreads;
+
+  // The ROIs and their contours, and the placement of each contour.
+  itk::RTStructureSet                          m_StructureSet;
+  std::vector< std::vector<ContourPlacement> > m_Placements;
+
+  // Not copyable: the contours can be large.
+  RTSTRUCTExporter(const RTSTRUCTExporter&);
+  void operator=(const RTSTRUCTExporter&);
+};
+
+#endif // __RTSTRUCTExporter_h
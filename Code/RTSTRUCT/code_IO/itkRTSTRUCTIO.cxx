@@ -53,6 +53,14 @@ public:
   gdcm::File *m_Header;
 };
 
+// Whether the value of a key is written as a sequence: a sub-dictionary,
+// or a list of items.
+static bool IsSequenceValue(const MetaDataObjectBase *object)
+{
+  return dynamic_cast<const MetaDataObject<MetaDataDictionary> *>(object) ||
+         dynamic_cast<const MetaDataObject<RTSTRUCTIO::SequenceItemsType> *>(object);
+}
+
 bool RTSTRUCTIO::m_LoadSequencesDefault = true;
 bool RTSTRUCTIO::m_LoadPrivateTagsDefault = true;
 
@@ -75,6 +83,8 @@ RTSTRUCTIO::RTSTRUCTIO()
 
   m_KeepOriginalUID = false;
   m_MaxSizeLoadEntry = 0xfff;
+
+  m_StructureSet = 0;
 }
 
 RTSTRUCTIO::~RTSTRUCTIO()
@@ -246,17 +256,17 @@ void RTSTRUCTIO::Write(const void* buffer)
     // into the DICOM header:
     if (dictEntry)
       {
-      // Seperately handle the case when the Value is a sub-dictionary....
-      if( typeid(dict).name() == (dict[key].GetPointer())->GetMetaDataObjectTypeName() )
+      // Seperately handle the case when the Value is a sub-dictionary
+      // or a list of items....
+      const MetaDataObjectBase *object = itr->second.GetPointer();
+      if( IsSequenceValue(object) )
       {
         gdcm::SeqEntry *seqEntry = header->InsertSeqEntry(
                                               dictEntry->GetGroup(),
                                               dictEntry->GetElement());  
-        MetaDataDictionary sub_dict;
-        ExposeMetaData<itk::MetaDataDictionary>(dict, key, sub_dict);
 
         // the depth asscoiated with 1st layer of items of this sequence = 1
-        InsertDICOMSequence(sub_dict, 1, seqEntry);
+        InsertDICOMSequence(object, 1, seqEntry);
       } else
       {
       ExposeMetaData<std::string>(dict, key, value);
@@ -279,6 +289,12 @@ void RTSTRUCTIO::Write(const void* buffer)
     #endif
   }
 
+  // The sequences of the structure set, from the typed model
+  if ( m_StructureSet )
+    {
+    this->InsertStructureSet( header );
+    }
+
   // Write Explicit for both 1 and 3 components images:
   gfile->SetWriteTypeToDcmExplVR();
 
@@ -438,20 +454,54 @@ void RTSTRUCTIO::PrintSelf(std::ostream& os, Indent indent) const
 }
 
 
-bool RTSTRUCTIO::InsertDICOMSequence(MetaDataDictionary &sub_dict,
-                                     const unsigned int itemDepthLevel,
-                                     gdcm::SeqEntry     *seqEntry)
+bool RTSTRUCTIO::InsertDICOMSequence(const MetaDataObjectBase *object,
+                                     const unsigned int       itemDepthLevel,
+                                     gdcm::SeqEntry           *seqEntry)
+{
+  unsigned int itemNumber = 0;
+
+  // A list of items: one item per dictionary, in the order of the list.
+  const MetaDataObject<SequenceItemsType> *items =
+    dynamic_cast<const MetaDataObject<SequenceItemsType> *>(object);
+  if ( items )
+  {
+    const SequenceItemsType &itemList = items->GetMetaDataObjectValue();
+    for ( SequenceItemsType::const_iterator it = itemList.begin(); it != itemList.end(); ++it )
+    {
+      InsertDICOMSequence(*it, itemDepthLevel, seqEntry, itemNumber);
+    }
+    return true;
+  }
+
+  // A sub-dictionary: one item, or the items encapsulated in it.
+  const MetaDataObject<MetaDataDictionary> *sub_dict =
+    dynamic_cast<const MetaDataObject<MetaDataDictionary> *>(object);
+  if ( sub_dict )
+  {
+    return InsertDICOMSequence(sub_dict->GetMetaDataObjectValue(), itemDepthLevel,
+                               seqEntry, itemNumber);
+  }
+  return false;
+}
+
+
+bool RTSTRUCTIO::InsertDICOMSequence(const MetaDataDictionary &sub_dict,
+                                     const unsigned int       itemDepthLevel,
+                                     gdcm::SeqEntry           *seqEntry,
+                                     unsigned int             &itemNumber)
 
 {
   gdcm::SQItem *sqItem = NULL;
+  gdcm::Dict   *pubDict = gdcm::Global::GetDicts()->GetDefaultPubDict();
 
   itk::MetaDataDictionary::ConstIterator itr = sub_dict.Begin();
   itk::MetaDataDictionary::ConstIterator end = sub_dict.End();
 
   while(itr != end)
   {
-    // Get the key
+    // Get the key, and the value without copying it
     const std::string &inside_key = itr->first;
+    const MetaDataObjectBase *object = itr->second.GetPointer();
 
     // To separate the items from each other, each item is
     // encapsulated inside a dictionary and to distinguish them against sub-sequences,
@@ -462,43 +512,47 @@ bool RTSTRUCTIO::InsertDICOMSequence(MetaDataDictionary &sub_dict,
  
     if (ITEM_ENCAPSULATE_STRING == inside_key.substr(0, ITEM_ENCAPSULATE_STRING.length()))
     {
-      // Get the dictionary associted with that string...
-      itk::MetaDataDictionary actual_sub_dict;
-      ExposeMetaData<itk::MetaDataDictionary>(sub_dict, inside_key, actual_sub_dict);
+      const MetaDataObject<MetaDataDictionary> *actual_sub_dict =
+        dynamic_cast<const MetaDataObject<MetaDataDictionary> *>(object);
 
       // Call this function on that sub-dictionary
-      InsertDICOMSequence(actual_sub_dict, itemDepthLevel, seqEntry);
+      if ( actual_sub_dict )
+      {
+        InsertDICOMSequence(actual_sub_dict->GetMetaDataObjectValue(), itemDepthLevel,
+                            seqEntry, itemNumber);
+      }
     } else
     {
-      if ( itr == sub_dict.Begin() )
+      gdcm::DictEntry *dictEntry = pubDict->GetEntry(inside_key);
+      if ( dictEntry == NULL )
       {
-        sqItem = new gdcm::SQItem(itemDepthLevel);
+        itkWarningMacro(<< "Unknown DICOM tag in a sequence item: " << inside_key);
+        ++itr;
+        continue;
       }
 
-      assert( sqItem != NULL );
-
-      // if the value associated with this key is again a dictionary,
-      // recursively call this function to insert a sub-sequence:
-      if( typeid(sub_dict).name() == (sub_dict[inside_key].GetPointer())->GetMetaDataObjectTypeName() )
+      if ( sqItem == NULL )
       {
-        itk::MetaDataDictionary inside_sub_dict;
-        ExposeMetaData<itk::MetaDataDictionary>(sub_dict, inside_key, inside_sub_dict);
-
-        // if the attached sub-dictinary is a sequence, then.......
-        gdcm::SeqEntry *sub_seqEntry = new gdcm::SeqEntry(
-                        gdcm::Global::GetDicts()->GetDefaultPubDict()->GetEntry(inside_key));
-        InsertDICOMSequence(inside_sub_dict, itemDepthLevel+1, sub_seqEntry);
+        sqItem = new gdcm::SQItem(itemDepthLevel);
+      }
 
+      // if the value associated with this key is again a dictionary (or a
+      // list of items), recursively call this function to insert a sub-sequence:
+      if ( IsSequenceValue(object) )
+      {
+        gdcm::SeqEntry *sub_seqEntry = new gdcm::SeqEntry(dictEntry);
+        InsertDICOMSequence(object, itemDepthLevel+1, sub_seqEntry);
         sqItem->AddEntry(sub_seqEntry);
-
       } else // if the value associated with the key is a string, directly add it to the sequence
       {
-        std::string inside_value;
-        ExposeMetaData<std::string>(sub_dict, inside_key, inside_value);
+        const MetaDataObject<std::string> *inside_value =
+          dynamic_cast<const MetaDataObject<std::string> *>(object);
 
-        gdcm::ValEntry *inside_valEntry = new gdcm::ValEntry(
-                        gdcm::Global::GetDicts()->GetDefaultPubDict()->GetEntry(inside_key) );
-        inside_valEntry->SetValue(inside_value);
+        gdcm::ValEntry *inside_valEntry = new gdcm::ValEntry(dictEntry);
+        if ( inside_value )
+        {
+          inside_valEntry->SetValue(inside_value->GetMetaDataObjectValue());
+        }
 
         sqItem->AddEntry(inside_valEntry);
       }
@@ -507,11 +561,206 @@ bool RTSTRUCTIO::InsertDICOMSequence(MetaDataDictionary &sub_dict,
   }
   if (sqItem != NULL)
   {
-    // 2nd argument: ordinal number of the seq-item
-    // seqEntry->AddSQItem(sqItem, seqEntry->GetNumberOfSQItems()+1);
-    seqEntry->AddSQItem(sqItem, seqEntry->GetNumberOfSQItems());
+    // 2nd argument: ordinal number of the seq-item, counted here rather
+    // than asked to seqEntry, which would walk all of its items.
+    seqEntry->AddSQItem(sqItem, itemNumber++);
   }
   return true;
 }
 
+
+// Helpers for InsertStructureSet(): each value, sequence or item is
+// created from a dictionary entry looked up once, and is added at the
+// end of its parent.
+
+static void AddValue(gdcm::SQItem      *item,
+                     gdcm::DictEntry   *dictEntry,
+                     const std::string &value)
+{
+  gdcm::ValEntry *valEntry = new gdcm::ValEntry( dictEntry );
+  valEntry->SetValue( value );
+  item->AddEntry( valEntry );
+}
+
+// Contour Data entry that writes the text of a contour straight from the
+// RTStructureSet, which outlives the header: a gdcm::ValEntry would take
+// two copies of it (its value, then the value padded to an even length).
+// The space that pads a text of odd length is only added in the file.
+class ContourDataEntry : public gdcm::BinEntry
+{
+public:
+  ContourDataEntry(gdcm::DictEntry *dictEntry, const char *text, size_t length)
+    : gdcm::BinEntry( dictEntry ), m_Text( text ), m_Length( length )
+    {
+    // Not owned: gdcm must not delete the text.
+    SetBinArea( reinterpret_cast<uint8_t *>( const_cast<char *>( text ) ), false );
+    SetLength( static_cast<uint32_t>( length + length % 2 ) );
+    }
+
+  virtual void WriteContent(std::ofstream *fp, gdcm::FileType filetype)
+    {
+    gdcm::DocEntry::WriteContent( fp, filetype );
+    fp->write( m_Text, m_Length );
+    if ( m_Length % 2 )
+      {
+      fp->put( ' ' );
+      }
+    }
+
+private:
+  const char *m_Text;
+  size_t      m_Length;
+};
+
+static void AddContourData(gdcm::SQItem    *item,
+                           gdcm::DictEntry *dictEntry,
+                           const RTContour &contour)
+{
+  item->AddEntry( new ContourDataEntry( dictEntry, contour.GetDataPointer(),
+                                        contour.GetDataLength() ) );
+}
+
+static gdcm::SeqEntry *AddSequence(gdcm::SQItem    *item,
+                                   gdcm::DictEntry *dictEntry)
+{
+  gdcm::SeqEntry *seqEntry = new gdcm::SeqEntry( dictEntry );
+  item->AddEntry( seqEntry );
+  return seqEntry;
+}
+
+// "itemNumber" is the number of items already in the sequence (counting
+// them in the sequence itself would take a walk through its list).
+static gdcm::SQItem *AddItem(gdcm::SeqEntry *seqEntry,
+                             unsigned int    depth,
+                             unsigned int    itemNumber)
+{
+  gdcm::SQItem *item = new gdcm::SQItem( depth );
+  seqEntry->AddSQItem( item, itemNumber );
+  return item;
+}
+
+static void AddReferencedImage(gdcm::SQItem            *item,
+                               gdcm::DictEntry         *classEntry,
+                               gdcm::DictEntry         *instanceEntry,
+                               const RTReferencedImage &image)
+{
+  AddValue( item, classEntry, image.ReferencedSOPClassUID );
+  AddValue( item, instanceEntry, image.ReferencedSOPInstanceUID );
+}
+
+static std::string NumberString(unsigned int number)
+{
+  itksys_ios::ostringstream s;
+  s << number;
+  return s.str();
+}
+
+
+void RTSTRUCTIO::InsertStructureSet(gdcm::File *header)
+{
+  const RTStructureSet &structureSet = *m_StructureSet;
+
+  gdcm::Dict *pubDict = gdcm::Global::GetDicts()->GetDefaultPubDict();
+
+  gdcm::DictEntry *refSOPClassEntry     = pubDict->GetEntry(0x0008, 0x1150);
+  gdcm::DictEntry *refSOPInstanceEntry  = pubDict->GetEntry(0x0008, 0x1155);
+  gdcm::DictEntry *seriesInstanceEntry  = pubDict->GetEntry(0x0020, 0x000e);
+  gdcm::DictEntry *frameOfRefEntry      = pubDict->GetEntry(0x0020, 0x0052);
+  gdcm::DictEntry *rtRefStudyEntry      = pubDict->GetEntry(0x3006, 0x0012);
+  gdcm::DictEntry *rtRefSeriesEntry     = pubDict->GetEntry(0x3006, 0x0014);
+  gdcm::DictEntry *contourImageEntry    = pubDict->GetEntry(0x3006, 0x0016);
+  gdcm::DictEntry *roiNumberEntry       = pubDict->GetEntry(0x3006, 0x0022);
+  gdcm::DictEntry *refFrameOfRefEntry   = pubDict->GetEntry(0x3006, 0x0024);
+  gdcm::DictEntry *roiNameEntry         = pubDict->GetEntry(0x3006, 0x0026);
+  gdcm::DictEntry *roiColorEntry        = pubDict->GetEntry(0x3006, 0x002a);
+  gdcm::DictEntry *roiAlgorithmEntry    = pubDict->GetEntry(0x3006, 0x0036);
+  gdcm::DictEntry *contourSeqEntry      = pubDict->GetEntry(0x3006, 0x0040);
+  gdcm::DictEntry *geometricTypeEntry   = pubDict->GetEntry(0x3006, 0x0042);
+  gdcm::DictEntry *numberOfPointsEntry  = pubDict->GetEntry(0x3006, 0x0046);
+  gdcm::DictEntry *contourDataEntry     = pubDict->GetEntry(0x3006, 0x0050);
+  gdcm::DictEntry *observationNumEntry  = pubDict->GetEntry(0x3006, 0x0082);
+  gdcm::DictEntry *refROINumberEntry    = pubDict->GetEntry(0x3006, 0x0084);
+  gdcm::DictEntry *interpretedTypeEntry = pubDict->GetEntry(0x3006, 0x00a4);
+  gdcm::DictEntry *interpreterEntry     = pubDict->GetEntry(0x3006, 0x00a6);
+
+  gdcm::SQItem *item;
+
+  // Referenced Study Sequence
+  gdcm::SeqEntry *refStudySeq = header->InsertSeqEntry(0x0008, 0x1110);
+  item = AddItem( refStudySeq, 1, 0 );
+  AddValue( item, refSOPClassEntry, structureSet.ReferencedStudySOPClassUID );
+  AddValue( item, refSOPInstanceEntry, structureSet.ReferencedStudySOPInstanceUID );
+
+  // Referenced Frame of Reference Sequence
+  //  > RT Referenced Study Sequence
+  //    >> RT Referenced Series Sequence
+  //       >>> Contour Image Sequence
+  gdcm::SeqEntry *refFrameSeq = header->InsertSeqEntry(0x3006, 0x0010);
+  gdcm::SQItem *refFrameItem = AddItem( refFrameSeq, 1, 0 );
+  AddValue( refFrameItem, frameOfRefEntry, structureSet.FrameOfReferenceUID );
+
+  gdcm::SQItem *rtRefStudyItem =
+    AddItem( AddSequence( refFrameItem, rtRefStudyEntry ), 2, 0 );
+  AddValue( rtRefStudyItem, refSOPClassEntry, structureSet.ReferencedStudySOPClassUID );
+  AddValue( rtRefStudyItem, refSOPInstanceEntry, structureSet.ReferencedStudySOPInstanceUID );
+
+  gdcm::SQItem *rtRefSeriesItem =
+    AddItem( AddSequence( rtRefStudyItem, rtRefSeriesEntry ), 3, 0 );
+  AddValue( rtRefSeriesItem, seriesInstanceEntry, structureSet.ReferencedSeriesInstanceUID );
+
+  gdcm::SeqEntry *contourImageSeq = AddSequence( rtRefSeriesItem, contourImageEntry );
+  for ( unsigned int i = 0; i < structureSet.ContourImages.size(); i++ )
+    {
+    item = AddItem( contourImageSeq, 4, i );
+    AddReferencedImage( item, refSOPClassEntry, refSOPInstanceEntry,
+                        structureSet.ContourImages[i] );
+    }
+
+  // Structure Set ROI Sequence, ROI Contour Sequence and
+  // RT ROI Observations Sequence: one item per ROI in each
+  gdcm::SeqEntry *structureSetROISeq = header->InsertSeqEntry(0x3006, 0x0020);
+  gdcm::SeqEntry *roiContourSeq      = header->InsertSeqEntry(0x3006, 0x0039);
+  gdcm::SeqEntry *roiObservationsSeq = header->InsertSeqEntry(0x3006, 0x0080);
+
+  for ( unsigned int r = 0; r < structureSet.ROIs.size(); r++ )
+    {
+    const RTROI &roi = structureSet.ROIs[r];
+    const std::string roiNumber = NumberString( roi.Number );
+
+    item = AddItem( structureSetROISeq, 1, r );
+    AddValue( item, roiNumberEntry, roiNumber );
+    AddValue( item, refFrameOfRefEntry, structureSet.FrameOfReferenceUID );
+    AddValue( item, roiNameEntry, roi.Name );
+    AddValue( item, roiAlgorithmEntry, roi.GenerationAlgorithm );
+
+    item = AddItem( roiContourSeq, 1, r );
+    AddValue( item, refROINumberEntry, roiNumber );
+    AddValue( item, roiColorEntry, roi.DisplayColor );
+
+    gdcm::SeqEntry *contourSeq = AddSequence( item, contourSeqEntry );
+    for ( unsigned int c = 0; c < roi.Contours.size(); c++ )
+      {
+      const RTContour &contour = roi.Contours[c];
+
+      gdcm::SQItem *contourItem = AddItem( contourSeq, 2, c );
+      if ( ! contour.ContourImage.ReferencedSOPInstanceUID.empty() )
+        {
+        gdcm::SQItem *imageItem =
+          AddItem( AddSequence( contourItem, contourImageEntry ), 3, 0 );
+        AddReferencedImage( imageItem, refSOPClassEntry, refSOPInstanceEntry,
+                            contour.ContourImage );
+        }
+      AddValue( contourItem, geometricTypeEntry, contour.GeometricType );
+      AddValue( contourItem, numberOfPointsEntry, NumberString( contour.NumberOfPoints ) );
+      AddContourData( contourItem, contourDataEntry, contour );
+      }
+
+    item = AddItem( roiObservationsSeq, 1, r );
+    AddValue( item, observationNumEntry, roiNumber );
+    AddValue( item, refROINumberEntry, roiNumber );
+    AddValue( item, interpretedTypeEntry, roi.InterpretedType );
+    AddValue( item, interpreterEntry, roi.Interpreter );
+    }
+}
+
 } // end namespace itk
@@ -23,16 +23,29 @@
 #include "itkImageIOBase.h"
 #include <fstream>
 #include <string>
+#include <vector>
 
 // Required for adding InsertDICOMSequence() method
 #include "gdcmSeqEntry.h"
 
+// Typed model of the sequences of the structure set
+#include "itkRTStructureSet.h"
+
+namespace gdcm
+{
+class File;
+}
+
 // The following string is used for distinguishing the encapsulation of an
 // Item of DICOM sequence from the encapsulation of the DICOM sequence itself.
 //
 // XXX GORTHI: I am not sure whether this the right place to define this string
 // considering the clear interface.
 const std::string ITEM_ENCAPSULATE_STRING("DICOM_ITEM_ENCAPSULATE");
+//
+// The items are then ordered by their keys. A sequence with many items is
+// better given as an RTSTRUCTIO::SequenceItemsType (see below), whose items
+// are written in the order of the vector, whatever their number.
 
 
 namespace itk
@@ -78,6 +91,10 @@ public:
   /** Method for creation through the object factory. */
   itkNewMacro(Self);
 
+  /** Items of a DICOM sequence, in their order. A MetaDataObject of this
+   *  type, as the value of a sequence key, gives one item per dictionary. */
+  typedef std::vector<MetaDataDictionary>   SequenceItemsType;
+
   /** Run-time type information (and related methods). */
   itkTypeMacro(RTSTRUCTIO, Superclass);
 
@@ -114,6 +131,15 @@ public:
   itkGetStringMacro(UIDPrefix);
   itkSetStringMacro(UIDPrefix);
 
+  /** The sequences of the structure set (referenced study, frame of
+   *  reference, ROIs and contours), written directly from this typed
+   *  model instead of from sequence dictionaries. The model is not
+   *  copied: it must stay valid until the file is written. */
+  void SetStructureSet(const RTStructureSet* structureSet)
+    { m_StructureSet = structureSet; }
+  const RTStructureSet* GetStructureSet() const
+    { return m_StructureSet; }
+
   /** Access the generated DICOM UID's. */
   itkGetStringMacro(StudyInstanceUID);
   itkGetStringMacro(SeriesInstanceUID);
@@ -226,9 +252,21 @@ protected:
   void InternalReadImageInformation(std::ifstream& file);
 
   // GORTHI: Added a method to recurively enter sequence data
-  bool InsertDICOMSequence(MetaDataDictionary &sub_dict,
-                           const unsigned int itemDepthLevel,
-                           gdcm::SeqEntry     *seqEntry);
+  // "itemNumber" is the ordinal of the next item of seqEntry; it is
+  // counted up as the items are added.
+  bool InsertDICOMSequence(const MetaDataDictionary &sub_dict,
+                           const unsigned int       itemDepthLevel,
+                           gdcm::SeqEntry           *seqEntry,
+                           unsigned int             &itemNumber);
+
+  // Inserts a value that is either a sub-dictionary (a sequence) or a
+  // SequenceItemsType into a new sequence; false if it is neither.
+  bool InsertDICOMSequence(const MetaDataObjectBase *object,
+                           const unsigned int       itemDepthLevel,
+                           gdcm::SeqEntry           *seqEntry);
+
+  // Inserts the sequences of m_StructureSet into the header
+  void InsertStructureSet(gdcm::File *header);
 
   std::string m_UIDPrefix;
   std::string m_StudyInstanceUID;
@@ -237,6 +275,8 @@ protected:
   bool        m_KeepOriginalUID;
   long        m_MaxSizeLoadEntry;
 
+  const RTStructureSet *m_StructureSet;
+
 private:
   RTSTRUCTIO(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
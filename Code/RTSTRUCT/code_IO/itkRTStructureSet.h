@@ -0,0 +1,159 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkRTStructureSet.h,v $
+  Language:  C++
+  Date:
+  Version:
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkRTStructureSet_h
+#define __itkRTStructureSet_h
+
+#include "itkLightObject.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace itk
+{
+
+/** \struct RTReferencedImage
+ *
+ *  \brief An image (CT slice) referenced by a structure set:
+ *  Referenced SOP Class UID (0008,1150) and
+ *  Referenced SOP Instance UID (0008,1155).
+ */
+struct RTReferencedImage
+{
+  std::string ReferencedSOPClassUID;
+  std::string ReferencedSOPInstanceUID;
+};
+
+
+/** \struct RTContour
+ *
+ *  \brief An item of the Contour Sequence (3006,0040) of an ROI.
+ *
+ *  The Contour Image Sequence (3006,0016) of the contour has the single
+ *  item ContourImage, and is not written if the contour references no
+ *  image (an empty ReferencedSOPInstanceUID).
+ *
+ *  The Contour Data (3006,0050), "x1\y1\z1\x2\...", is either the text
+ *  of Data, or, once ShareData() is called, text that belongs to another
+ *  object (e.g. a contour data file mapped into memory, shared by all its
+ *  contours). Shared text is never copied: the contour holds a reference
+ *  to its owner, which keeps it valid, and RTSTRUCTIO writes it as it is.
+ */
+struct RTContour
+{
+  RTReferencedImage ContourImage;     // (3006,0016)
+  std::string       GeometricType;    // (3006,0042)
+  unsigned int      NumberOfPoints;   // (3006,0046)
+  std::string       Data;             // (3006,0050), unless shared
+
+  RTContour() : NumberOfPoints(0), m_SharedData(0), m_SharedLength(0) {}
+
+  /** The Contour Data is the "length" characters at "data", which
+   *  "owner" keeps valid. */
+  void ShareData(const char *data, size_t length, const LightObject *owner)
+    {
+    Data.clear();
+    m_SharedData = data;
+    m_SharedLength = length;
+    m_DataOwner = owner;
+    }
+
+  /** The Contour Data is the text of "data", taken without a copy
+   *  ("data" gets the previous text of Data). */
+  void SwapData(std::string &data)
+    {
+    Data.swap(data);
+    m_SharedData = 0;
+    m_SharedLength = 0;
+    m_DataOwner = 0;
+    }
+
+  const char *GetDataPointer() const
+    { return m_DataOwner ? m_SharedData : Data.data(); }
+  size_t GetDataLength() const
+    { return m_DataOwner ? m_SharedLength : Data.size(); }
+
+private:
+  const char                *m_SharedData;
+  size_t                     m_SharedLength;
+  LightObject::ConstPointer  m_DataOwner;
+};
+
+
+/** \struct RTROI
+ *
+ *  \brief An ROI, written as an item of each of the Structure Set ROI
+ *  Sequence (3006,0020), the ROI Contour Sequence (3006,0039) and the
+ *  RT ROI Observations Sequence (3006,0080).
+ *
+ *  The ROI Number is also used as the Referenced ROI Number (3006,0084)
+ *  and as the Observation Number (3006,0082).
+ */
+struct RTROI
+{
+  unsigned int           Number;               // (3006,0022)
+  std::string            Name;                 // (3006,0026)
+  std::string            GenerationAlgorithm;  // (3006,0036)
+  std::string            DisplayColor;         // (3006,002a)
+  std::string            InterpretedType;      // (3006,00a4)
+  std::string            Interpreter;          // (3006,00a6)
+  std::vector<RTContour> Contours;             // (3006,0040)
+
+  RTROI() : Number(0) {}
+};
+
+
+/** \class RTStructureSet
+ *
+ *  \brief Typed in-memory model of the sequences of an RT Structure Set,
+ *  which RTSTRUCTIO writes directly into the DICOM header.
+ *
+ *  The attributes that are not in a sequence (patient, study, series...)
+ *  are still given through the MetaDataDictionary of RTSTRUCTIO.
+ *
+ *  The items are written in the order of the vectors, and there is no
+ *  limit to their number. Filling the vectors in place (e.g. after a
+ *  resize()) does not copy the contours.
+ *
+ *  \sa RTSTRUCTIO::SetStructureSet
+ *  \ingroup IOFilters
+ */
+class RTStructureSet
+{
+public:
+  /** Referenced Study Sequence (0008,1110), with a single item. The same
+   *  study is the RT Referenced Study (3006,0012). */
+  std::string ReferencedStudySOPClassUID;
+  std::string ReferencedStudySOPInstanceUID;
+
+  /** Referenced Frame of Reference Sequence (3006,0010), with a single
+   *  item: Frame of Reference UID (0020,0052), which is also the
+   *  Referenced Frame of Reference UID (3006,0024) of every ROI. */
+  std::string FrameOfReferenceUID;
+
+  /** RT Referenced Series Sequence (3006,0014), with a single item:
+   *  Series Instance UID (0020,000e) and Contour Image Sequence (3006,0016). */
+  std::string                    ReferencedSeriesInstanceUID;
+  std::vector<RTReferencedImage> ContourImages;
+
+  /** The ROIs, in the order of their items. */
+  std::vector<RTROI> ROIs;
+};
+
+} // end namespace itk
+
+#endif // __itkRTStructureSet_h
@@ -1,90 +1,122 @@
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
-#include <new>
 #include <sstream>
 #include <string>
 #include <vector>
 
-#include "itkGDCMImageIO.h" //for reading the input DICOM-CT-image-slice
-#include "itkRTSTRUCTIO.h" //for writing the output RTSTRUCT
+#include "itkLightObject.h"
+#include "itkObjectFactory.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleMutexLock.h"
+#include "itkTimeProbe.h"
 
-#include "itkImageFileReader.h"
-#include "itkImageFileWriter.h"
+#include <itksys/SystemTools.hxx>
 
-#include "itkMetaDataObject.h"
+#include "MappedTextFile.h" //for parsing the contour data files in place
+#include "CTSeriesScanner.h" //for the SOP Instance UIDs of the CT slices
+#include "RTSTRUCTExporter.h" //for writing the output RTSTRUCT
 
 using std::cerr;
+using std::cout;
 using std::endl;
 using std::ifstream;
 using std::istream;
 using std::string;
-using std::stringstream;
 using std::vector;
 
-typedef itk::MetaDataDictionary       DictionaryType;
-typedef itk::MetaDataObject< string > MetaDataStringType;
-typedef itk::MetaDataObject< DictionaryType > MetaDataDictionaryObject;
-
-// Following two values are fixed and are defined in the DICOM standards.
-const string StudyComponentManagementSOPClass = "1.2.840.10008.3.1.2.3.2";
-const string CTImageSOPClassUID = "1.2.840.10008.5.1.4.1.1.2";
-
-const string roiGenAlgorithm = "ITK-GDCM based algorithm";
-
 //-----------------------------------------------------------------------------
 // Forward declaration of functions:
-void readInputParameters(const char* parameterFileName);
-
-bool IsTagPresent(DictionaryType::ConstIterator& tagItr,
-                  DictionaryType::ConstIterator& end);
-
-void ExitIfTagNotPresent(const string&                  entryId,
-                         DictionaryType::ConstIterator& tagItr,
-                         DictionaryType::ConstIterator& end);
-
-string GetTagValue(DictionaryType::ConstIterator& tagItr);
-
-void WriteCompulsoryTags(const vector<string>&  compulsoryModule,
-                         const DictionaryType&  dictReader,
-                         DictionaryType&        dictWriter);
-
-void WriteOptionalTags(const vector<string>&   optionalModule,
-                       const DictionaryType&   dictReader,
-                       DictionaryType&         dictWriter);
-
-string itos(int i); // convert int to string
-string FixNumDigitsTo3( string str); 
-
-void read_contour_data_file(char* );
+struct InputParameters_struct;
+struct ExportOptions_struct;
+bool readInputParameters(const char* parameterFileName, InputParameters_struct& parameters,
+                         std::ostream& log);
+bool ExportStructureSet(const string& parameterFileName, const ExportOptions_struct& options,
+                        std::ostream& log);
+bool BatchExport(const char* manifestFileName, const ExportOptions_struct& options,
+                 unsigned int numberOfJobs);
+
+struct ContourObject_struct;
+struct ContourChunk_struct;
+bool read_contour_data_file(const char* , ContourObject_struct& , unsigned int ,
+                            unsigned int , vector<ContourChunk_struct>& , string& ,
+                            std::ostream& );
+bool read_contour_index(const string& , const ContourObject_struct& , vector<size_t>& ,
+                        std::ostream& );
+bool read_contour_slice(const char* , unsigned int , ContourObject_struct& , string& );
+bool parse_contour_chunk(ContourObject_struct& , const ContourChunk_struct& );
+bool LoadContourDataFiles(const vector<string>& , unsigned int ,
+                          vector<ContourObject_struct*>& , std::ostream& );
 void SkipWhiteSpace(istream& );
 
 
 //-----------------------------------------------------------------------------
-// Following two values are used for allocating the memory for
-// temporarily storing the contours information later defined object.
-//
-// XXX Modify the following two values if they do not fit to your requirement!
-//
-#define MAX_NUM_CONTOURS 1000
-#define MAX_NUM_ROIs 10
+// A contour data file mapped into memory, reference counted so that the
+// structure set can share the text of its contours: the file is only
+// unmapped once the exporter has released them.
+class SharedMappedTextFile : public itk::LightObject, public MappedTextFile
+{
+public:
+  typedef SharedMappedTextFile          Self;
+  typedef itk::LightObject              Superclass;
+  typedef itk::SmartPointer<Self>       Pointer;
+  typedef itk::SmartPointer<const Self> ConstPointer;
 
-//precision with which the vertices are saved in the input text file.
-#define PRECISION 16
+  itkNewMacro(Self);
+  itkTypeMacro(SharedMappedTextFile, LightObject);
 
-#define MAX_CHAR 1024
+protected:
+  SharedMappedTextFile() {}
 
+private:
+  SharedMappedTextFile(const Self&);
+  void operator=(const Self&);
+};
 
+// The contours of one ROI, as read from its contour data file.
+// The number of contours is only limited by the memory.
 typedef struct ContourObject_struct
 {
   unsigned int totalContours;
-  unsigned int sliceNumber[MAX_NUM_CONTOURS];
-  unsigned int numOfPoints[MAX_NUM_CONTOURS];
+  vector<unsigned int> sliceNumber;
+  vector<unsigned int> numOfPoints;
+
+  // Views into "file": the text is neither copied nor allocated per contour.
+  vector<TextView> geometryType;
+  vector<TextView> contourData;
 
-  char* geometryType[MAX_NUM_CONTOURS];
-  char* contourData[MAX_NUM_CONTOURS];
+  // The contour data file, mapped into memory and passed on to the
+  // exporter together with the views of the Contour Data.
+  SharedMappedTextFile::Pointer file;
 
+  ContourObject_struct() : totalContours(0), file( SharedMappedTextFile::New() ) {}
 } *ContourObject_handle;
 
-ContourObject_handle CONTOUR;
+// A run of consecutive contours of one ROI, parsed by one thread:
+// the text of the contours [firstContour, endContour) starts at "begin".
+// A contour data file is a single chunk, unless it has an index
+// ("<file>.idx", written by "mask2contour -index") giving the offset
+// of each contour, in which case it is split into several chunks.
+typedef struct ContourChunk_struct
+{
+  unsigned int roi;
+  unsigned int firstContour;
+  unsigned int endContour;
+  const char*  begin;
+  const char*  end;
+} *ContourChunk_handle;
+
+// The chunks of the contour data files of all the ROIs, shared by the
+// loading threads. Each thread only writes the contours of its chunks.
+typedef struct ContourLoading_struct
+{
+  vector<ContourObject_struct*>* contours;
+  vector<ContourChunk_struct>    chunks;
+  vector<char>                   failed;   // per chunk (not vector<bool>,
+                                           // whose flags share words)
+} *ContourLoading_handle;
 
 //---------------------------------------------------
 // Definition of a structure for storing the parameters from
@@ -92,905 +124,779 @@ ContourObject_handle CONTOUR;
 
 typedef struct InputParameters_struct
 {
-  char* inputDCMFileName;
-  char* outputFileName;
-  char* prefixSOPInstUID;
+  string inputDCMFileName;
+  string outputFileName;
+  string prefixSOPInstUID;
   
-  char* contourDataFileName[MAX_NUM_ROIs];
-  char* roiName[MAX_NUM_ROIs];
-  char* roiInterpretedType[MAX_NUM_ROIs];
-  char* roiColor[MAX_NUM_ROIs];
+  // One entry per ROI
+  vector<string> contourDataFileName;
+  vector<string> roiName;
+  vector<string> roiInterpretedType;
+  vector<string> roiColor;
 
   unsigned int NumSlicesInRTSTRUCT;
   unsigned int START_SLICE_NUM;
   unsigned int numOfROIs;
 } *InputParameters_handle;
 
-InputParameters_handle parameters;
-
 //---------------------------------------------------
-typedef signed short PixelType; //for Input CT slice
-const unsigned int   Dimension = 2; //for Input CT slice
+// The options of the command line, shared by all the exports of a batch.
 
-typedef itk::Image< PixelType, Dimension > ImageType;
-typedef itk::ImageFileReader < ImageType > ReaderType;
-typedef itk::ImageFileWriter < ImageType > WriterType;
-
-typedef itk::GDCMImageIO ImageInType;
-typedef itk::RTSTRUCTIO  STRUCTOutType;
-//---------------------------------------------------
+typedef struct ExportOptions_struct
+{
+  double       precision;             // -precision
+  string       seriesDirectory;       // -series
+  bool         seriesDirectoryGiven;
+  string       seriesCacheDirectory;  // -series-cache (no cache if empty)
+  bool         placeByZ;              // -place-by-z
+  double       zTolerance;            // -z-tolerance
+
+  // Threads of the parsing of the contour data files of an export, of
+  // the scan of its CT series, and of the building of its ROIs.
+  unsigned int numberOfThreads;
+
+  ExportOptions_struct()
+    : precision(0.001), seriesDirectoryGiven(false),
+      placeByZ(false), zTolerance(-1.0),
+      numberOfThreads( static_cast<unsigned int>(
+                         itk::MultiThreader::GetGlobalDefaultNumberOfThreads() ) ) {}
+} *ExportOptions_handle;
+
+// The exports of a batch, shared by the worker threads: each worker takes
+// the next job of the manifest until there is none left, so that long and
+// short exports balance out.
+typedef struct BatchExport_struct
+{
+  vector<string>        parameterFileNames;
+  ExportOptions_struct  options;
+  unsigned int          nextJob;     // under "lock"
+  vector<char>          succeeded;   // per job
+  itk::SimpleMutexLock  lock;        // also guards the output of the reports
+} *BatchExport_handle;
 
 
 int main(int argc, char* argv[])
 {
   // Verify the number of parameters in the command line.
-  if( argc < 2 )
+  const bool batch = ( argc >= 2 && string(argv[1]) == "-batch" );
+  if( argc < 2 || ( batch && argc < 3 ) )
   {
     cerr << "Usage: " << endl;
-    cerr << argv[0] << " <parameter-file>" << endl;
+    cerr << argv[0] << " <parameter-file> [options]" << endl;
+    cerr << argv[0] << " -batch <manifest> [-jobs <n>] [options]" << endl;
+    cerr << "  -batch <manifest>  exports the structure sets of all the parameter" << endl;
+    cerr << "                   files listed in the manifest (one per line, \"#\"" << endl;
+    cerr << "                   for comments), several at a time" << endl;
+    cerr << "  -jobs <n>        number of exports run at a time (default: the" << endl;
+    cerr << "                   number of processors)" << endl;
+    cerr << "Options:" << endl;
+    cerr << "  -precision <mm>  rounding of the coordinates that are not valid" << endl;
+    cerr << "                   DICOM Decimal Strings (default 0.001)" << endl;
+    cerr << "  -series <directory>  directory of the CT series, whose slices are" << endl;
+    cerr << "                   referenced by their own SOP Instance UIDs (default:" << endl;
+    cerr << "                   the directory of the input DICOM slice)" << endl;
+    cerr << "  -series-cache <directory>  directory of the caches of the headers of" << endl;
+    cerr << "                   the series (<Series Instance UID>.ctseries), read" << endl;
+    cerr << "                   again only from the changed files (default: no" << endl;
+    cerr << "                   cache, the headers are always read from the series)" << endl;
+    cerr << "  -place-by-z      put each contour on the CT slice at its z rather than" << endl;
+    cerr << "                   on its slice number (for contour data files in the" << endl;
+    cerr << "                   patient coordinates of the CT series)" << endl;
+    cerr << "  -z-tolerance <mm>  with -place-by-z, largest distance between a contour" << endl;
+    cerr << "                   and the CT slice it is put on (default: a quarter of" << endl;
+    cerr << "                   the smallest distance between two slices)" << endl;
     return EXIT_FAILURE;
   }
 
-  // Read the input parameters.
-  parameters = new InputParameters_struct;
-  readInputParameters(argv[1]);
-
-  ImageInType::Pointer gdcmIO1 = ImageInType::New(); // for DICOM reader
-  const DictionaryType& dictReader = gdcmIO1->GetMetaDataDictionary();
-
-  // the tags and keys of interest are read from the input DICOM file
-  // and are written to the output RTSTRUCT DICOM file.
-  ReaderType::Pointer reader = ReaderType::New();
-  reader->SetFileName(parameters->inputDCMFileName);
-  reader->SetImageIO(gdcmIO1);
-
-  try
+  ExportOptions_struct options;
+  unsigned int         numberOfJobs = 0;
+  for ( int arg = batch ? 3 : 2; arg < argc; arg++ )
   {
-    reader->Update();
+    if ( string(argv[arg]) == "-precision" && arg + 1 < argc )
+    {
+      options.precision = atof( argv[++arg] );
+      if ( ! DecimalStringEncoder::IsValidPrecision( options.precision ) )
+      {
+        cerr << "The precision must be a positive number: " << argv[arg] << endl;
+        return EXIT_FAILURE;
+      }
+    } else if ( string(argv[arg]) == "-series" && arg + 1 < argc )
+    {
+      options.seriesDirectory = argv[++arg];
+      options.seriesDirectoryGiven = true;
+    } else if ( string(argv[arg]) == "-series-cache" && arg + 1 < argc )
+    {
+      options.seriesCacheDirectory = argv[++arg];
+    } else if ( string(argv[arg]) == "-place-by-z" )
+    {
+      options.placeByZ = true;
+    } else if ( string(argv[arg]) == "-z-tolerance" && arg + 1 < argc )
+    {
+      options.zTolerance = atof( argv[++arg] );
+    } else if ( batch && string(argv[arg]) == "-jobs" && arg + 1 < argc )
+    {
+      numberOfJobs = static_cast<unsigned int>( atoi( argv[++arg] ) );
+    } else
+    {
+      cerr << "Unknown or incomplete option: " << argv[arg] << endl;
+      return EXIT_FAILURE;
+    }
   }
-  catch (itk::ExceptionObject &ex)
+
+  if ( batch )
   {
-    cerr << "Exception caught while reading the i/p DICOM file: " << endl;
-    cerr << ex << endl;
+    return BatchExport(argv[2], options, numberOfJobs) ? EXIT_SUCCESS : EXIT_FAILURE;
   }
+  return ExportStructureSet(argv[1], options, cerr) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
-  //       |------------------------------|
-  //       | RT STRUCTURE SET IOD MODULES |
-  //       |------------------------------|
-  //
-  // Only the mandatory(M) IOD modules of RTSTRUCT are created by this program.
-  // Those manadatory modules are as follows:
-  //
-  // |--------------------|----------------------|
-  // | Information-Entity |  Mandatory Modules   |
-  // |--------------------|----------------------|
-  // |                    |                      |
-  // | Patient            | Patient              |
-  // |                    |                      |
-  // |--------------------|----------------------|
-  // |                    |                      |
-  // | Study              | General Study        |
-  // |                    |                      |
-  // |--------------------|----------------------|
-  // |                    |                      |
-  // | Series             | RT Series            |
-  // |                    |                      |
-  // |--------------------|----------------------|
-  // |                    |                      |
-  // | Equipment          | General Equipment    |
-  // |                    |                      |
-  // |--------------------|----------------------|
-  // |                    |                      |
-  // | Structure Set      | Structure Set        |
-  // |                    | ROI Contour          |
-  // |                    | RT ROI Observations  |
-  // |                    | SOP Common           |
-  // |                    |                      |
-  // |--------------------|----------------------|
-  //
-  // Each individual module is described in detail below....
-  //
-  
-  
-  STRUCTOutType::Pointer gdcmIO2 = STRUCTOutType::New(); // for DICOM writer
-  DictionaryType& dictWriter = gdcmIO2->GetMetaDataDictionary();
-
-  vector<string> mandatoryModule;
-  vector<string> optioalModule;
-
-  DictionaryType::ConstIterator  tagItr;
-  DictionaryType::ConstIterator  end = dictReader.End();
-  string tagValue;
-
-  //                  |--------------------|
-  //                  | Patient Module (M) |
-  //                  |--------------------|
-  //
-  // Only the following tags of this module are written!
-  //
-  // |-------|----------------------|-------------|------|
-  // | S.No. | Attribute Name       | Tag         | Type |
-  // |-------|----------------------|-------------|------|
-  // | 1     | Patient's Name       | (0010,0010) | 2    |
-  // | 2     | Patient ID           | (0010,0020) | 2    |
-  // | 3     | Patient's Birth Date | (0010,0030) | 2    |
-  // | 4     | Patient's Sex        | (0010,0040) | 2    |
-  // |-------|----------------------|-------------|------|
-  //
-  // This information is extracted from the input CT-Slice.
-
-  mandatoryModule.push_back("0010|0010");
-  mandatoryModule.push_back("0010|0020");
-  mandatoryModule.push_back("0010|0030");
-  mandatoryModule.push_back("0010|0040");
-
-
-  //                  |--------------------------|
-  //                  | General Study Module (M) |
-  //                  |--------------------------|
-  //
-  // Only the following tags of this module are written!
-  // 
-  //
-  // |-------|--------------------------------|-------------|------|
-  // | S.No. | Attribute Name                 | Tag         | Type |
-  // |-------|--------------------------------|-------------|------|
-  // | 1     | Study Inst. UID                | (0020|000d) | 1    | 
-  // | 2     | Study Date                     | (0008|0020) | 2    |
-  // | 3     | Study Time                     | (0008|0030) | 2    |
-  // | 4     | Ref. Phys. Name                | (0008|0090) | 2    |
-  // | 5     | Study ID                       | (0020|0010) | 2    |
-  // | 6     | Accession Number               | (0008|0050) | 2    |
-  // |-------|--------------------------------|-------------|------|
-  // | 7     | Study Description              | (0008|1030) | 3    |
-  // | 8     | Physician(s) of Record         | (0008|1048) | 3    |
-  // |-------|--------------------------------|-------------|------|
-  // | 9     | Referenced Study Sequence      | (0008|1110) | 3    |
-  // | 9.1   |  > Referenced SOP Class UID    | (0008|1150) | 1C   |
-  // | 9.2   |  > Referenced SOP Instance UID | (0008|1155) | 1C   |
-  // |-------|--------------------------------|-------------|------|
-  //
-  // This information is extracted from the input CT-Slice.
-
-  mandatoryModule.push_back("0020|000d");
-  mandatoryModule.push_back("0008|0020");
-  mandatoryModule.push_back("0008|0030");
-  mandatoryModule.push_back("0008|0090");
-  mandatoryModule.push_back("0020|0010");
-  mandatoryModule.push_back("0008|0050");
-
-  optioalModule.push_back("0008|1030");
-  optioalModule.push_back("0008|1048");
-
-  STRUCTOutType::Pointer refStudySeq = STRUCTOutType::New();
-  DictionaryType & refStudyDict = refStudySeq->GetMetaDataDictionary();
-
-  // StudyComponentManagementSOPClass = 1.2.840.10008.3.1.2.3.2
-  itk::EncapsulateMetaData<string>(refStudyDict, "0008|1150", StudyComponentManagementSOPClass);
-
-  // Reference SOP instance UID:
-  // This value is same as that of (0020|000d)
-  // The same value will also be used latter in Structure-Set module.
-
-  string sopInstUID;
-  tagItr = dictReader.Find( "0020|000d" );
-
-  if (IsTagPresent( tagItr, end ) )
-  {
-    sopInstUID = GetTagValue( tagItr );
-  } else
+
+// Exports the structure set of a parameter file. The messages go to
+// "log". Returns false if the structure set could not be written.
+bool ExportStructureSet(const string&               parameterFileName,
+                        const ExportOptions_struct& options,
+                        std::ostream&               log)
+{
+  // Read the input parameters.
+  InputParameters_struct parameters;
+  if ( ! readInputParameters(parameterFileName.c_str(), parameters, log) )
   {
-    cerr << "Unable to find the (0020,000d) tag in the input CT image!" << endl;
+    return false;
   }
 
-  itk::EncapsulateMetaData<string>(refStudyDict, "0008|1155", sopInstUID);
-
-  itk::EncapsulateMetaData<DictionaryType>(dictWriter, "0008|1110", refStudyDict);
-
-
-  //                  |----------------------|
-  //                  | RT Series Module (M) |
-  //                  |----------------------|
-  //
-  // Only the following tags of this module are written!
-  //
-  // |-------|--------------------|-------------|------|
-  // | S.No. | Attribute Name     | Tag         | Type |
-  // |-------|--------------------|-------------|------|
-  // | 1     | Modality           | (0008|0060) | 1    | 
-  // | 2     | Series Inst. UID   | (0020|000e) | 1    |
-  // | 3     | Series Number      | (0020|0011) | 2    |
-  // |-------|--------------------|-------------|------|
-  // | 4     | Series Description | (0008|103e) | 3    |
-  // |-------|------------------  |-------------|------|
-  //
-
-  // Modality: "RTSTRUCT"
-  itk::EncapsulateMetaData<string>(dictWriter, "0008|0060", "RTSTRUCT");
-
-  // Series Inst. UID: The default value assigned by GDCM is used!!!
-
-  // Series Number: A number that identifies this series
-  // No value is set for this tag at this moment
-  itk::EncapsulateMetaData<string>(dictWriter, "0020|0011", "");
-
-  itk::EncapsulateMetaData<string>(dictWriter, "0008|103e", "ITK/GDCM ROI");
-
-
-
-  //             |------------------------------|
-  //             | General Equipment Module (M) |
-  //             |------------------------------|
-  //
-  // Only the following tags of this module are written!
-  //
-  // |-------|------------------|-------------|------|
-  // | S.No. | Attribute Name   | Tag         | Type |
-  // |-------|------------------|-------------|------|
-  // | 1     | Manufacturer     | (0008|0070) | 2    | 
-  // |-------|------------------|-------------|------|
-  // | 2     | Station Name     | (0008|1010) | 3    |
-  // |-------|------------------|-------------|------|
-
-
-  // The default manufacturer name for this output is: "GDCM Factory"
-  // and the same name is retained.
-  //
-
-  // (0x0008,0x1010) SH Station Name
-  itk::EncapsulateMetaData<string>(dictWriter, "0008|1010", "ITK/GDCM PC");
-
-  //                 |------------------------|
-  //                 |  SOP Common Module (M) |
-  //                 |------------------------|
-  //
-  // Only the following tags of this module are written!
-  //
-  // |-------|--------------------------|-------------|------|
-  // | S.No. | Attribute Name           | Tag         | Type |
-  // |-------|--------------------------|-------------|------|
-  // | 1     | SOP Class UID            | (0008|0016) | --   |
-  // | 2     | SOP Instance UID         | (0008|0018) | --   |
-  // | 3     | Instance Creation Date   | (0008|0012) | 3    |
-  // | 4     | Instance Creation Time   | (0008|0013) | 3    |
-  // | 5     | Timezone Offset From UTC | (0008|0201) | 3    |
-  // |-------|--------------------------|-------------|------|
-  //
-
-  // SOP Class UID is written in gdcmFileHelper.cxx
-  // SOP Instance UID is written in gdcmFileHelper.cxx
-  // Instance Creation Date is Set in gdcmFileHelper.cxx
-  // Instance Creation Time is Set in gdcmFileHelper.cxx
-  //
-
-  optioalModule.push_back("0008|0201");
-
-  // (0x0002,0x0016) AE Source Application Entity Title
-  optioalModule.push_back("0002|0016");
-
-  WriteCompulsoryTags(mandatoryModule, dictReader, dictWriter);
-  WriteOptionalTags(optioalModule, dictReader, dictWriter);
-
-
-  //                 |--------------------------|
-  //                 | Structure Set Module (M) |
-  //                 |--------------------------|
-  //
-  // Only the following tags of this module are written!
-  //
-  // A structure set defines a set of areas of significance.
-  // Each area can be associated with a Frame of Reference and zero or more
-  // images. Information which can be transferred with each region of
-  // interest (ROI) includes geometrical and display parameters, 
-  // and generation technique.
-  //
-  // We will write only those attributes listed in the following table.
-  //
-  //
-  // |-----------|--------------------------------------|-------------|------|
-  // | S.No.     |           Attribute Name             |    Tag      | Type |
-  // |-----------|--------------------------------------|-------------|------|
-  // | 1         | Structure Set Label                  | (3006|0002) | 1    |
-  // |-----------|--------------------------------------|-------------|------|
-  // | 2         | Structure Set Name                   | (3006|0004) | 3    |
-  // |-----------|--------------------------------------|-------------|------|
-  // | 3         | Structure Set Date                   | (3006|0008) | 2    |
-  // |-----------|--------------------------------------|-------------|------|
-  // | 4         | Structure Set Time                   | (3006|0009) | 2    |
-  // |-----------|--------------------------------------|-------------|------|
-  // | 5         | Referenced frame of Ref. Sequence    | (3006|0010) | 3    |
-  // | 5.1       |  > Frame of Ref. UID                 | (0020|0052) | 1C   |
-  // |           |                                      |             |      |
-  // | 5.2       |  > RT Referenced Study Sequence      | (3006|0012) | 3    |
-  // | 5.2.1     |    >> Referenced SOP Class UID       | (0008|1150) | 1C   |
-  // | 5.2.2     |    >> Referenced SOP Instance UID    | (0008|1155) | 1C   |
-  // |           |                                      |             |      |
-  // | 5.2.3     |    >> RT Referenced Series Sequence  | (3006|0014) | 1C   |
-  // | 5.2.3.1   |       >>> Series Instance UID        | (0020|000E) | 1C   |
-  // |           |                                      |             |      |
-  // | 5.2.3.2   |       >>> Contour Image Sequence     | (3006|0016) | 1C   |
-  // | 5.2.3.2.1 |           >>>> Ref. SOP Class UID    | (0008|1150) | 1C   |
-  // | 5.2.3.2.2 |           >>>> Ref. SOP Instance UID | (0008|1155) | 1C   |
-  // |-----------|--------------------------------------|-------------|------|
-  // | 6         | Structure Set ROI Sequence           | (3006|0020) | 3    |
-  // | 6.1       |  > ROI Number                        | (3006|0022) | 1C   |
-  // | 6.2       |  > Referenced Frame of ref. UID      | (3006|0024) | 1C   |
-  // | 6.3       |  > ROI Name                          | (3006|0026) | 2C   |
-  // | 6.4       |  > ROI Generation Algorithm          | (3006|0036) | 2C   |
-  // |-----------|--------------------------------------|-------------|------|
-  //
-  //
-
-  // 1
-  // Structure Set Label = Study Description name (0008,1030)
-  // If study description name does not exist, set it to "test-structure"
-  tagItr = dictReader.Find( "0008|1030" );
-  tagValue = "test-structure";
-  if (IsTagPresent( tagItr, end ) )
-    tagValue = GetTagValue( tagItr );
-  itk::EncapsulateMetaData<string>(dictWriter, "3006|0002", tagValue);
-
-  // 2
-  // Structure Set Name = "ROI"
-  itk::EncapsulateMetaData<string>(dictWriter, "3006|0004", "ROI");
-
-  // 3
-  // Structure Set Time = Initially set it's value to an empty string;
-  // set it's value correctly, latter in "gdcmFileHelper.cxx"
-  itk::EncapsulateMetaData<string>(dictWriter, "3006|0008", "");
-
-  // 4
-  // Structure Set Date = Initially set it's value to an empty string;
-  // set it's value correctly, latter in "gdcmFileHelper.cxx"
-  itk::EncapsulateMetaData<string>(dictWriter, "3006|0009", "");
-
-  // Create all the required Dictionaries.....
-  // ------------------------------------------------------
-  // Dictionary for including "Referenced frame of Reference"
-  STRUCTOutType::Pointer gdcmRefFrameSeq = STRUCTOutType::New();
-  DictionaryType refFrameDict = gdcmRefFrameSeq->GetMetaDataDictionary();
-
-  // Dictionary for including "RT Referenced Study Sequence"
-  STRUCTOutType::Pointer gdcmRtRefStudySeq = STRUCTOutType::New();
-  DictionaryType rtRefStudyDict = gdcmRtRefStudySeq->GetMetaDataDictionary();
-
-  // Dictionary for including "RT Referenced Series Sequence"
-  STRUCTOutType::Pointer gdcmRtRefSerSeq = STRUCTOutType::New();
-  DictionaryType rtRefSerDict = gdcmRtRefSerSeq->GetMetaDataDictionary();
-
-  // Dictionary for including "Contour Image Sequence"
-  STRUCTOutType::Pointer gdcmContourImageSeq = STRUCTOutType::New();
-  DictionaryType contourImageDict = gdcmContourImageSeq->GetMetaDataDictionary();
-  // ------------------------------------------------------
-
-  // The Frame of Reference UID (0020,0052) shall be used to uniquely identify
-  // a frame of reference for a series. Each series shall have 
-  // a single Frame of Reference UID. However, multiple Series
-  // within a Study may share a Frame of Reference UID.
-  // All images in a Series that share the same Frame of Reference UID
-  // shall be spatially related to each other.
-  // 
-  // We assume here that there is a single frame of reference and,
-  // we will extract that value from the CT-DICOM image.
-  //
-  string frameOfReferenceUID;
-  tagItr = dictReader.Find( "0020|0052" );
-
-  if (IsTagPresent( tagItr, end ) )
+  // The contour data files of all the ROIs are parsed at once, in
+  // parallel; the exporter then takes them in ROI order.
+  vector<ContourObject_struct*> roiContours;
+  if ( ! LoadContourDataFiles(parameters.contourDataFileName, options.numberOfThreads,
+                              roiContours, log) )
   {
-    frameOfReferenceUID = GetTagValue( tagItr );
-  } else
-  {
-    cerr << "Unable to find the Frame of Reference UID in the CT image!"
-         << endl;
+    return false;
   }
-  // 5.1
-  itk::EncapsulateMetaData<string>(refFrameDict, "0020|0052", frameOfReferenceUID);
 
-  // -----------------------------------------------------------------------
-  // Bottom-up approach is followed when there are recursive sequences....
-  // -----------------------------------------------------------------------
-  
-  // 5.2.1
-  // Referenced SOP class UID = StudyComponentManagementSOPClass
-  itk::EncapsulateMetaData<string>(rtRefStudyDict, "0008|1150", StudyComponentManagementSOPClass);
+  // The export itself, from the data of the parameter file
+  RTSTRUCTExporter exporter;
 
-  // 5.2.2
-  // Referenced SOP Instance UID: Already available = sopInstUID;
-  itk::EncapsulateMetaData<string>(rtRefStudyDict, "0008|1155", sopInstUID);
+  // The Contour Data values longer than the 16 characters of a DICOM
+  // Decimal String are re-encoded, rounded to this precision.
+  exporter.SetPrecision( options.precision );
+  exporter.SetPlaceContoursByZ( options.placeByZ );
+  exporter.SetZTolerance( options.zTolerance );
+  exporter.SetNumberOfThreads( options.numberOfThreads );
+  exporter.SetSlices( parameters.prefixSOPInstUID, parameters.START_SLICE_NUM,
+                      parameters.NumSlicesInRTSTRUCT );
 
-  // Series Instance UID: Unique Identifier of the series containing the image
-  //It's value = (0020,000e) tag value of the CT image
-  string refSeriesInstUID;
-  tagItr = dictReader.Find( "0020|000e" );
-
-  if (IsTagPresent( tagItr, end ) )
-  {
-    refSeriesInstUID = GetTagValue( tagItr );
-  } else
+  if ( ! exporter.ReadReferenceHeader( parameters.inputDCMFileName, log ) )
   {
-    cerr << "Unable to find (0020|000e) tag in the CT image!" << endl;
+    for ( unsigned int roi = 0; roi < roiContours.size(); roi++ )
+    {
+      delete roiContours[roi];
+    }
+    return false;
   }
-  // 5.2.3.1
-  itk::EncapsulateMetaData<string>(rtRefSerDict, "0020|000e", refSeriesInstUID);
-
 
-  string tempSOPInstUID;
-  string tempString;
-  unsigned int startNum = parameters->START_SLICE_NUM;
+  // The slices of the CT series, in the order of their numbers in the
+  // parameter file, give the Referenced SOP Instance UIDs. With
+  // -series-cache, the headers of the series are cached for the next
+  // exports against the same series (never in the series directory
+  // unless it is the one given, so that the input data is left as is).
+  const string refSeriesInstUID = exporter.GetReferenceValue( "0020|000e", log );
 
-  for ( int count = 1; count <= parameters->NumSlicesInRTSTRUCT; count++ )
+  string seriesDirectory = options.seriesDirectory;
+  if ( ! options.seriesDirectoryGiven )
   {
-    tempString = ITEM_ENCAPSULATE_STRING + FixNumDigitsTo3( itos( count ) );
-    tempSOPInstUID = (parameters->prefixSOPInstUID) + itos( startNum );
-
-    STRUCTOutType::Pointer gdcmIOItem = STRUCTOutType::New();
-    DictionaryType &itemDict = gdcmIOItem->GetMetaDataDictionary();
-
-    // 5.2.3.2.1
-    // Referenced SOP Class UID:
-    // Uniquely identifies the referenced image SOP instance
-    // It's value is constant = CTImageSOPClassUID
-    itk::EncapsulateMetaData<string>(itemDict, "0008|1150", CTImageSOPClassUID);
-
-    // 5.2.3.2.2
-    // Referenced SOP Instance UID
-    itk::EncapsulateMetaData<string>(itemDict, "0008|1155", tempSOPInstUID);
-
-    // item encapsulation
-    itk::EncapsulateMetaData<DictionaryType>(contourImageDict, tempString, itemDict);
-
-    ++startNum;
+    seriesDirectory = itksys::SystemTools::GetFilenamePath( parameters.inputDCMFileName );
   }
-
-  // 5.2.3.2
-  itk::EncapsulateMetaData<DictionaryType>(rtRefSerDict, "3006|0016", contourImageDict);
-
-  // 5.2.3
-  itk::EncapsulateMetaData<DictionaryType>(rtRefStudyDict, "3006|0014", rtRefSerDict);
-
-  // 5.2
-  itk::EncapsulateMetaData<DictionaryType>(refFrameDict, "3006|0012", rtRefStudyDict);
-
-  // 5
-  itk::EncapsulateMetaData<DictionaryType>(dictWriter, "3006|0010", refFrameDict);
-  //-------------------------------------------------------------------------------
-
-
-  STRUCTOutType::Pointer gdcmIOStructureSetRoi = STRUCTOutType::New();
-  DictionaryType &structureSetRoiSeq = gdcmIOStructureSetRoi->GetMetaDataDictionary();
-
-  // 6.2
-  // Referenced Frame of ref. UID = frameOfReferenceUID
-  //
-  // Uniquely identifies Frame of Reference in which ROI is defined, specified by Frame
-  // of Reference UID (0020,0052) in Referenced Frame of Reference Sequence
-  // (3006,0010). Required if Structure Set ROI Sequence (3006,0020) is sent.
-   
-  for (unsigned int roiNumber = 1; roiNumber <= parameters->numOfROIs; roiNumber++)
+  string seriesCacheFileName;
+  if ( ! options.seriesCacheDirectory.empty() )
   {
-    tempString = ITEM_ENCAPSULATE_STRING + FixNumDigitsTo3( itos( roiNumber ) );
-
-    STRUCTOutType::Pointer gdcmIOItem = STRUCTOutType::New();
-    DictionaryType &itemDict = gdcmIOItem->GetMetaDataDictionary();
-
-    itk::EncapsulateMetaData<string>(itemDict, "3006|0022", itos(roiNumber));
-    itk::EncapsulateMetaData<string>(itemDict, "3006|0024", frameOfReferenceUID);
-    itk::EncapsulateMetaData<string>(itemDict, "3006|0026", parameters->roiName[roiNumber-1]);
-    itk::EncapsulateMetaData<string>(itemDict, "3006|0036", roiGenAlgorithm);
-
-    itk::EncapsulateMetaData<DictionaryType>(structureSetRoiSeq, tempString, itemDict);
+    seriesCacheFileName = CTSeriesCacheFileName( options.seriesCacheDirectory,
+                                                 refSeriesInstUID );
   }
 
-  // 6
-  itk::EncapsulateMetaData<DictionaryType>(dictWriter, "3006|0020", structureSetRoiSeq);
-
-
-
-  //                       |------------------------|
-  //                       | ROI Contour Module (M) |
-  //                       |------------------------|
-  //
-  // Only the following tags of this module are written!
-  //
-  // This module is used to define the ROI as a set of contours.
-  // Each ROI contains a sequence of one or more contours, where a contour
-  // is either a single point (for a point ROI) or more than one point
-  // (representing an open or closed polygon).
-  // 
-  //
-  // We will write only those attributes listed in the following table.
-  //
-  //
-  // |---------|---------------------------------------|-------------|------|
-  // | S.No.   |           Attribute Name              |    Tag      | Type |
-  // |---------|---------------------------------------|-------------|------|
-  // | 1       | ROI Contour Sequence                  | (3006|0039) | 1    |
-  // | 1.1     |  > Referenced ROI Number              | (3006|0084) | 1    |
-  // | 1.2     |  > ROI Display Color                  | (3006|002a) | 3    |
-  // |         |                                       |             |      |
-  // | 1.3     |  > Contour Sequence                   | (3006|0040) | 3    |
-  // |         |                                       |             |      |
-  // | 1.3.1   |    >> Contour Image Sequence          | (3006|0016) | 3    |
-  // | 1.3.1.1 |       >>> Referenced SOP Class UID    | (0008|1150) | 1C   |
-  // | 1.3.1.2 |       >>> Referenced SOP Instance UID | (0008|1155) | 1C   |
-  // |         |                                       |             |      |
-  // | 1.3.2   |    >> Contour Geometric Type          | (3006|0042) | 1C   |
-  // | 1.3.3   |    >> Number of Contour Points        | (3006|0046) | 1C   |
-  // | 1.3.4   |    >> Contour Data                    | (3006|0050) | 1C   |
-  // |---------|---------------------------------------|-------------|------|
-
-  STRUCTOutType::Pointer gdcmIORoiContour = STRUCTOutType::New();
-  DictionaryType &roiContourSeq = gdcmIORoiContour->GetMetaDataDictionary();
-
-  for (unsigned int contourItem = 1; contourItem <= parameters->numOfROIs; contourItem++)
+  vector<CTSliceHeader> series;
+  string                seriesError;
+  if ( ! ScanCTSeries(seriesDirectory, refSeriesInstUID, seriesCacheFileName,
+                      options.numberOfThreads, series, seriesError) )
   {
-    // Create a temporary string for encapsulating the item:
-    string tempStringHigh = ITEM_ENCAPSULATE_STRING + FixNumDigitsTo3( itos( contourItem ) );
-
-    // Create an item-dictionary for each contour
-    STRUCTOutType::Pointer gdcmIOItem = STRUCTOutType::New();
-    DictionaryType &itemDict = gdcmIOItem->GetMetaDataDictionary();
-
-    // Create an item-dictionary for each contour
-
-    //1.1 Referenced ROI Number
-    //ROIs are successively numberd starting from 1
-    itk::EncapsulateMetaData<string>(itemDict, "3006|0084", itos(contourItem));
+    log << seriesError << endl;
+  }
+  exporter.SetSeries( series );
 
-    //1.2 ROI Display Color
-    itk::EncapsulateMetaData<string>(itemDict, "3006|002a", parameters->roiColor[contourItem-1]);
+  // The ROIs, in the order of the parameter file, and their contours, the
+  // text of whose Contour Data is shared with the mapped contour data
+  // files rather than copied.
+  for ( unsigned int roiNumber = 1; roiNumber <= parameters.numOfROIs; roiNumber++ )
+  {
+    const unsigned int roi = exporter.AddROI( parameters.roiName[roiNumber-1],
+                                              parameters.roiInterpretedType[roiNumber-1],
+                                              parameters.roiColor[roiNumber-1] );
 
-    //1.3 Contour Sequence Declaration
-    STRUCTOutType::Pointer gdcmIOContour = STRUCTOutType::New();
-    DictionaryType &contourSeq = gdcmIOContour->GetMetaDataDictionary();
+    const ContourObject_struct& contours = *roiContours[roiNumber-1];
+    exporter.ReserveContours( roi, contours.totalContours );
 
-    CONTOUR = new ContourObject_struct;
-    read_contour_data_file(parameters->contourDataFileName[contourItem-1]); 
+    for ( unsigned int i = 0; i < contours.totalContours; i++ )
+    {
+      exporter.AddContour( roi, contours.geometryType[i].ToString(), contours.numOfPoints[i],
+                           contours.contourData[i].data, contours.contourData[i].length,
+                           contours.sliceNumber[i], contours.file );
+    }
 
-    unsigned int sliceNumber;
+    // The parsed contours of the ROI are released at once; the exporter
+    // keeps the file mapped.
+    delete roiContours[roiNumber-1];
+    roiContours[roiNumber-1] = NULL;
+  }
 
-    for (unsigned int count = 1; count <= CONTOUR->totalContours; count++)
-    {
-      // Create an item-dictionary for each contour
-      STRUCTOutType::Pointer gdcmIOSubItem = STRUCTOutType::New();
-      DictionaryType &subItemDict = gdcmIOSubItem->GetMetaDataDictionary();
+  return exporter.Write( parameters.outputFileName, log );
+}
 
-      // Creating a name for encapsulating the item....
-      tempString = ITEM_ENCAPSULATE_STRING + FixNumDigitsTo3( itos( count ) );
 
-      // 1.3.1 Declaration
-      // Dictionary for including "Contour Image Sequence"
-      STRUCTOutType::Pointer gdcmContourImageSeq2 = STRUCTOutType::New();
-      DictionaryType contourImageDict2 = gdcmContourImageSeq2->GetMetaDataDictionary();
+ITK_THREAD_RETURN_TYPE BatchExportThreadCallback(void* arg)
+{
+  itk::MultiThreader::ThreadInfoStruct* info =
+    static_cast<itk::MultiThreader::ThreadInfoStruct*>(arg);
+  BatchExport_handle batch = static_cast<BatchExport_handle>( info->UserData );
 
-      // 1.3.1.1
-      // Referenced SOP Class UID:
-      // Uniquely identifies the referenced image SOP instance
-      // It's value is constant = CTImageSOPClassUID
-      itk::EncapsulateMetaData<string>(contourImageDict2, "0008|1150", CTImageSOPClassUID); 
+  const unsigned int numberOfJobs =
+    static_cast<unsigned int>( batch->parameterFileNames.size() );
 
-      // 1.3.1.2
-      // Finding the Referenced SOP Instance UID, from the slice Number
-      sliceNumber = CONTOUR->sliceNumber[count-1];
-      tempSOPInstUID = (parameters->prefixSOPInstUID) + itos( parameters->START_SLICE_NUM + sliceNumber );
-      itk::EncapsulateMetaData<string>(contourImageDict2, "0008|1155", tempSOPInstUID);
+  for (;;)
+  {
+    batch->lock.Lock();
+    const unsigned int job = batch->nextJob++;
+    batch->lock.Unlock();
 
-      // 1.3.1 Encapsulation
-      // Add Contour Image Sequence to Item Dictionary
-      itk::EncapsulateMetaData<DictionaryType>(subItemDict, "3006|0016", contourImageDict2);
+    if ( job >= numberOfJobs )
+    {
+      break;
+    }
 
-      //1.3.2
-      // Add Contour Geometric Type
-      itk::EncapsulateMetaData<string>(subItemDict, "3006|0042", CONTOUR->geometryType[count-1]);
+    // The messages of an export are printed at once, with its report.
+    std::ostringstream log;
+    itk::TimeProbe     probe;
+    probe.Start();
+    const bool succeeded =
+      ExportStructureSet( batch->parameterFileNames[job], batch->options, log );
+    probe.Stop();
+
+    batch->succeeded[job] = succeeded;
+
+    batch->lock.Lock();
+    cerr << log.str();
+    cout << "[" << job + 1 << "/" << numberOfJobs << "] "
+         << batch->parameterFileNames[job] << ": "
+         << ( succeeded ? "written" : "FAILED" ) << " in "
+         << probe.GetMeanTime() << " s" << endl;
+    batch->lock.Unlock();
+  }
+  return ITK_THREAD_RETURN_VALUE;
+}
 
-      //1.3.3
-      //Add Number of Contour Points
-      itk::EncapsulateMetaData<string>(subItemDict, "3006|0046",  itos( CONTOUR->numOfPoints[count-1] ) );
 
+// Exports the structure sets of the parameter files of a manifest, with
+// "numberOfJobs" exports at a time (0 for the number of processors), in a
+// single process: ITK and the gdcm dictionaries are set up only once.
+// Prints the time of each export. Returns false if an export failed.
+bool BatchExport(const char*                 manifestFileName,
+                 const ExportOptions_struct& options,
+                 unsigned int                numberOfJobs)
+{
+  ifstream manifest(manifestFileName);
+  if ( ! manifest )
+  {
+    cerr << "Unable to open the manifest: " << manifestFileName << endl;
+    return false;
+  }
 
-      //1.3.4
-      //Add Contour Data
-      itk::EncapsulateMetaData<string>(subItemDict, "3006|0050", CONTOUR->contourData[count-1]);
+  BatchExport_struct batch;
+  batch.options = options;
+  batch.nextJob = 0;
 
-      // Add this sub-item to Contour Sequence
-      itk::EncapsulateMetaData<DictionaryType>(contourSeq, tempString, subItemDict);
+  // One parameter file per line; empty lines and "#" comments are skipped.
+  string line;
+  while ( std::getline(manifest, line) )
+  {
+    const string::size_type first = line.find_first_not_of(" \t\r");
+    if ( first == string::npos || line[first] == '#' )
+    {
+      continue;
     }
-  
-    itk::EncapsulateMetaData<DictionaryType>(itemDict, "3006|0040", contourSeq);
-    itk::EncapsulateMetaData<DictionaryType>(roiContourSeq, tempStringHigh, itemDict);
+    const string::size_type last = line.find_last_not_of(" \t\r");
+    batch.parameterFileNames.push_back( line.substr(first, last - first + 1) );
   }
-  
-  // Add ROI Contour Sequence to Final Dictonary
-  itk::EncapsulateMetaData<DictionaryType>(dictWriter, "3006|0039", roiContourSeq);
-
-  // Clean up
-  delete CONTOUR;
-
-
-
-  //                 |--------------------------------|
-  //                 | RT ROI Observations Module (M) |
-  //                 |--------------------------------|
-  //
-  // Only the following tags of this module are written!
-  //
-  // The RT ROI Observations module specifies the identification and
-  // interpretation of an ROI specified in the Structure Set and ROI 
-  // Contour modules.
-  //
-  //
-  // We will write only those attributes listed in the following table.
-  //
-
-  // |-------|------------------------------|-------------|------|
-  // | S.No. |           Attribute Name     |    Tag      | Type |
-  // |-------|------------------------------|-------------|------|
-  // | 1     | RT ROI Observations Sequence | (3006|0080) | 1    |
-  // | 1.1   |  > Observation Number        | (3006|0082) | 1    |
-  // | 1.2   |  > Referenced ROI Number     | (3006|0084) | 1    |
-  // | 1.3   |  > RT ROI Interpreted Type   | (3006|00a4) | 2    |
-  // | 1.4   |  > ROI Interpreter           | (3006|00a6) | 2    |
-  // |-------|------------------------------|-------------|------|
-
-
-  STRUCTOutType::Pointer gdcmIORoiObservations = STRUCTOutType::New();
-  DictionaryType &roiObservationsSeq = gdcmIORoiObservations->GetMetaDataDictionary();
-
-  for (unsigned int observeItem = 1; observeItem <= parameters->numOfROIs; observeItem++)
+  if ( batch.parameterFileNames.empty() )
   {
-    // Create a temporary string for encapsulating the item:
-    tempString = ITEM_ENCAPSULATE_STRING + FixNumDigitsTo3( itos( observeItem ) );
-
-    // Create an item-dictionary for each observation
-    STRUCTOutType::Pointer gdcmIOItem = STRUCTOutType::New();
-    DictionaryType &itemDict = gdcmIOItem->GetMetaDataDictionary();
-
-    // Referenced roi number itself is used as the observation number
-
-    //1.1 Observation Number
-    itk::EncapsulateMetaData<string>(itemDict, "3006|0082", itos(observeItem));
-
-    //1.2 Referenced ROI Number
-    itk::EncapsulateMetaData<string>(itemDict, "3006|0084", itos(observeItem));
-
-    //1.3 RT ROI Interpreted Type
-    itk::EncapsulateMetaData<string>(itemDict, "3006|00a4", parameters->roiInterpretedType[observeItem-1]);
-
-    //1.4 XXX Currently an empty string is used for ROI Interpreter
-    itk::EncapsulateMetaData<string>(itemDict, "3006|00a6", "");
+    cerr << "No parameter file in the manifest: " << manifestFileName << endl;
+    return false;
+  }
 
-    //Add the it
-    itk::EncapsulateMetaData<DictionaryType>(roiObservationsSeq, tempString, itemDict);
+  const unsigned int numberOfProcessors =
+    static_cast<unsigned int>( itk::MultiThreader::GetGlobalDefaultNumberOfThreads() );
+  if ( numberOfJobs == 0 )
+  {
+    numberOfJobs = numberOfProcessors;
   }
+  numberOfJobs = std::min( numberOfJobs,
+                           static_cast<unsigned int>( batch.parameterFileNames.size() ) );
+  numberOfJobs = std::min( numberOfJobs, static_cast<unsigned int>( ITK_MAX_THREADS ) );
 
-  // Add ROI Observations Sequence to the Final Dictonary
-  itk::EncapsulateMetaData<DictionaryType>(dictWriter, "3006|0080", roiObservationsSeq);
-  //-------------------------------------------------------------------------------
+  // The processors are shared by the exports running at a time.
+  batch.options.numberOfThreads = std::max( 1u, numberOfProcessors / numberOfJobs );
 
-  WriterType::Pointer writer = WriterType::New();
+  // The exports only read and write DICOM one at a time (gdcm is not
+  // thread-safe), everything else (contour parsing, series scan, building
+  // of the sequences) running in parallel. The object factories and the
+  // gdcm dictionaries are set up here, once, rather than by the first
+  // exports at the same time.
+  RTSTRUCTExporter::Initialize();
 
-  // We now need to not only explicitly set the proper image IO (GDCMImageIO), but also
-  // we must tell the ImageFileWriter NOT to use the MetaDataDictionary from the
-  // input but from the GDCMImageIO since this is the one that contains the DICOM
-  // specific information
-  //
-  writer->UseInputMetaDataDictionaryOff ();
+  batch.succeeded.assign( batch.parameterFileNames.size(), false );
 
-  writer->SetFileName(parameters->outputFileName);
+  itk::TimeProbe probe;
+  probe.Start();
 
-  writer->SetInput(reader->GetOutput());
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads( numberOfJobs );
+  threader->SetSingleMethod( BatchExportThreadCallback, &batch );
+  threader->SingleMethodExecute();
 
-  writer->SetImageIO(gdcmIO2);
+  probe.Stop();
 
-  try
+  unsigned int failed = 0;
+  for ( unsigned int job = 0; job < batch.succeeded.size(); job++ )
   {
-      writer->Update();
-  }
-  catch (itk::ExceptionObject & excp)
-  {
-      cerr << "Exception is thrown while writing the DICOM file: " << endl;
-      cerr << excp << endl;
+    if ( ! batch.succeeded[job] )
+    {
+      failed++;
+    }
   }
-
-
-  // Clean up
-  delete parameters;
-
-  return EXIT_SUCCESS;   
+  cout << batch.parameterFileNames.size() << " structure sets, " << failed
+       << " failed, in " << probe.GetMeanTime() << " s (" << numberOfJobs
+       << " at a time)" << endl;
+  return failed == 0;
 }
 
 
-void ExitIfTagNotPresent(const string&                  entryId,
-                         DictionaryType::ConstIterator& tagItr,
-                         DictionaryType::ConstIterator& end)
+// "[" is also considered as white-space/comment and is ignored
+void SkipWhiteSpace(istream& f)
 {
-  if (IsTagPresent(tagItr, end) == false)
+  while(f && !f.eof() && (std::ws(f).peek())=='[')
   {
-    cerr << "Tag: " << entryId;
-    cerr << " not found in the DICOM header" << endl;
-    EXIT_FAILURE;
+    // XXX Gorthi Hard Coded;
+    // I am not sure how this works :(
+    f.ignore(150,'\n');
   }
 }
 
 
-bool IsTagPresent(DictionaryType::ConstIterator& tagItr,
-                  DictionaryType::ConstIterator& end)
+// Maps a contour data file into "contours", reads its number of contours
+// and appends the chunks of its contours to "chunks": "chunksPerFile"
+// chunks if the file has an index, a single one otherwise.
+// Returns false and fills "error" if the file can not be read.
+bool read_contour_data_file(const char*                  config_file,
+                            ContourObject_struct&        contours,
+                            unsigned int                 roi,
+                            unsigned int                 chunksPerFile,
+                            vector<ContourChunk_struct>& chunks,
+                            string&                      error,
+                            std::ostream&                log)
 {
-    if( tagItr == end)
+    if ( ! contours.file->Open(config_file, error) )
+    {
       return false;
-    
+    }
+
+    ContourTextTokenizer tokenizer(contours.file->GetBegin(), contours.file->GetEnd());
+
+    tokenizer.SkipHeaders();
+    bool valid = tokenizer.NextUnsigned(contours.totalContours);
+
+    // Each contour takes at least 4 tokens: a larger count can only come
+    // from a corrupted file, and must not be allocated.
+    if ( ! valid || contours.totalContours > contours.file->GetSize() / 8 + 1 )
+    {
+      error = string("Malformed contour data file: ") + config_file;
+      return false;
+    }
+
+    contours.sliceNumber.resize(contours.totalContours);
+    contours.numOfPoints.resize(contours.totalContours);
+    contours.geometryType.resize(contours.totalContours);
+    contours.contourData.resize(contours.totalContours);
+
+    ContourChunk_struct chunk;
+    chunk.roi          = roi;
+    chunk.firstContour = 0;
+    chunk.endContour   = contours.totalContours;
+    chunk.begin        = tokenizer.GetPosition();
+    chunk.end          = contours.file->GetEnd();
+
+    vector<size_t> offsets;
+    if ( chunksPerFile < 2 ||
+         ! read_contour_index(string(config_file) + ".idx", contours, offsets, log) ||
+         ( offsets.size() > 0 && contours.file->GetBegin() + offsets[0] < chunk.begin ) )
+    {
+      chunks.push_back(chunk);
+      return true;
+    }
+
+    // Small chunks are not worth a thread.
+    const unsigned int minimumContoursPerChunk = 64;
+    unsigned int numberOfChunks = contours.totalContours / minimumContoursPerChunk;
+    numberOfChunks = std::max( 1u, std::min( numberOfChunks, chunksPerFile ) );
+
+    for ( unsigned int k = 0; k < numberOfChunks; k++ )
+    {
+      chunk.firstContour = static_cast<unsigned int>(
+        static_cast<double>( contours.totalContours ) * k / numberOfChunks );
+      chunk.endContour   = static_cast<unsigned int>(
+        static_cast<double>( contours.totalContours ) * ( k + 1 ) / numberOfChunks );
+      if ( chunk.firstContour == chunk.endContour )
+      {
+        continue;
+      }
+      chunk.begin = contours.file->GetBegin() + offsets[chunk.firstContour];
+      chunk.end   = ( chunk.endContour < contours.totalContours )
+                      ? contours.file->GetBegin() + offsets[chunk.endContour]
+                      : contours.file->GetEnd();
+      chunks.push_back(chunk);
+    }
     return true;
 }
 
 
-string GetTagValue(DictionaryType::ConstIterator& tagItr)
+// The contours of one slice in the index of a contour data file
+// ("[Slice Offsets]", written by "mask2contour -index").
+typedef struct ContourIndexSlice_struct
 {
-  MetaDataStringType::ConstPointer entryValue;
-  entryValue =
-           dynamic_cast<const MetaDataStringType *>
-           ( tagItr->second.GetPointer() );
-
-  if( !entryValue )
-  {
-    cerr << "Entry was not of string type" << endl;
-    EXIT_FAILURE;
-  }
-  return entryValue->GetMetaDataObjectValue();
+  size_t       offset;         // of the first contour of the slice
+  unsigned int firstContour;   // numbered from 1
+  unsigned int numberOfContours;
+} *ContourIndexSlice_handle;
+
+
+// Reads the index of a contour data file up to its slice offsets, and
+// the offsets of its first "numberOfSlicesToRead" slices (all of them if
+// there are fewer). Returns false if the index does not match the
+// contour data file of "totalContours" contours and "dataSize" bytes, or
+// if the slices do not follow each other.
+static bool read_contour_index_slices(ContourTextTokenizer&             tokenizer,
+                                      unsigned int                      totalContours,
+                                      size_t                            dataSize,
+                                      unsigned int                      numberOfSlicesToRead,
+                                      unsigned int&                     numberOfSlices,
+                                      vector<ContourIndexSlice_struct>& slices)
+{
+    unsigned int indexContours;
+    size_t       indexDataSize;
+    TextView     header;
+
+    tokenizer.SkipHeaders();
+    bool valid = tokenizer.NextUnsigned(indexContours);
+    tokenizer.SkipHeaders();
+    valid = valid && tokenizer.NextSize(indexDataSize);
+    tokenizer.SkipHeaders();
+    valid = valid && tokenizer.NextUnsigned(numberOfSlices);
+
+    valid = valid && indexContours == totalContours && indexDataSize == dataSize;
+
+    tokenizer.SkipHeaders(header);
+    valid = valid && header.Equals("Slice Offsets");
+
+    // "offset first-contour contours" per slice: each slice starts with
+    // the contour that follows those of the previous slice.
+    const unsigned int numberOfLines = std::min( numberOfSlicesToRead, numberOfSlices );
+    unsigned int       nextContour   = 1;
+    slices.clear();
+    for ( unsigned int z = 0; valid && z < numberOfLines; z++ )
+    {
+      ContourIndexSlice_struct slice;
+      valid = tokenizer.NextSize(slice.offset) &&
+              tokenizer.NextUnsigned(slice.firstContour) &&
+              tokenizer.NextUnsigned(slice.numberOfContours) &&
+              slice.offset <= dataSize &&
+              slice.firstContour == nextContour &&
+              slice.numberOfContours <= totalContours - ( nextContour - 1 ) &&
+              ( z == 0 || slice.offset >= slices.back().offset );
+      nextContour += slice.numberOfContours;
+      slices.push_back(slice);
+    }
+    return valid;
 }
 
 
-void WriteCompulsoryTags(const vector<string>& mandatoryModule,
-                        const DictionaryType& dictReader,
-                        DictionaryType&       dictWriter)
+// Reads the offsets of the contours from the index of a contour data
+// file, and checks its slice offsets against them. Returns false if there
+// is no index, or if it does not match the contour data file (which has
+// then been written again without -index).
+bool read_contour_index(const string&               indexFileName,
+                        const ContourObject_struct& contours,
+                        vector<size_t>&             offsets,
+                        std::ostream&               log)
 {
-  string tagID;
-  string tagValue;
+    MappedTextFile indexFile;
+    string         error;
+    if ( ! indexFile.Open(indexFileName.c_str(), error) )
+    {
+      return false;
+    }
 
-  vector<string>::const_iterator stringItr;
-  DictionaryType::ConstIterator  tagItr;
-  DictionaryType::ConstIterator  end = dictReader.End();
+    ContourTextTokenizer             tokenizer(indexFile.GetBegin(), indexFile.GetEnd());
+    const size_t                     dataSize = contours.file->GetSize();
+    unsigned int                     numberOfSlices;
+    vector<ContourIndexSlice_struct> slices;
 
-  for (stringItr = mandatoryModule.begin(); stringItr != mandatoryModule.end(); stringItr++)
-  {
-    tagID  = *stringItr;
+    bool valid = read_contour_index_slices(tokenizer, contours.totalContours, dataSize,
+                                           UINT_MAX, numberOfSlices, slices);
 
-    tagItr = dictReader.Find( tagID );
-    ExitIfTagNotPresent( tagID, tagItr, end );
+    // All the contours are on the slices of the index.
+    valid = valid && ( slices.empty()
+                         ? contours.totalContours == 0
+                         : slices.back().firstContour - 1 + slices.back().numberOfContours ==
+                           contours.totalContours );
 
-    tagValue = GetTagValue( tagItr );
+    vector<unsigned int> contourSlices;
+    if ( valid )
+    {
+      offsets.resize(contours.totalContours);
+      contourSlices.resize(contours.totalContours);
+    }
 
-    itk::EncapsulateMetaData<string>(dictWriter, tagID, tagValue);
-  }
+    // "offset slice" per contour; the offsets must increase.
+    for ( unsigned int i = 0; valid && i < contours.totalContours; i++ )
+    {
+      tokenizer.SkipHeaders();
+      valid = tokenizer.NextSize(offsets[i]) && tokenizer.NextUnsigned(contourSlices[i]) &&
+              offsets[i] < dataSize && ( i == 0 || offsets[i] > offsets[i-1] );
+    }
+
+    // Each slice starts at its first contour, and holds only its own.
+    for ( unsigned int z = 0; valid && z < slices.size(); z++ )
+    {
+      const ContourIndexSlice_struct& slice = slices[z];
+      for ( unsigned int i = 0; valid && i < slice.numberOfContours; i++ )
+      {
+        const unsigned int contour = slice.firstContour - 1 + i;
+        valid = contourSlices[contour] == z &&
+                ( i > 0 || offsets[contour] == slice.offset );
+      }
+    }
+
+    if ( ! valid )
+    {
+      log << "Ignoring the index " << indexFileName
+           << ", which does not match its contour data file." << endl;
+    }
+    return valid;
 }
 
 
-void WriteOptionalTags(const vector<string>& optionalModule,
-                       const DictionaryType& dictReader,
-                       DictionaryType&       dictWriter)
+// Reads only the contours of the slice "slice" (numbered from 0, as in
+// the contour data file) into "contours", by seeking to them through the
+// index of the contour data file: the index is read up to that slice,
+// and the other contours are never parsed. For the tools that look at a
+// single slice of a large structure.
+// Returns false and fills "error" if the file or its index can not be
+// read, or if the slice is not in the index.
+bool read_contour_slice(const char*           config_file,
+                        unsigned int          slice,
+                        ContourObject_struct& contours,
+                        string&               error)
 {
-  string tagID;
-  string tagValue;
+    if ( ! contours.file->Open(config_file, error) )
+    {
+      return false;
+    }
 
-  vector<string>::const_iterator stringItr;
-  DictionaryType::ConstIterator  tagItr;
-  DictionaryType::ConstIterator  end = dictReader.End();
+    ContourTextTokenizer dataTokenizer(contours.file->GetBegin(), contours.file->GetEnd());
+    unsigned int         totalContours;
+    dataTokenizer.SkipHeaders();
+    if ( ! dataTokenizer.NextUnsigned(totalContours) )
+    {
+      error = string("Malformed contour data file: ") + config_file;
+      return false;
+    }
 
-  for (stringItr = optionalModule.begin(); stringItr != optionalModule.end(); stringItr++)
-  {
-    tagID  = *stringItr;
+    const string   indexFileName = string(config_file) + ".idx";
+    MappedTextFile indexFile;
+    if ( ! indexFile.Open(indexFileName.c_str(), error) )
+    {
+      return false;
+    }
 
-    tagItr = dictReader.Find( tagID );
+    ContourTextTokenizer             tokenizer(indexFile.GetBegin(), indexFile.GetEnd());
+    unsigned int                     numberOfSlices;
+    vector<ContourIndexSlice_struct> slices;
+    if ( ! read_contour_index_slices(tokenizer, totalContours, contours.file->GetSize(),
+                                     slice + 1, numberOfSlices, slices) )
+    {
+      error = "The index " + indexFileName + " does not match its contour data file.";
+      return false;
+    }
+    if ( slice >= numberOfSlices )
+    {
+      std::ostringstream message;
+      message << "No slice " << slice << " in the index " << indexFileName;
+      error = message.str();
+      return false;
+    }
 
-    if (IsTagPresent( tagItr, end ) )
+    contours.totalContours = slices[slice].numberOfContours;
+    contours.sliceNumber.resize(contours.totalContours);
+    contours.numOfPoints.resize(contours.totalContours);
+    contours.geometryType.resize(contours.totalContours);
+    contours.contourData.resize(contours.totalContours);
+
+    ContourChunk_struct chunk;
+    chunk.roi          = 0;
+    chunk.firstContour = 0;
+    chunk.endContour   = contours.totalContours;
+    chunk.begin        = contours.file->GetBegin() + slices[slice].offset;
+    chunk.end          = contours.file->GetEnd();
+
+    bool valid = parse_contour_chunk(contours, chunk);
+    for ( unsigned int i = 0; valid && i < contours.totalContours; i++ )
     {
-      tagValue = GetTagValue( tagItr );
-      itk::EncapsulateMetaData<string>(dictWriter, tagID, tagValue);
+      valid = contours.sliceNumber[i] == slice;
     }
-  }
+    if ( ! valid )
+    {
+      error = string("Malformed contour data file: ") + config_file;
+    }
+    return valid;
 }
 
 
-string itos(int i)	// convert int to string
+// Parses the contours of a chunk.
+// Returns false if the text of the contours is malformed.
+bool parse_contour_chunk(ContourObject_struct&      contours,
+                         const ContourChunk_struct& chunk)
 {
-  stringstream s;
-  s << i;
-  return s.str();
+    ContourTextTokenizer tokenizer(chunk.begin, chunk.end);
+    TextView             header;
+    bool                 valid = true;
+
+    for ( unsigned int i=chunk.firstContour; valid && i < chunk.endContour; i++ )
+    {
+      // Slice Number
+      tokenizer.SkipHeaders();
+      valid = tokenizer.NextUnsigned(contours.sliceNumber[i]);
+
+      // Geometry-Type
+      tokenizer.SkipHeaders();
+      valid = valid && tokenizer.NextToken(contours.geometryType[i]);
+
+      // Number of Points
+      tokenizer.SkipHeaders();
+      valid = valid && tokenizer.NextUnsigned(contours.numOfPoints[i]);
+
+      // Optional Parent Contour, written by "mask2contour -nesting".
+      // RTSTRUCT has no attribute for it (holes are given by the geometry
+      // of the contours alone), so it is only skipped.
+      tokenizer.SkipHeaders(header);
+      if ( header.Equals("Parent Contour") )
+      {
+        unsigned int parentContour;
+        valid = valid && tokenizer.NextUnsigned(parentContour);
+        tokenizer.SkipHeaders();
+      }
+
+      // Contour Data
+      valid = valid && tokenizer.NextToken(contours.contourData[i]);
+    }
+    return valid;
 }
 
 
-// Add zeros before the stringto make # of digits = 3
-// It assumes that number of digits <= 3
-string FixNumDigitsTo3( string str) 
+ITK_THREAD_RETURN_TYPE LoadContourDataFilesThreadCallback(void* arg)
 {
-  unsigned length = str.length();
-  
-  assert( length != 0 );
-  assert( length <= 3 );
+  itk::MultiThreader::ThreadInfoStruct* info =
+    static_cast<itk::MultiThreader::ThreadInfoStruct*>(arg);
+  ContourLoading_handle loading = static_cast<ContourLoading_handle>( info->UserData );
 
-  if (length == 1)
+  // Interleaved chunks, so that large and small files are mixed.
+  for ( unsigned int k = info->ThreadID; k < loading->chunks.size();
+        k += info->NumberOfThreads )
   {
-   str = "00" + str;
-  } else if (length == 2)
-  {
-    str = "0" +str;
+    const ContourChunk_struct& chunk = loading->chunks[k];
+    if ( ! parse_contour_chunk(*(*loading->contours)[chunk.roi], chunk) )
+    {
+      loading->failed[k] = true;
+    }
   }
-  return str;
+  return ITK_THREAD_RETURN_VALUE;
 }
 
 
-// "[" is also considered as white-space/comment and is ignored
-void SkipWhiteSpace(istream& f)
+// Parses the contour data files of all the ROIs with "numberOfThreads"
+// threads; "contours" gets the contours of each ROI, in the order of the
+// file names.
+// Returns false (after printing the reasons to "log") if a file can not
+// be read.
+bool LoadContourDataFiles(const vector<string>&          fileNames,
+                          unsigned int                   numberOfThreads,
+                          vector<ContourObject_struct*>& contours,
+                          std::ostream&                  log)
 {
-  while(f && !f.eof() && (std::ws(f).peek())=='[')
+  contours.assign(fileNames.size(), NULL);
+  numberOfThreads = std::max( 1u, numberOfThreads );
+
+  ContourLoading_struct loading;
+  loading.contours = &contours;
+
+  // The files are mapped and their indexes read first (which is quick),
+  // to split the parsing into chunks.
+  bool loaded = true;
+  for ( unsigned int roi = 0; roi < fileNames.size(); roi++ )
   {
-    // XXX Gorthi Hard Coded;
-    // I am not sure how this works :(
-    f.ignore(150,'\n');
-  }
-}
+    contours[roi] = new ContourObject_struct;
 
+    string error;
+    if ( ! read_contour_data_file(fileNames[roi].c_str(), *contours[roi], roi,
+                                  numberOfThreads, loading.chunks, error, log) )
+    {
+      log << error << endl;
+      loaded = false;
+    }
+  }
 
-void read_contour_data_file(char* config_file)
-{
-    ifstream f;
-    char geomBuffer[MAX_CHAR] = {'\0'};
+  if ( loaded && ! loading.chunks.empty() )
+  {
+    loading.failed.assign(loading.chunks.size(), false);
 
-    f.open(config_file);
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads( std::min( numberOfThreads,
+                                            static_cast<unsigned int>( loading.chunks.size() ) ) );
+    threader->SetSingleMethod(LoadContourDataFilesThreadCallback, &loading);
+    threader->SingleMethodExecute();
 
-    if (f)
+    for ( unsigned int k = 0; k < loading.chunks.size(); k++ )
     {
-      SkipWhiteSpace(f);            
-     f >> CONTOUR->totalContours;
-
-     for ( unsigned int i=0; i < CONTOUR->totalContours; i++ )
-     {
-       // Slice Number
-       SkipWhiteSpace(f);
-       f >> CONTOUR->sliceNumber[i];
-
-       // Geometry-Type
-       SkipWhiteSpace(f);
-       if( (CONTOUR->geometryType[i] = new char[MAX_CHAR]) == NULL ) exit(1);
-       f >> geomBuffer;
-       strcpy(CONTOUR->geometryType[i], geomBuffer);
-
-       // Number of Points
-       SkipWhiteSpace(f);
-       f >> CONTOUR->numOfPoints[i];
-
-       // Contour Data
-       SkipWhiteSpace(f);
-
-       // 3 coordinates: (x,y,z) for each point are to be stored.
-       // "\\" is inserted in between the cooordinates => 4 additional bytes
-       // are required for each point. 
-       // 6 more bytes are used for accomidating the digits
-       // before the decimal point. =>
-       // In addition to precision bytes, (6+4=) 10 additional bytes are used. 
-       //
-       unsigned int numOfBytes = (PRECISION+10) * 3 * CONTOUR->numOfPoints[i];
-       char* contourData = new char[numOfBytes];
-
-       f >> contourData;
-       if( (CONTOUR->contourData[i] = new char[numOfBytes]) == NULL ) exit(1);
-       strcpy(CONTOUR->contourData[i], contourData);
-
-       delete [] contourData;
-     }
-     f.close();
-    }else
+      if ( loading.failed[k] )
+      {
+        log << "Malformed contour data file: "
+            << fileNames[ loading.chunks[k].roi ] << endl;
+        loaded = false;
+      }
+    }
+  }
+
+  if ( ! loaded )
+  {
+    for ( unsigned int roi = 0; roi < contours.size(); roi++ )
     {
-      cerr << "No contour data file specified...quitting.\n";
-      exit(1);
+      delete contours[roi];
     }
+    contours.clear();
+  }
+  return loaded;
 }
 
 
-void readInputParameters( const char* parameterFileName)
+bool readInputParameters(const char*             parameterFileName,
+                         InputParameters_struct& parameters,
+                         std::ostream&           log)
 {
-    char* nameBuffer = new char[MAX_CHAR];
-
     ifstream f;
     f.open(parameterFileName);
 
@@ -998,87 +904,76 @@ void readInputParameters( const char* parameterFileName)
     {
       // Input DICOM Image Slice Name with Complete Path
       SkipWhiteSpace(f);
-      if ( (parameters->inputDCMFileName = new char[MAX_CHAR]) == NULL )
-        exit(1);
-      f >> nameBuffer;
-      strcpy(parameters->inputDCMFileName, nameBuffer);
+      f >> parameters.inputDCMFileName;
 
       // Output RTSTRUCT File Name
       SkipWhiteSpace(f);
-      if ( (parameters->outputFileName = new char[MAX_CHAR]) == NULL )
-        exit(1);
-      f >> nameBuffer;
-      strcpy(parameters->outputFileName, nameBuffer);
+      f >> parameters.outputFileName;
 
       // Number of Image Slices in the Segmented Image
       SkipWhiteSpace(f);
-      f >> parameters->NumSlicesInRTSTRUCT;
+      f >> parameters.NumSlicesInRTSTRUCT;
 
       // Starting Slice Number for the Segmented with respect to original DICOM file
       SkipWhiteSpace(f);
-      f >> parameters->START_SLICE_NUM;
+      f >> parameters.START_SLICE_NUM;
 
       // Common SOP Instance UID Prefix for the DICOM Series
       SkipWhiteSpace(f);
-      if ( (parameters->prefixSOPInstUID = new char[MAX_CHAR]) == NULL )
-        exit(1);
-      f >> nameBuffer;
-      strcpy(parameters->prefixSOPInstUID, nameBuffer);
+      f >> parameters.prefixSOPInstUID;
 
       // Number of ROIs to be written to RTSTRUCT
       SkipWhiteSpace(f);
-      f >> parameters->numOfROIs;
+      f >> parameters.numOfROIs;
+
+      if ( ! f )
+      {
+        log << "Malformed parameter file: " << parameterFileName << endl;
+        return false;
+      }
+
+      parameters.contourDataFileName.resize(parameters.numOfROIs);
+      parameters.roiName.resize(parameters.numOfROIs);
+      parameters.roiInterpretedType.resize(parameters.numOfROIs);
+      parameters.roiColor.resize(parameters.numOfROIs);
 
       // Names of the text files containing Contour Data
-      for (unsigned int num = 0; num < parameters->numOfROIs; num++)
+      for (unsigned int num = 0; num < parameters.numOfROIs; num++)
       {
         SkipWhiteSpace(f);
-        if ((parameters->contourDataFileName[num] = new char[MAX_CHAR]) == NULL )
-          exit(1);
-        f >> nameBuffer;
-        strcpy(parameters->contourDataFileName[num], nameBuffer);
+        f >> parameters.contourDataFileName[num];
       }
 
       // Names to be assigned to the ROIs
-      for (unsigned int num = 0; num < parameters->numOfROIs; num++)
+      for (unsigned int num = 0; num < parameters.numOfROIs; num++)
       {
         SkipWhiteSpace(f);
-        if ((parameters->roiName[num] = new char[MAX_CHAR]) == NULL )
-          exit(1);
 
         // Since there can be spaces in the name, getline() is used instead of <<
-        f.getline(parameters->roiName[num], MAX_CHAR);
+        std::getline(f, parameters.roiName[num]);
       }
 
 
       // ROI Interpretted Types for Each ROI
-      for (unsigned int num = 0; num < parameters->numOfROIs; num++)
+      for (unsigned int num = 0; num < parameters.numOfROIs; num++)
       {
         SkipWhiteSpace(f);
-        if ((parameters->roiInterpretedType[num] = new char[MAX_CHAR]) == NULL )
-          exit(1);
-        f >> nameBuffer;
-        strcpy(parameters->roiInterpretedType[num], nameBuffer);
+        f >> parameters.roiInterpretedType[num];
       }
 
 
       // Colors to be Assigned for each ROI
-      for (unsigned int num = 0; num < parameters->numOfROIs; num++)
+      for (unsigned int num = 0; num < parameters.numOfROIs; num++)
       {
         SkipWhiteSpace(f);
-        if ((parameters->roiColor[num] = new char[MAX_CHAR]) == NULL )
-          exit(1);
-        f >> nameBuffer;
-        strcpy(parameters->roiColor[num], nameBuffer);
+        f >> parameters.roiColor[num];
       }
 
-      // Clean up
-      delete [] nameBuffer;
-
       f.close();
     } else {
-      cerr << "No Input Parameter file specified...quitting.\n";
-      exit(1);
+      log << "Unable to open the parameter file: " << parameterFileName << endl;
+      return false;
     }
+    return true;
 }
 /************************************************************************/
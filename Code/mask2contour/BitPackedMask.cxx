@@ -0,0 +1,260 @@
+#include "BitPackedMask.h"
+
+
+BitPackedMask::BitPackedMask()
+  : m_SizeX(0), m_SizeY(0), m_SizeZ(0),
+    m_WordsPerRow(0), m_WordsPerSlice(0)
+{
+}
+
+
+void BitPackedMask::Allocate(unsigned int sizeX,
+                             unsigned int sizeY,
+                             unsigned int sizeZ)
+{
+  m_SizeX = sizeX;
+  m_SizeY = sizeY;
+  m_SizeZ = sizeZ;
+
+  m_WordsPerRow   = ( sizeX + BitsPerWord - 1 ) / BitsPerWord;
+  m_WordsPerSlice = static_cast<unsigned long>( m_WordsPerRow ) * sizeY;
+
+  // The swap releases any previously allocated memory.
+  std::vector<WordType> words( m_WordsPerSlice * sizeZ, 0 );
+  m_Words.swap( words );
+}
+
+
+void BitPackedMask::PackSlice(unsigned int         z,
+                              const unsigned char* pixels,
+                              unsigned char        threshold)
+{
+  WordType* row = this->GetSliceWords(z);
+
+  for ( unsigned int y = 0; y < m_SizeY; y++ )
+  {
+    const unsigned char* pixelRow = pixels + static_cast<unsigned long>(y) * m_SizeX;
+
+    for ( unsigned int w = 0; w < m_WordsPerRow; w++ )
+    {
+      const unsigned int xBegin = w * BitsPerWord;
+      unsigned int xEnd = xBegin + BitsPerWord;
+      if ( xEnd > m_SizeX )
+      {
+        xEnd = m_SizeX;
+      }
+
+      WordType word = 0;
+      for ( unsigned int x = xBegin; x < xEnd; x++ )
+      {
+        if ( pixelRow[x] > threshold )
+        {
+          word |= WordType(1) << ( x - xBegin );
+        }
+      }
+      row[w] = word;
+    }
+    row += m_WordsPerRow;
+  }
+}
+
+
+bool BitPackedMask::IsSliceEmpty(const WordType* sliceWords) const
+{
+  // OR-reduce the whole slice; no need to count anything.
+  WordType any = 0;
+  for ( unsigned long i = 0; i < m_WordsPerSlice; i++ )
+  {
+    any |= sliceWords[i];
+  }
+  return any == 0;
+}
+
+
+void BitPackedMask::ComputeSliceStatistics(const WordType*  sliceWords,
+                                           SliceStatistics& stats) const
+{
+  stats.numberOfVoxels = 0;
+  stats.xMin = m_SizeX;
+  stats.xMax = 0;
+  stats.yMin = m_SizeY;
+  stats.yMax = 0;
+
+  const WordType* row = sliceWords;
+
+  for ( unsigned int y = 0; y < m_SizeY; y++, row += m_WordsPerRow )
+  {
+    unsigned long rowCount = 0;
+    unsigned int  firstWord = m_WordsPerRow;
+    unsigned int  lastWord  = 0;
+
+    for ( unsigned int w = 0; w < m_WordsPerRow; w++ )
+    {
+      if ( row[w] != 0 )
+      {
+        rowCount += PopCount( row[w] );
+        if ( firstWord == m_WordsPerRow )
+        {
+          firstWord = w;
+        }
+        lastWord = w;
+      }
+    }
+
+    if ( rowCount == 0 )
+    {
+      continue;
+    }
+
+    stats.numberOfVoxels += rowCount;
+
+    if ( y < stats.yMin )
+    {
+      stats.yMin = y;
+    }
+    stats.yMax = y;
+
+    const unsigned int rowXMin =
+      firstWord * BitsPerWord + CountTrailingZeros( row[firstWord] );
+    const unsigned int rowXMax =
+      lastWord * BitsPerWord + ( BitsPerWord - 1 ) - CountLeadingZeros( row[lastWord] );
+
+    if ( rowXMin < stats.xMin )
+    {
+      stats.xMin = rowXMin;
+    }
+    if ( rowXMax > stats.xMax )
+    {
+      stats.xMax = rowXMax;
+    }
+  }
+}
+
+
+void BitPackedMask::UnpackSliceRegion(const WordType* sliceWords,
+                                      unsigned int x0, unsigned int y0,
+                                      unsigned int x1, unsigned int y1,
+                                      unsigned char* pixels,
+                                      unsigned long  pixelsPerRow,
+                                      unsigned char  onValue,
+                                      unsigned char  offValue) const
+{
+  for ( unsigned int y = y0; y <= y1; y++ )
+  {
+    const WordType* row      = sliceWords + static_cast<unsigned long>(y) * m_WordsPerRow;
+    unsigned char*  pixelRow = pixels + static_cast<unsigned long>(y) * pixelsPerRow;
+
+    unsigned int x = x0;
+    while ( x <= x1 )
+    {
+      const unsigned int w     = x / BitsPerWord;
+      const WordType     word  = row[w];
+      unsigned int       xEnd  = ( w + 1 ) * BitsPerWord - 1;
+      if ( xEnd > x1 )
+      {
+        xEnd = x1;
+      }
+
+      if ( word == 0 )
+      {
+        // Whole word is background.
+        for ( ; x <= xEnd; x++ )
+        {
+          pixelRow[x] = offValue;
+        }
+      } else
+      {
+        for ( ; x <= xEnd; x++ )
+        {
+          pixelRow[x] = ( ( word >> ( x % BitsPerWord ) ) & 1 ) ? onValue : offValue;
+        }
+      }
+    }
+  }
+}
+
+
+void BitPackedMask::SetRowRun(WordType* sliceWords, unsigned int y,
+                              unsigned int x0, unsigned int x1) const
+{
+  WordType* row = sliceWords + static_cast<unsigned long>(y) * m_WordsPerRow;
+
+  const unsigned int firstWord = x0 / BitsPerWord;
+  const unsigned int lastWord  = x1 / BitsPerWord;
+
+  for ( unsigned int w = firstWord; w <= lastWord; w++ )
+  {
+    // Bits [lo,hi] of this word belong to the run.
+    const unsigned int lo = ( w == firstWord ) ? x0 % BitsPerWord : 0;
+    const unsigned int hi = ( w == lastWord )  ? x1 % BitsPerWord : BitsPerWord - 1;
+
+    WordType bits = ~WordType(0) << lo;
+    if ( hi < BitsPerWord - 1 )
+    {
+      bits &= ( WordType(1) << ( hi + 1 ) ) - 1;
+    }
+    row[w] |= bits;
+  }
+}
+
+
+void BitPackedMask::ClearRowWords(WordType* sliceWords, unsigned int y,
+                                  unsigned int x0, unsigned int x1) const
+{
+  WordType* row = sliceWords + static_cast<unsigned long>(y) * m_WordsPerRow;
+
+  for ( unsigned int w = x0 / BitsPerWord; w <= x1 / BitsPerWord; w++ )
+  {
+    row[w] = 0;
+  }
+}
+
+
+unsigned int BitPackedMask::FindNextSetVoxel(const WordType* row,
+                                             unsigned int    x) const
+{
+  if ( x >= m_SizeX )
+  {
+    return m_SizeX;
+  }
+
+  unsigned int w    = x / BitsPerWord;
+  WordType     word = row[w] & ( ~WordType(0) << ( x % BitsPerWord ) );
+
+  while ( word == 0 )
+  {
+    if ( ++w == m_WordsPerRow )
+    {
+      return m_SizeX;
+    }
+    word = row[w];
+  }
+  return w * BitsPerWord + CountTrailingZeros(word);
+}
+
+
+unsigned int BitPackedMask::FindNextClearVoxel(const WordType* row,
+                                               unsigned int    x) const
+{
+  if ( x >= m_SizeX )
+  {
+    return m_SizeX;
+  }
+
+  unsigned int w    = x / BitsPerWord;
+  WordType     word = ~row[w] & ( ~WordType(0) << ( x % BitsPerWord ) );
+
+  while ( word == 0 )
+  {
+    if ( ++w == m_WordsPerRow )
+    {
+      return m_SizeX;
+    }
+    word = ~row[w];
+  }
+
+  // The padding bits of the last word are clear, so the result may be
+  // beyond the row: clamp it.
+  const unsigned int result = w * BitsPerWord + CountTrailingZeros(word);
+  return ( result < m_SizeX ) ? result : m_SizeX;
+}
@@ -0,0 +1,150 @@
+#ifndef __BitPackedMask_h
+#define __BitPackedMask_h
+
+#include <vector>
+
+// -------------------------------------------------------------
+// BitPackedMask: a binary 3D mask stored with one bit per voxel.
+//
+// Every row of a slice starts on a word boundary, so that a slice is
+// "GetWordsPerSlice()" consecutive words and a row is "GetWordsPerRow()"
+// consecutive words. The bits of the last word of a row beyond the
+// x-size are always kept at zero; all the word-wide operations below
+// (popcount, bit-scan, boolean algebra) rely on that.
+//
+// Bit "x % 64" of word "x / 64" of a row holds the voxel at column x.
+// -------------------------------------------------------------
+class BitPackedMask
+{
+public:
+  typedef unsigned long long WordType;
+
+  static const unsigned int BitsPerWord = 64;
+
+  // Statistics of one slice, computed only with popcount and bit-scan
+  // operations on the packed words.
+  struct SliceStatistics
+  {
+    unsigned long numberOfVoxels;
+
+    // Bounding box of the foreground voxels (inclusive).
+    // Only meaningful when numberOfVoxels != 0.
+    unsigned int xMin;
+    unsigned int xMax;
+    unsigned int yMin;
+    unsigned int yMax;
+
+    bool IsEmpty() const { return numberOfVoxels == 0; }
+  };
+
+  BitPackedMask();
+
+  // Allocates a zero-filled mask of the given size.
+  void Allocate(unsigned int sizeX, unsigned int sizeY, unsigned int sizeZ);
+
+  unsigned int  GetSizeX() const { return m_SizeX; }
+  unsigned int  GetSizeY() const { return m_SizeY; }
+  unsigned int  GetSizeZ() const { return m_SizeZ; }
+  unsigned int  GetWordsPerRow() const { return m_WordsPerRow; }
+  unsigned long GetWordsPerSlice() const { return m_WordsPerSlice; }
+
+  // Memory actually used by the packed voxels, in bytes.
+  unsigned long GetBufferSizeInBytes() const
+    { return m_Words.size() * sizeof(WordType); }
+
+  // 0 for an empty mask.
+  WordType*       GetSliceWords(unsigned int z)
+    { return m_Words.empty() ? 0 : &m_Words[0] + z * m_WordsPerSlice; }
+  const WordType* GetSliceWords(unsigned int z) const
+    { return m_Words.empty() ? 0 : &m_Words[0] + z * m_WordsPerSlice; }
+
+  // Packs one slice of "sizeX * sizeY" bytes (x running fastest).
+  // A voxel is set when its value is strictly above "threshold".
+  void PackSlice(unsigned int z, const unsigned char* pixels,
+                 unsigned char threshold);
+
+  // The following functions work on any slice laid out like the slices of
+  // this mask (i.e. a slice of this mask, of a mask of the same x/y size, or
+  // a scratch buffer of "GetWordsPerSlice()" words).
+
+  bool IsSliceEmpty(const WordType* sliceWords) const;
+
+  void ComputeSliceStatistics(const WordType*  sliceWords,
+                              SliceStatistics& stats) const;
+
+  // Writes "onValue"/"offValue" bytes for the voxels of the region
+  // [x0,x1] x [y0,y1] (inclusive) into "pixels", whose rows are
+  // "pixelsPerRow" bytes apart and whose origin is voxel (0,0).
+  void UnpackSliceRegion(const WordType* sliceWords,
+                         unsigned int x0, unsigned int y0,
+                         unsigned int x1, unsigned int y1,
+                         unsigned char* pixels, unsigned long pixelsPerRow,
+                         unsigned char onValue, unsigned char offValue) const;
+
+  // Sets the voxels [x0,x1] (inclusive) of row "y" of a slice.
+  void SetRowRun(WordType* sliceWords, unsigned int y,
+                 unsigned int x0, unsigned int x1) const;
+
+  // Clears the words of row "y" that hold the voxels [x0,x1].
+  void ClearRowWords(WordType* sliceWords, unsigned int y,
+                     unsigned int x0, unsigned int x1) const;
+
+  // Returns the first column >= x whose voxel is set (resp. not set) in
+  // "row", or GetSizeX() if there is none.
+  unsigned int FindNextSetVoxel(const WordType* row, unsigned int x) const;
+  unsigned int FindNextClearVoxel(const WordType* row, unsigned int x) const;
+
+  // Word-wide helpers.
+  static unsigned int PopCount(WordType w);
+  static unsigned int CountTrailingZeros(WordType w); // w must not be 0
+  static unsigned int CountLeadingZeros(WordType w);  // w must not be 0
+
+private:
+  unsigned int  m_SizeX;
+  unsigned int  m_SizeY;
+  unsigned int  m_SizeZ;
+  unsigned int  m_WordsPerRow;
+  unsigned long m_WordsPerSlice;
+
+  std::vector<WordType> m_Words;
+};
+
+
+inline unsigned int BitPackedMask::PopCount(WordType w)
+{
+#if defined(__GNUC__)
+  return static_cast<unsigned int>( __builtin_popcountll(w) );
+#else
+  // SWAR population count.
+  w = w - ((w >> 1) & 0x5555555555555555ULL);
+  w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+  w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return static_cast<unsigned int>( (w * 0x0101010101010101ULL) >> 56 );
+#endif
+}
+
+
+inline unsigned int BitPackedMask::CountTrailingZeros(WordType w)
+{
+#if defined(__GNUC__)
+  return static_cast<unsigned int>( __builtin_ctzll(w) );
+#else
+  // Isolate the lowest set bit and count the bits below it.
+  return PopCount( (w & (~w + 1)) - 1 );
+#endif
+}
+
+
+inline unsigned int BitPackedMask::CountLeadingZeros(WordType w)
+{
+#if defined(__GNUC__)
+  return static_cast<unsigned int>( __builtin_clzll(w) );
+#else
+  // Smear the highest set bit downwards and count the bits above it.
+  w |= w >> 1;  w |= w >> 2;  w |= w >> 4;
+  w |= w >> 8;  w |= w >> 16; w |= w >> 32;
+  return BitsPerWord - PopCount(w);
+#endif
+}
+
+#endif // __BitPackedMask_h
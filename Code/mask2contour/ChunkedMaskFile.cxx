@@ -0,0 +1,532 @@
+#include "ChunkedMaskFile.h"
+
+#include "itk_zlib.h"
+
+#include <cstring>
+
+namespace
+{
+
+const char         Magic[9]   = "M2CZ0001";
+const unsigned int HeaderSize = 8 + 4 * 4 + 3 * 8;
+
+typedef BitPackedMask::WordType WordType;
+
+// Little-endian encoding of the numbers of the file.
+void PutUInt64(unsigned char* bytes, unsigned long long value)
+{
+  for ( unsigned int i = 0; i < 8; i++ )
+  {
+    bytes[i] = static_cast<unsigned char>( value >> ( 8 * i ) );
+  }
+}
+
+unsigned long long GetUInt64(const unsigned char* bytes)
+{
+  unsigned long long value = 0;
+  for ( unsigned int i = 0; i < 8; i++ )
+  {
+    value |= static_cast<unsigned long long>( bytes[i] ) << ( 8 * i );
+  }
+  return value;
+}
+
+void PutUInt32(unsigned char* bytes, unsigned int value)
+{
+  for ( unsigned int i = 0; i < 4; i++ )
+  {
+    bytes[i] = static_cast<unsigned char>( value >> ( 8 * i ) );
+  }
+}
+
+unsigned int GetUInt32(const unsigned char* bytes)
+{
+  unsigned int value = 0;
+  for ( unsigned int i = 0; i < 4; i++ )
+  {
+    value |= static_cast<unsigned int>( bytes[i] ) << ( 8 * i );
+  }
+  return value;
+}
+
+void PutFloat64(unsigned char* bytes, double value)
+{
+  unsigned long long bits;
+  memcpy(&bits, &value, sizeof(bits));
+  PutUInt64(bytes, bits);
+}
+
+double GetFloat64(const unsigned char* bytes)
+{
+  const unsigned long long bits = GetUInt64(bytes);
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+
+// Compression of the slabs, shared by the writing threads.
+struct SlabCompression
+{
+  const BitPackedMask*                      mask;
+  unsigned int                              slabDepth;
+  unsigned int                              numberOfSlabs;
+  std::vector< std::vector<unsigned char> > streams;
+  std::vector<char>                         failed;  // not vector<bool>, whose
+                                                     // flags share words
+};
+
+ITK_THREAD_RETURN_TYPE CompressSlabsThreadCallback(void* arg)
+{
+  itk::MultiThreader::ThreadInfoStruct* info =
+    static_cast<itk::MultiThreader::ThreadInfoStruct*>(arg);
+  SlabCompression* data = static_cast<SlabCompression*>( info->UserData );
+
+  const BitPackedMask& mask = *data->mask;
+  std::vector<unsigned char> bytes;
+
+  // Interleaved slabs, each thread writing only its own streams.
+  for ( unsigned int k = info->ThreadID; k < data->numberOfSlabs;
+        k += info->NumberOfThreads )
+  {
+    const unsigned int zBegin = k * data->slabDepth;
+    unsigned int       depth  = data->slabDepth;
+    if ( zBegin + depth > mask.GetSizeZ() )
+    {
+      depth = mask.GetSizeZ() - zBegin;
+    }
+
+    const unsigned long numberOfWords = depth * mask.GetWordsPerSlice();
+    const WordType*     words         = mask.GetSliceWords(zBegin);
+
+    bytes.resize( numberOfWords * 8 );
+    for ( unsigned long i = 0; i < numberOfWords; i++ )
+    {
+      PutUInt64( &bytes[8 * i], words[i] );
+    }
+
+    uLongf streamSize = compressBound( bytes.size() );
+    std::vector<unsigned char>& stream = data->streams[k];
+    stream.resize( streamSize );
+
+    if ( compress2( &stream[0], &streamSize, &bytes[0], bytes.size(),
+                    Z_DEFAULT_COMPRESSION ) != Z_OK )
+    {
+      data->failed[k] = true;
+      continue;
+    }
+    stream.resize( streamSize );
+  }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+} // end anonymous namespace
+
+
+bool ChunkedMaskFile::IsChunkedMaskFileName(const std::string& fileName)
+{
+  const std::string extension = ".m2cz";
+  return fileName.length() > extension.length() &&
+         fileName.compare( fileName.length() - extension.length(),
+                           extension.length(), extension ) == 0;
+}
+
+
+bool ChunkedMaskFile::Write(const std::string&   fileName,
+                            const BitPackedMask& mask,
+                            const double         spacing[3],
+                            unsigned int         slabDepth,
+                            unsigned int         numberOfThreads,
+                            std::string&         error)
+{
+  if ( slabDepth == 0 )
+  {
+    slabDepth = 1;
+  }
+
+  SlabCompression data;
+  data.mask          = &mask;
+  data.slabDepth     = slabDepth;
+  data.numberOfSlabs = ( mask.GetSizeZ() + slabDepth - 1 ) / slabDepth;
+  data.streams.resize( data.numberOfSlabs );
+  data.failed.resize( data.numberOfSlabs, false );
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads( std::max( 1u, std::min( numberOfThreads, data.numberOfSlabs ) ) );
+  threader->SetSingleMethod( CompressSlabsThreadCallback, &data );
+  threader->SingleMethodExecute();
+
+  for ( unsigned int k = 0; k < data.numberOfSlabs; k++ )
+  {
+    if ( data.failed[k] )
+    {
+      error = "Unable to compress the mask for " + fileName;
+      return false;
+    }
+  }
+
+  // Header and offset table.
+  std::vector<unsigned char> header( HeaderSize + 8 * ( data.numberOfSlabs + 1 ) );
+  memcpy( &header[0], Magic, 8 );
+  PutUInt32( &header[8],  mask.GetSizeX() );
+  PutUInt32( &header[12], mask.GetSizeY() );
+  PutUInt32( &header[16], mask.GetSizeZ() );
+  PutUInt32( &header[20], slabDepth );
+  for ( unsigned int i = 0; i < 3; i++ )
+  {
+    PutFloat64( &header[24 + 8 * i], spacing[i] );
+  }
+
+  unsigned long long offset = header.size();
+  for ( unsigned int k = 0; k <= data.numberOfSlabs; k++ )
+  {
+    PutUInt64( &header[HeaderSize + 8 * k], offset );
+    if ( k < data.numberOfSlabs )
+    {
+      offset += data.streams[k].size();
+    }
+  }
+
+  std::ofstream file( fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+  if ( ! file.is_open() )
+  {
+    error = "Unable to open the file:  " + fileName;
+    return false;
+  }
+
+  file.write( reinterpret_cast<const char*>( &header[0] ), header.size() );
+  for ( unsigned int k = 0; k < data.numberOfSlabs; k++ )
+  {
+    file.write( reinterpret_cast<const char*>( &data.streams[k][0] ), data.streams[k].size() );
+  }
+
+  if ( ! file )
+  {
+    error = "Unable to write the file:  " + fileName;
+    return false;
+  }
+  return true;
+}
+
+
+ChunkedMaskReader::ChunkedMaskReader()
+  : m_SizeZ(0), m_SlabDepth(1), m_NumberOfThreads(1),
+    m_Target(0), m_NextSlab(0), m_CurrentSlab(0), m_SlabsAhead(0), m_Stop(false)
+{
+  m_Spacing[0] = m_Spacing[1] = m_Spacing[2] = 1.0;
+}
+
+
+ChunkedMaskReader::~ChunkedMaskReader()
+{
+  this->StopThreads();
+}
+
+
+bool ChunkedMaskReader::Open(const std::string& fileName, std::string& error)
+{
+  m_FileName = fileName;
+
+  std::ifstream file( fileName.c_str(), std::ios::in | std::ios::binary );
+  if ( ! file.is_open() )
+  {
+    error = "Unable to open the file:  " + fileName;
+    return false;
+  }
+
+  unsigned char header[HeaderSize];
+  if ( ! file.read( reinterpret_cast<char*>(header), HeaderSize ) ||
+       memcmp( header, Magic, 8 ) != 0 )
+  {
+    error = "Not a chunked mask file:  " + fileName;
+    return false;
+  }
+
+  const unsigned int sizeX = GetUInt32( &header[8] );
+  const unsigned int sizeY = GetUInt32( &header[12] );
+  m_SizeZ                  = GetUInt32( &header[16] );
+  m_SlabDepth              = GetUInt32( &header[20] );
+  for ( unsigned int i = 0; i < 3; i++ )
+  {
+    m_Spacing[i] = GetFloat64( &header[24 + 8 * i] );
+  }
+
+  if ( m_SlabDepth == 0 )
+  {
+    error = "Invalid slab depth in the chunked mask file:  " + fileName;
+    return false;
+  }
+
+  const unsigned int numberOfSlabs = ( m_SizeZ + m_SlabDepth - 1 ) / m_SlabDepth;
+
+  std::vector<unsigned char> table( 8 * ( numberOfSlabs + 1 ) );
+  if ( ! file.read( reinterpret_cast<char*>( &table[0] ), table.size() ) )
+  {
+    error = "Truncated chunked mask file:  " + fileName;
+    return false;
+  }
+  m_Offsets.resize( numberOfSlabs + 1 );
+  for ( unsigned int k = 0; k <= numberOfSlabs; k++ )
+  {
+    m_Offsets[k] = GetUInt64( &table[8 * k] );
+    if ( k > 0 && m_Offsets[k] < m_Offsets[k - 1] )
+    {
+      error = "Invalid offset table in the chunked mask file:  " + fileName;
+      return false;
+    }
+  }
+
+  m_Layout.Allocate( sizeX, sizeY, 0 );
+  return true;
+}
+
+
+unsigned int ChunkedMaskReader::GetSlabDepth(unsigned int k) const
+{
+  const unsigned int zBegin = k * m_SlabDepth;
+  return ( zBegin + m_SlabDepth > m_SizeZ ) ? m_SizeZ - zBegin : m_SlabDepth;
+}
+
+
+bool ChunkedMaskReader::InflateSlab(std::ifstream& file,
+                                    unsigned int   k,
+                                    WordType*      words,
+                                    std::string&   error) const
+{
+  std::vector<unsigned char> stream( m_Offsets[k + 1] - m_Offsets[k] );
+
+  file.clear();
+  file.seekg( static_cast<std::streamoff>( m_Offsets[k] ) );
+  if ( stream.empty() ||
+       ! file.read( reinterpret_cast<char*>( &stream[0] ), stream.size() ) )
+  {
+    error = "Truncated chunked mask file:  " + m_FileName;
+    return false;
+  }
+
+  const unsigned long numberOfWords = this->GetSlabDepth(k) * m_Layout.GetWordsPerSlice();
+
+  std::vector<unsigned char> bytes( numberOfWords * 8 );
+  uLongf size = bytes.size();
+  if ( uncompress( &bytes[0], &size, &stream[0], stream.size() ) != Z_OK ||
+       size != bytes.size() )
+  {
+    error = "Corrupted slab in the chunked mask file:  " + m_FileName;
+    return false;
+  }
+
+  for ( unsigned long i = 0; i < numberOfWords; i++ )
+  {
+    words[i] = GetUInt64( &bytes[8 * i] );
+  }
+  return true;
+}
+
+
+const ChunkedMaskReader::WordType* ChunkedMaskReader::GetSliceWords(unsigned int z)
+{
+  const unsigned int k = z / m_SlabDepth;
+
+  if ( m_ThreadIds.empty() )
+  {
+    m_Target      = 0;
+    m_CurrentSlab = k;
+    m_NextSlab    = k;
+    this->StartThreads();
+  }
+
+  m_Mutex.Lock();
+
+  if ( k != m_CurrentSlab )
+  {
+    if ( k < m_CurrentSlab )
+    {
+      m_Mutex.Unlock();
+      throw itk::ExceptionObject( __FILE__, __LINE__,
+                                  "The slices of a chunked mask must be read in increasing z.",
+                                  "ChunkedMaskReader::GetSliceWords" );
+    }
+
+    // Release the slabs the caller is done with, and let the threads
+    // move forward.
+    for ( unsigned int j = m_CurrentSlab; j < k; j++ )
+    {
+      if ( m_SlabReady[j] )
+      {
+        m_Slabs[j].Allocate(0, 0, 0);
+      }
+    }
+    m_CurrentSlab = k;
+    m_Condition->Broadcast();
+  }
+
+  while ( ! m_SlabReady[k] && m_Error.empty() )
+  {
+    m_Condition->Wait( &m_Mutex );
+  }
+  const std::string error = m_Error;
+
+  m_Mutex.Unlock();
+
+  if ( ! error.empty() )
+  {
+    throw itk::ExceptionObject( __FILE__, __LINE__, error.c_str(),
+                                "ChunkedMaskReader::GetSliceWords" );
+  }
+  return m_Slabs[k].GetSliceWords( z - k * m_SlabDepth );
+}
+
+
+void ChunkedMaskReader::ReadAll(BitPackedMask& mask)
+{
+  this->StopThreads();
+
+  mask.Allocate( m_Layout.GetSizeX(), m_Layout.GetSizeY(), m_SizeZ );
+
+  m_Target   = &mask;
+  m_NextSlab = 0;
+  m_Stop     = false;
+  m_Error    = "";
+  m_SlabReady.assign( m_Offsets.size() - 1, false );
+
+  // The calling thread inflates too: all the threads run InflateLoop()
+  // until there is no slab left.
+  if ( ! m_Condition )
+  {
+    m_Condition = itk::ConditionVariable::New();
+  }
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads( std::max( 1u, m_NumberOfThreads ) );
+  threader->SetSingleMethod( ChunkedMaskReader::InflateThreadCallback, this );
+  threader->SingleMethodExecute();
+
+  m_Target = 0;
+
+  if ( ! m_Error.empty() )
+  {
+    throw itk::ExceptionObject( __FILE__, __LINE__, m_Error.c_str(),
+                                "ChunkedMaskReader::ReadAll" );
+  }
+}
+
+
+void ChunkedMaskReader::StartThreads()
+{
+  const unsigned int numberOfSlabs = m_Offsets.size() - 1;
+  // ITK spawns ITK_MAX_THREADS threads at most.
+  const unsigned int numberOfThreads =
+    std::min( std::max( 1u, m_NumberOfThreads ), static_cast<unsigned int>( ITK_MAX_THREADS ) );
+
+  m_Slabs.clear();
+  m_Slabs.resize( numberOfSlabs );
+  m_SlabReady.assign( numberOfSlabs, false );
+
+  // Enough slabs in advance to keep every thread busy.
+  m_SlabsAhead = 2 * numberOfThreads;
+  m_Stop       = false;
+  m_Error      = "";
+
+  m_Condition = itk::ConditionVariable::New();
+  m_Threader  = itk::MultiThreader::New();
+  for ( unsigned int t = 0; t < numberOfThreads; t++ )
+  {
+    const int threadId =
+      m_Threader->SpawnThread( ChunkedMaskReader::InflateThreadCallback, this );
+    if ( threadId >= 0 )
+    {
+      m_ThreadIds.push_back( threadId );
+    }
+  }
+  if ( m_ThreadIds.empty() )
+  {
+    throw itk::ExceptionObject( __FILE__, __LINE__,
+                                "Unable to start the threads inflating the slabs.",
+                                "ChunkedMaskReader::StartThreads" );
+  }
+}
+
+
+void ChunkedMaskReader::StopThreads()
+{
+  if ( m_ThreadIds.empty() )
+  {
+    return;
+  }
+
+  m_Mutex.Lock();
+  m_Stop = true;
+  m_Condition->Broadcast();
+  m_Mutex.Unlock();
+
+  for ( unsigned int t = 0; t < m_ThreadIds.size(); t++ )
+  {
+    m_Threader->TerminateThread( m_ThreadIds[t] );
+  }
+  m_ThreadIds.clear();
+  m_Slabs.clear();
+}
+
+
+void ChunkedMaskReader::InflateLoop()
+{
+  const unsigned int numberOfSlabs = m_Offsets.size() - 1;
+
+  std::ifstream file( m_FileName.c_str(), std::ios::in | std::ios::binary );
+  std::string   error;
+
+  m_Mutex.Lock();
+  for (;;)
+  {
+    // Wait for a slab to inflate: with ReadAll() any slab left, otherwise
+    // only a few slabs ahead of the caller.
+    while ( ! m_Stop && m_Error.empty() && m_NextSlab < numberOfSlabs &&
+            ! m_Target && m_NextSlab >= m_CurrentSlab + m_SlabsAhead )
+    {
+      m_Condition->Wait( &m_Mutex );
+    }
+    if ( m_Stop || ! m_Error.empty() || m_NextSlab >= numberOfSlabs )
+    {
+      break;
+    }
+    const unsigned int k = m_NextSlab++;
+    m_Mutex.Unlock();
+
+    // The slab is inflated without holding the lock.
+    WordType* words;
+    if ( m_Target )
+    {
+      words = m_Target->GetSliceWords( k * m_SlabDepth );
+    } else
+    {
+      m_Slabs[k].Allocate( m_Layout.GetSizeX(), m_Layout.GetSizeY(), this->GetSlabDepth(k) );
+      words = m_Slabs[k].GetSliceWords(0);
+    }
+    const bool inflated = file.is_open() && this->InflateSlab( file, k, words, error );
+    if ( ! file.is_open() )
+    {
+      error = "Unable to open the file:  " + m_FileName;
+    }
+
+    m_Mutex.Lock();
+    if ( inflated )
+    {
+      m_SlabReady[k] = true;
+    } else if ( m_Error.empty() )
+    {
+      m_Error = error;
+    }
+    m_Condition->Broadcast();
+  }
+  m_Mutex.Unlock();
+}
+
+
+ITK_THREAD_RETURN_TYPE ChunkedMaskReader::InflateThreadCallback(void* arg)
+{
+  itk::MultiThreader::ThreadInfoStruct* info =
+    static_cast<itk::MultiThreader::ThreadInfoStruct*>(arg);
+  ChunkedMaskReader* self = static_cast<ChunkedMaskReader*>( info->UserData );
+
+  self->InflateLoop();
+  return ITK_THREAD_RETURN_VALUE;
+}
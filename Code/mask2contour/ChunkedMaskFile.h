@@ -0,0 +1,118 @@
+#ifndef __ChunkedMaskFile_h
+#define __ChunkedMaskFile_h
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "itkMultiThreader.h"
+#include "itkSimpleMutexLock.h"
+#include "itkConditionVariable.h"
+
+#include "MaskSliceSource.h"
+
+// -------------------------------------------------------------
+// Chunked compressed mask file (".m2cz").
+//
+// The mask is stored bit-packed (see BitPackedMask), cut into slabs of
+// consecutive slices, each slab being an independent zlib stream, so that
+// the slabs can be inflated in parallel:
+//
+//   "M2CZ0001"                         8 bytes
+//   size x, size y, size z, slab depth 4 x uint32
+//   spacing x, y, z                    3 x float64
+//   offsets of the slabs               (number of slabs + 1) x uint64
+//   zlib streams of the slabs
+//
+// All the numbers are little-endian; the offsets are counted from the
+// start of the file, the last one being the size of the file. A slab
+// inflates to the packed words of its slices, each word written as 8
+// little-endian bytes.
+// -------------------------------------------------------------
+namespace ChunkedMaskFile
+{
+// Whether "fileName" names a chunked mask file (".m2cz" extension).
+bool IsChunkedMaskFileName(const std::string& fileName);
+
+// Writes a whole mask; the slabs are compressed in parallel.
+bool Write(const std::string&   fileName,
+           const BitPackedMask& mask,
+           const double         spacing[3],
+           unsigned int         slabDepth,
+           unsigned int         numberOfThreads,
+           std::string&         error);
+}
+
+
+// -------------------------------------------------------------
+// ChunkedMaskReader: reads a chunked compressed mask file.
+//
+// The slabs are inflated by a pool of threads, in z order but several at
+// a time, while the slices are requested (in increasing z) by the caller:
+// a slab can be contoured as soon as it has been inflated, while the next
+// ones are still being inflated. The threads keep at most a few slabs
+// ahead of the caller, and the slabs already used are released.
+// -------------------------------------------------------------
+class ChunkedMaskReader : public MaskSliceSource
+{
+public:
+  typedef BitPackedMask::WordType WordType;
+
+  ChunkedMaskReader();
+  ~ChunkedMaskReader();
+
+  // Reads the header and the offset table.
+  // Returns false and fills "error" on failure.
+  bool Open(const std::string& fileName, std::string& error);
+
+  void SetNumberOfThreads(unsigned int n) { m_NumberOfThreads = n; }
+
+  const BitPackedMask& GetLayout() const { return m_Layout; }
+  unsigned int  GetSizeZ() const          { return m_SizeZ; }
+  const double* GetSpacing() const        { return m_Spacing; }
+
+  // The inflating threads are started on the first call.
+  const WordType* GetSliceWords(unsigned int z);
+
+  // Inflates the whole mask into "mask" (all the threads working on it).
+  // Throws itk::ExceptionObject on failure.
+  void ReadAll(BitPackedMask& mask);
+
+private:
+  // Reads and inflates slab k into "words"; "file" is the stream of the
+  // calling thread.
+  bool InflateSlab(std::ifstream& file, unsigned int k,
+                   WordType* words, std::string& error) const;
+
+  unsigned int GetSlabDepth(unsigned int k) const;
+
+  void StartThreads();
+  void StopThreads();
+  void InflateLoop();
+
+  static ITK_THREAD_RETURN_TYPE InflateThreadCallback(void* arg);
+
+  std::string                     m_FileName;
+  BitPackedMask                   m_Layout;
+  unsigned int                    m_SizeZ;
+  double                          m_Spacing[3];
+  unsigned int                    m_SlabDepth;
+  std::vector<unsigned long long> m_Offsets;
+  unsigned int                    m_NumberOfThreads;
+
+  // State shared with the inflating threads, guarded by m_Mutex.
+  itk::MultiThreader::Pointer     m_Threader;
+  std::vector<int>                m_ThreadIds;
+  itk::SimpleMutexLock            m_Mutex;
+  itk::ConditionVariable::Pointer m_Condition;
+  std::vector<BitPackedMask>      m_Slabs;
+  BitPackedMask*                  m_Target;       // destination of ReadAll()
+  std::vector<bool>               m_SlabReady;
+  unsigned int                    m_NextSlab;     // next slab to inflate
+  unsigned int                    m_CurrentSlab;  // slab used by the caller
+  unsigned int                    m_SlabsAhead;   // limit on the slabs in advance
+  bool                            m_Stop;
+  std::string                     m_Error;
+};
+
+#endif // __ChunkedMaskFile_h
@@ -0,0 +1,340 @@
+#include "ConnectedComponents.h"
+
+#include <algorithm>
+
+namespace
+{
+
+// Orders the roots by decreasing volume; equal volumes keep the raster
+// order of their first run, so that the numbering is reproducible.
+struct LargerVolume
+{
+  const std::vector<unsigned long>* volumes;
+
+  bool operator()(unsigned long a, unsigned long b) const
+    {
+    if ( (*volumes)[a] != (*volumes)[b] )
+      {
+      return (*volumes)[a] > (*volumes)[b];
+      }
+    return a < b;
+    }
+};
+
+} // end anonymous namespace
+
+
+ConnectedComponents::ConnectedComponents()
+  : m_Mask(0), m_FullyConnected(false), m_NumberOfThreads(1)
+{
+}
+
+
+void ConnectedComponents::Compute(const BitPackedMask& mask)
+{
+  m_Mask = &mask;
+
+  const unsigned int sizeZ = mask.GetSizeZ();
+
+  m_SliceRuns.clear();
+  m_SliceRuns.resize(sizeZ);
+  m_RowStart.clear();
+  m_RowStart.resize(sizeZ);
+  m_ComponentVolumes.clear();
+
+  if ( sizeZ == 0 )
+  {
+    return;
+  }
+
+  // Cut the volume into one slab of consecutive slices per thread; the
+  // callbacks handle the slab of their thread, so the slabs are counted
+  // from the threads the threader actually runs (it may run fewer than
+  // asked).
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads( std::min( std::max( 1u, m_NumberOfThreads ), sizeZ ) );
+  const unsigned int numberOfSlabs =
+    static_cast<unsigned int>( threader->GetNumberOfThreads() );
+
+  m_SlabStart.resize( numberOfSlabs + 1 );
+  for ( unsigned int s = 0; s <= numberOfSlabs; s++ )
+  {
+    m_SlabStart[s] = static_cast<unsigned int>(
+      static_cast<unsigned long>(sizeZ) * s / numberOfSlabs );
+  }
+
+  threader->SetSingleMethod( ConnectedComponents::FindRunsThreadCallback, this );
+  threader->SingleMethodExecute();
+
+  // Give every run its union-find entry.
+  m_FirstRun.resize( sizeZ + 1 );
+  m_FirstRun[0] = 0;
+  for ( unsigned int z = 0; z < sizeZ; z++ )
+  {
+    m_FirstRun[z + 1] = m_FirstRun[z] + m_SliceRuns[z].size();
+  }
+
+  const unsigned long numberOfRuns = m_FirstRun[sizeZ];
+  m_Parent.resize(numberOfRuns);
+  for ( unsigned long i = 0; i < numberOfRuns; i++ )
+  {
+    m_Parent[i] = i;
+  }
+
+  threader->SetSingleMethod( ConnectedComponents::MergeRunsThreadCallback, this );
+  threader->SingleMethodExecute();
+
+  // Stitch the slabs together.
+  for ( unsigned int s = 1; s < numberOfSlabs; s++ )
+  {
+    this->MergeWithPreviousSlice( m_SlabStart[s] );
+  }
+
+  // Volume of each component, accumulated on its root.
+  std::vector<unsigned long> volumes(numberOfRuns, 0);
+  std::vector<unsigned long> roots;
+
+  for ( unsigned int z = 0; z < sizeZ; z++ )
+  {
+    const SliceRuns& runs = m_SliceRuns[z];
+    for ( unsigned long i = 0; i < runs.size(); i++ )
+    {
+      const unsigned long root = this->Find( m_FirstRun[z] + i );
+      if ( root == m_FirstRun[z] + i )
+      {
+        roots.push_back(root);
+      }
+      volumes[root] += runs[i].x1 - runs[i].x0 + 1;
+    }
+  }
+
+  LargerVolume order;
+  order.volumes = &volumes;
+  std::sort( roots.begin(), roots.end(), order );
+
+  m_ComponentVolumes.resize( roots.size() );
+  for ( unsigned int c = 0; c < roots.size(); c++ )
+  {
+    m_ComponentVolumes[c] = volumes[ roots[c] ];
+  }
+  std::vector<unsigned long> componentOfRoot(numberOfRuns);
+  for ( unsigned int c = 0; c < roots.size(); c++ )
+  {
+    componentOfRoot[ roots[c] ] = c;
+  }
+
+  for ( unsigned int z = 0; z < sizeZ; z++ )
+  {
+    SliceRuns& runs = m_SliceRuns[z];
+    for ( unsigned long i = 0; i < runs.size(); i++ )
+    {
+      runs[i].component = componentOfRoot[ this->Find( m_FirstRun[z] + i ) ];
+    }
+  }
+
+  // The union-find is not needed anymore.
+  std::vector<unsigned long>().swap(m_Parent);
+}
+
+
+void ConnectedComponents::FindSlabRuns(unsigned int zBegin, unsigned int zEnd)
+{
+  const BitPackedMask& mask  = *m_Mask;
+  const unsigned int   sizeX = mask.GetSizeX();
+  const unsigned int   sizeY = mask.GetSizeY();
+
+  for ( unsigned int z = zBegin; z < zEnd; z++ )
+  {
+    SliceRuns&                  runs     = m_SliceRuns[z];
+    std::vector<unsigned long>& rowStart = m_RowStart[z];
+    rowStart.resize( sizeY + 1 );
+
+    const BitPackedMask::WordType* row = mask.GetSliceWords(z);
+
+    for ( unsigned int y = 0; y < sizeY; y++, row += mask.GetWordsPerRow() )
+    {
+      rowStart[y] = runs.size();
+
+      unsigned int x = mask.FindNextSetVoxel(row, 0);
+      while ( x < sizeX )
+      {
+        const unsigned int end = mask.FindNextClearVoxel(row, x);
+
+        Run run;
+        run.y         = y;
+        run.x0        = x;
+        run.x1        = end - 1;
+        run.component = 0;
+        runs.push_back(run);
+
+        x = mask.FindNextSetVoxel(row, end);
+      }
+    }
+    rowStart[sizeY] = runs.size();
+  }
+}
+
+
+void ConnectedComponents::MergeSlabRuns(unsigned int zBegin, unsigned int zEnd)
+{
+  const unsigned int sizeY = m_Mask->GetSizeY();
+  const unsigned int reach = m_FullyConnected ? 1 : 0;
+
+  for ( unsigned int z = zBegin; z < zEnd; z++ )
+  {
+    const SliceRuns&                  runs     = m_SliceRuns[z];
+    const std::vector<unsigned long>& rowStart = m_RowStart[z];
+
+    if ( runs.empty() )
+    {
+      continue;
+    }
+
+    // Neighbouring rows of the slice.
+    for ( unsigned int y = 1; y < sizeY; y++ )
+    {
+      this->MergeRows( &runs[0] + rowStart[y - 1], &runs[0] + rowStart[y],
+                       m_FirstRun[z] + rowStart[y - 1],
+                       &runs[0] + rowStart[y], &runs[0] + rowStart[y + 1],
+                       m_FirstRun[z] + rowStart[y],
+                       reach );
+    }
+
+    // The first slice of the slab is merged with the previous slab later.
+    if ( z > zBegin )
+    {
+      this->MergeWithPreviousSlice(z);
+    }
+  }
+}
+
+
+void ConnectedComponents::MergeWithPreviousSlice(unsigned int z)
+{
+  const SliceRuns& runs     = m_SliceRuns[z];
+  const SliceRuns& previous = m_SliceRuns[z - 1];
+
+  if ( runs.empty() || previous.empty() )
+  {
+    return;
+  }
+
+  const std::vector<unsigned long>& rowStart         = m_RowStart[z];
+  const std::vector<unsigned long>& previousRowStart = m_RowStart[z - 1];
+
+  const int sizeY = static_cast<int>( m_Mask->GetSizeY() );
+  const int reach = m_FullyConnected ? 1 : 0;
+
+  for ( int y = 0; y < sizeY; y++ )
+  {
+    if ( rowStart[y] == rowStart[y + 1] )
+    {
+      continue;
+    }
+
+    const int yBegin = std::max( y - reach, 0 );
+    const int yEnd   = std::min( y + reach, sizeY - 1 );
+
+    for ( int yp = yBegin; yp <= yEnd; yp++ )
+    {
+      this->MergeRows( &runs[0] + rowStart[y], &runs[0] + rowStart[y + 1],
+                       m_FirstRun[z] + rowStart[y],
+                       &previous[0] + previousRowStart[yp],
+                       &previous[0] + previousRowStart[yp + 1],
+                       m_FirstRun[z - 1] + previousRowStart[yp],
+                       reach );
+    }
+  }
+}
+
+
+void ConnectedComponents::MergeRows(const Run* a, const Run* aEnd, unsigned long aFirst,
+                                    const Run* b, const Run* bEnd, unsigned long bFirst,
+                                    unsigned int reach)
+{
+  const Run* aBegin = a;
+  const Run* bBegin = b;
+
+  while ( a != aEnd && b != bEnd )
+  {
+    if ( a->x1 + reach < b->x0 )
+    {
+      ++a;
+    } else if ( b->x1 + reach < a->x0 )
+    {
+      ++b;
+    } else
+    {
+      this->Union( aFirst + ( a - aBegin ), bFirst + ( b - bBegin ) );
+
+      // The run that ends first can not overlap anything further.
+      if ( a->x1 < b->x1 )
+      {
+        ++a;
+      } else
+      {
+        ++b;
+      }
+    }
+  }
+}
+
+
+unsigned long ConnectedComponents::Find(unsigned long run)
+{
+  // Path halving.
+  while ( m_Parent[run] != run )
+  {
+    m_Parent[run] = m_Parent[ m_Parent[run] ];
+    run = m_Parent[run];
+  }
+  return run;
+}
+
+
+void ConnectedComponents::Union(unsigned long a, unsigned long b)
+{
+  a = this->Find(a);
+  b = this->Find(b);
+
+  // The smaller entry becomes the root: a root is always the first run of
+  // its component in raster order, and the roots found by a thread never
+  // leave its slab.
+  if ( a < b )
+  {
+    m_Parent[b] = a;
+  } else if ( b < a )
+  {
+    m_Parent[a] = b;
+  }
+}
+
+
+ITK_THREAD_RETURN_TYPE ConnectedComponents::FindRunsThreadCallback(void* arg)
+{
+  itk::MultiThreader::ThreadInfoStruct* info =
+    static_cast<itk::MultiThreader::ThreadInfoStruct*>(arg);
+  ConnectedComponents* self = static_cast<ConnectedComponents*>( info->UserData );
+  const unsigned int   slab = info->ThreadID;
+
+  if ( slab + 1 < self->m_SlabStart.size() )
+  {
+    self->FindSlabRuns( self->m_SlabStart[slab], self->m_SlabStart[slab + 1] );
+  }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+ITK_THREAD_RETURN_TYPE ConnectedComponents::MergeRunsThreadCallback(void* arg)
+{
+  itk::MultiThreader::ThreadInfoStruct* info =
+    static_cast<itk::MultiThreader::ThreadInfoStruct*>(arg);
+  ConnectedComponents* self = static_cast<ConnectedComponents*>( info->UserData );
+  const unsigned int   slab = info->ThreadID;
+
+  if ( slab + 1 < self->m_SlabStart.size() )
+  {
+    self->MergeSlabRuns( self->m_SlabStart[slab], self->m_SlabStart[slab + 1] );
+  }
+  return ITK_THREAD_RETURN_VALUE;
+}
@@ -0,0 +1,97 @@
+#ifndef __ConnectedComponents_h
+#define __ConnectedComponents_h
+
+#include <vector>
+
+#include "BitPackedMask.h"
+#include "itkMultiThreader.h"
+
+// -------------------------------------------------------------
+// ConnectedComponents: labels the 3D connected components of a
+// bit-packed mask.
+//
+// The mask is first reduced to its runs (maximal sequences of set voxels
+// along a row), found with bit-scans on the packed words. The runs are
+// then merged with a union-find: two runs are connected when they are in
+// neighbouring rows of the same slice, or in the same row (any of the
+// three neighbouring rows with full connectivity) of neighbouring slices,
+// and overlap along x.
+//
+// The volume is cut into slabs of consecutive slices. Each thread finds
+// and merges the runs of its own slab, touching only the union-find
+// entries of that slab, so that no locking is needed; the slabs are then
+// stitched together along their boundary slices.
+//
+// The components are numbered by decreasing volume (component 0 is the
+// largest one).
+// -------------------------------------------------------------
+class ConnectedComponents
+{
+public:
+  struct Run
+  {
+    unsigned int y;
+    unsigned int x0;        // first voxel of the run
+    unsigned int x1;        // last voxel of the run (inclusive)
+    unsigned int component;
+  };
+  typedef std::vector<Run> SliceRuns; // ordered by y, then by x
+
+  ConnectedComponents();
+
+  // When on, voxels sharing only an edge or a corner are connected
+  // (26-connectivity); otherwise only faces are (6-connectivity).
+  void SetFullyConnected(bool on)          { m_FullyConnected = on; }
+  void SetNumberOfThreads(unsigned int n)  { m_NumberOfThreads = n; }
+
+  void Compute(const BitPackedMask& mask);
+
+  unsigned int  GetNumberOfComponents() const { return m_ComponentVolumes.size(); }
+
+  // Number of voxels of a component.
+  unsigned long GetComponentVolume(unsigned int component) const
+    { return m_ComponentVolumes[component]; }
+
+  const SliceRuns& GetSliceRuns(unsigned int z) const { return m_SliceRuns[z]; }
+
+private:
+  void FindSlabRuns(unsigned int zBegin, unsigned int zEnd);
+  void MergeSlabRuns(unsigned int zBegin, unsigned int zEnd);
+
+  // Merges the runs of slice z with the runs of slice z-1.
+  void MergeWithPreviousSlice(unsigned int z);
+
+  // Merges the overlapping runs of two rows, both ordered by x.
+  // "reach" is 1 to also connect runs touching diagonally.
+  void MergeRows(const Run* a, const Run* aEnd, unsigned long aFirst,
+                 const Run* b, const Run* bEnd, unsigned long bFirst,
+                 unsigned int reach);
+
+  unsigned long Find(unsigned long run);
+  void          Union(unsigned long a, unsigned long b);
+
+  static ITK_THREAD_RETURN_TYPE FindRunsThreadCallback(void* arg);
+  static ITK_THREAD_RETURN_TYPE MergeRunsThreadCallback(void* arg);
+
+  const BitPackedMask* m_Mask;
+  bool                 m_FullyConnected;
+  unsigned int         m_NumberOfThreads;
+
+  // First slice of each slab, followed by the number of slices.
+  std::vector<unsigned int> m_SlabStart;
+
+  std::vector<SliceRuns> m_SliceRuns;
+
+  // Runs of row y of slice z are
+  // m_SliceRuns[z][ m_RowStart[z][y] ... m_RowStart[z][y+1]-1 ].
+  std::vector< std::vector<unsigned long> > m_RowStart;
+
+  // Union-find over all the runs; run i of slice z is entry
+  // m_FirstRun[z] + i.
+  std::vector<unsigned long> m_FirstRun;
+  std::vector<unsigned long> m_Parent;
+
+  std::vector<unsigned long> m_ComponentVolumes;
+};
+
+#endif // __ConnectedComponents_h
@@ -0,0 +1,245 @@
+#ifndef __ContourNesting_h
+#define __ContourNesting_h
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// -------------------------------------------------------------
+// ContourNesting: finds, for the closed contours of one slice, the
+// contour each one is directly nested in (an outer boundary for a hole,
+// a hole for an island inside it, ...).
+//
+// The contours of a slice never cross each other, so contour A is inside
+// contour B as soon as one vertex of A is inside B; the parent of A is
+// the smallest contour it is inside.
+//
+// To avoid testing every pair of contours, the bounding boxes of the
+// contours are registered in a uniform grid over the slice. A contour
+// is only tested against the contours whose bounding box covers the grid
+// cell of its first vertex, contains its own bounding box, and encloses
+// a larger area.
+//
+// TPolyline is a vector-like container of 2D vertices (v[0], v[1]).
+// -------------------------------------------------------------
+template <class TPolyline>
+class ContourNesting
+{
+public:
+  // "closed[i]" tells whether polylines[i] is closed; open contours are
+  // neither nested nor parents. A closed polyline may repeat its first
+  // vertex at the end.
+  void Compute(const std::vector<TPolyline>& polylines,
+               const std::vector<bool>&      closed);
+
+  // Index of the contour that directly contains contour i, or -1.
+  int GetParent(unsigned int i) const { return m_Parents[i]; }
+
+private:
+  struct BoundingBox
+  {
+    double xMin, xMax, yMin, yMax;
+
+    bool Contains(const BoundingBox& b) const
+      {
+      return xMin <= b.xMin && b.xMax <= xMax && yMin <= b.yMin && b.yMax <= yMax;
+      }
+  };
+
+  static bool IsInside(const TPolyline& polyline, double x, double y);
+
+  unsigned int CellIndex(double value, double origin, double cellSize) const;
+
+  std::vector<int>         m_Parents;
+  std::vector<BoundingBox> m_Boxes;
+  std::vector<double>      m_Areas;
+
+  // Contours whose bounding box overlaps cell c are
+  // m_CellContours[ m_CellStart[c] ... m_CellStart[c+1]-1 ].
+  unsigned int              m_GridSize;
+  std::vector<unsigned int> m_CellStart;
+  std::vector<unsigned int> m_CellContours;
+};
+
+
+template <class TPolyline>
+void ContourNesting<TPolyline>::Compute(const std::vector<TPolyline>& polylines,
+                                        const std::vector<bool>&      closed)
+{
+  const unsigned int numContours = polylines.size();
+
+  m_Parents.assign(numContours, -1);
+  m_Boxes.resize(numContours);
+  m_Areas.assign(numContours, 0.0);
+
+  // Bounding box and area of each closed contour, and extent of the slice.
+  BoundingBox extent = { 0.0, 0.0, 0.0, 0.0 };
+  unsigned int numClosed = 0;
+
+  for ( unsigned int i = 0; i < numContours; i++ )
+  {
+    const TPolyline& polyline = polylines[i];
+    if ( ! closed[i] || polyline.empty() )
+    {
+      continue;
+    }
+
+    BoundingBox& box = m_Boxes[i];
+    box.xMin = box.xMax = polyline[0][0];
+    box.yMin = box.yMax = polyline[0][1];
+
+    double twiceArea = 0.0;
+    for ( unsigned int j = 0; j < polyline.size(); j++ )
+    {
+      const unsigned int k = ( j + 1 ) % polyline.size();
+      box.xMin = std::min( box.xMin, double( polyline[j][0] ) );
+      box.xMax = std::max( box.xMax, double( polyline[j][0] ) );
+      box.yMin = std::min( box.yMin, double( polyline[j][1] ) );
+      box.yMax = std::max( box.yMax, double( polyline[j][1] ) );
+      twiceArea += polyline[j][0] * polyline[k][1] - polyline[k][0] * polyline[j][1];
+    }
+    m_Areas[i] = 0.5 * fabs(twiceArea);
+
+    if ( numClosed++ == 0 )
+    {
+      extent = box;
+    } else
+    {
+      extent.xMin = std::min( extent.xMin, box.xMin );
+      extent.xMax = std::max( extent.xMax, box.xMax );
+      extent.yMin = std::min( extent.yMin, box.yMin );
+      extent.yMax = std::max( extent.yMax, box.yMax );
+    }
+  }
+
+  if ( numClosed < 2 )
+  {
+    return;
+  }
+
+  // About one contour per cell.
+  m_GridSize = static_cast<unsigned int>( ceil( sqrt( double(numClosed) ) ) );
+  const double cellWidth  = ( extent.xMax - extent.xMin ) / m_GridSize;
+  const double cellHeight = ( extent.yMax - extent.yMin ) / m_GridSize;
+
+  // Bucket the contours by cell (counting pass, then filling pass).
+  const unsigned int numCells = m_GridSize * m_GridSize;
+  m_CellStart.assign( numCells + 1, 0 );
+
+  for ( unsigned int pass = 0; pass < 2; pass++ )
+  {
+    std::vector<unsigned int> fill;
+    if ( pass == 1 )
+    {
+      for ( unsigned int c = 0; c < numCells; c++ )
+      {
+        m_CellStart[c + 1] += m_CellStart[c];
+      }
+      m_CellContours.resize( m_CellStart[numCells] );
+      fill.assign( m_CellStart.begin(), m_CellStart.end() - 1 );
+    }
+
+    for ( unsigned int i = 0; i < numContours; i++ )
+    {
+      if ( ! closed[i] || polylines[i].empty() )
+      {
+        continue;
+      }
+      const BoundingBox& box = m_Boxes[i];
+      const unsigned int cx0 = this->CellIndex( box.xMin, extent.xMin, cellWidth );
+      const unsigned int cx1 = this->CellIndex( box.xMax, extent.xMin, cellWidth );
+      const unsigned int cy0 = this->CellIndex( box.yMin, extent.yMin, cellHeight );
+      const unsigned int cy1 = this->CellIndex( box.yMax, extent.yMin, cellHeight );
+
+      for ( unsigned int cy = cy0; cy <= cy1; cy++ )
+      {
+        for ( unsigned int cx = cx0; cx <= cx1; cx++ )
+        {
+          const unsigned int c = cy * m_GridSize + cx;
+          if ( pass == 0 )
+          {
+            m_CellStart[c + 1]++;
+          } else
+          {
+            m_CellContours[ fill[c]++ ] = i;
+          }
+        }
+      }
+    }
+  }
+
+  // Parent of each contour: the smallest candidate that contains it.
+  for ( unsigned int i = 0; i < numContours; i++ )
+  {
+    if ( ! closed[i] || polylines[i].empty() )
+    {
+      continue;
+    }
+
+    const double x = polylines[i][0][0];
+    const double y = polylines[i][0][1];
+    const unsigned int c = this->CellIndex( y, extent.yMin, cellHeight ) * m_GridSize +
+                           this->CellIndex( x, extent.xMin, cellWidth );
+
+    for ( unsigned int n = m_CellStart[c]; n < m_CellStart[c + 1]; n++ )
+    {
+      const unsigned int j = m_CellContours[n];
+
+      if ( j == i || m_Areas[j] <= m_Areas[i] ||
+           ! m_Boxes[j].Contains( m_Boxes[i] ) )
+      {
+        continue;
+      }
+      if ( m_Parents[i] >= 0 && m_Areas[j] >= m_Areas[ m_Parents[i] ] )
+      {
+        continue; // a smaller container is already known
+      }
+      if ( IsInside( polylines[j], x, y ) )
+      {
+        m_Parents[i] = static_cast<int>(j);
+      }
+    }
+  }
+}
+
+
+template <class TPolyline>
+unsigned int ContourNesting<TPolyline>::CellIndex(double value,
+                                                  double origin,
+                                                  double cellSize) const
+{
+  if ( cellSize <= 0.0 )
+  {
+    return 0;
+  }
+  const double cell = floor( ( value - origin ) / cellSize );
+  if ( cell < 0.0 )
+  {
+    return 0;
+  }
+  return std::min( static_cast<unsigned int>(cell), m_GridSize - 1 );
+}
+
+
+// Even-odd rule (crossing number) point-in-polygon test.
+template <class TPolyline>
+bool ContourNesting<TPolyline>::IsInside(const TPolyline& polyline, double x, double y)
+{
+  bool inside = false;
+  const unsigned int n = polyline.size();
+
+  for ( unsigned int j = 0, k = n - 1; j < n; k = j++ )
+  {
+    const double xj = polyline[j][0], yj = polyline[j][1];
+    const double xk = polyline[k][0], yk = polyline[k][1];
+
+    if ( ( yj > y ) != ( yk > y ) &&
+         x < xj + ( y - yj ) * ( xk - xj ) / ( yk - yj ) )
+    {
+      inside = ! inside;
+    }
+  }
+  return inside;
+}
+
+#endif // __ContourNesting_h
@@ -0,0 +1,328 @@
+#include "MaskExpression.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define MASK_EXPRESSION_USE_SSE2
+#endif
+
+typedef MaskExpression::WordType WordType;
+
+// -------------------------------------------------------------
+// The word-wise operations. Each one provides a 64-bit version and,
+// when SSE2 is available, a 128-bit one.
+// -------------------------------------------------------------
+namespace
+{
+
+struct UnionOperation
+{
+  static WordType Word(WordType a, WordType b) { return a | b; }
+#ifdef MASK_EXPRESSION_USE_SSE2
+  static __m128i Vector(__m128i a, __m128i b) { return _mm_or_si128(a, b); }
+#endif
+};
+
+struct IntersectionOperation
+{
+  static WordType Word(WordType a, WordType b) { return a & b; }
+#ifdef MASK_EXPRESSION_USE_SSE2
+  static __m128i Vector(__m128i a, __m128i b) { return _mm_and_si128(a, b); }
+#endif
+};
+
+struct DifferenceOperation
+{
+  // The padding bits of "a" are zero, so "~b" does not set them.
+  static WordType Word(WordType a, WordType b) { return a & ~b; }
+#ifdef MASK_EXPRESSION_USE_SSE2
+  static __m128i Vector(__m128i a, __m128i b) { return _mm_andnot_si128(b, a); }
+#endif
+};
+
+struct XorOperation
+{
+  static WordType Word(WordType a, WordType b) { return a ^ b; }
+#ifdef MASK_EXPRESSION_USE_SSE2
+  static __m128i Vector(__m128i a, __m128i b) { return _mm_xor_si128(a, b); }
+#endif
+};
+
+// "out" may be the same buffer as "a"; it never aliases "b".
+template <class TOperation>
+void ApplyWordWise(const WordType* a,
+                   const WordType* b,
+                   WordType*       out,
+                   unsigned long   numberOfWords)
+{
+  unsigned long i = 0;
+
+#ifdef MASK_EXPRESSION_USE_SSE2
+  for ( ; i + 2 <= numberOfWords; i += 2 )
+  {
+    const __m128i va = _mm_loadu_si128( reinterpret_cast<const __m128i*>( a + i ) );
+    const __m128i vb = _mm_loadu_si128( reinterpret_cast<const __m128i*>( b + i ) );
+    _mm_storeu_si128( reinterpret_cast<__m128i*>( out + i ), TOperation::Vector(va, vb) );
+  }
+#endif
+
+  for ( ; i < numberOfWords; i++ )
+  {
+    out[i] = TOperation::Word( a[i], b[i] );
+  }
+}
+
+} // end anonymous namespace
+// -------------------------------------------------------------
+
+
+MaskExpression::MaskExpression()
+  : m_NumberOfMasks(0), m_MaxStackDepth(0)
+{
+}
+
+
+bool MaskExpression::Parse(const std::string& expression,
+                           unsigned int       numberOfMasks,
+                           std::string&       error)
+{
+  m_Text          = expression;
+  m_NumberOfMasks = numberOfMasks;
+  m_Error         = "";
+  m_Program.clear();
+
+  std::string::size_type pos = 0;
+  bool ok = this->ParseExpression(pos);
+
+  if ( ok && this->Peek(pos) != '\0' )
+  {
+    std::ostringstream msg;
+    msg << "unexpected character '" << m_Text[pos] << "' at position " << pos + 1;
+    m_Error = msg.str();
+    ok = false;
+  }
+
+  if ( ! ok )
+  {
+    error = "Invalid mask expression \"" + m_Text + "\": " + m_Error;
+    m_Program.clear();
+    return false;
+  }
+
+  // Depth of the evaluation stack needed by the program.
+  unsigned int depth = 0;
+  m_MaxStackDepth = 0;
+  for ( unsigned int i = 0; i < m_Program.size(); i++ )
+  {
+    if ( m_Program[i].opCode == PUSH_MASK )
+    {
+      depth++;
+    } else
+    {
+      depth--;
+    }
+    if ( depth > m_MaxStackDepth )
+    {
+      m_MaxStackDepth = depth;
+    }
+  }
+  m_Scratch.resize( m_MaxStackDepth );
+
+  return true;
+}
+
+
+char MaskExpression::Peek(std::string::size_type& pos) const
+{
+  while ( pos < m_Text.length() && isspace( static_cast<unsigned char>( m_Text[pos] ) ) )
+  {
+    pos++;
+  }
+  return ( pos < m_Text.length() ) ? m_Text[pos] : '\0';
+}
+
+
+bool MaskExpression::ParseExpression(std::string::size_type& pos)
+{
+  if ( ! this->ParseTerm(pos) )
+  {
+    return false;
+  }
+  while ( this->Peek(pos) == '|' )
+  {
+    pos++;
+    if ( ! this->ParseTerm(pos) )
+    {
+      return false;
+    }
+    Instruction instruction = { UNION, 0 };
+    m_Program.push_back(instruction);
+  }
+  return true;
+}
+
+
+bool MaskExpression::ParseTerm(std::string::size_type& pos)
+{
+  if ( ! this->ParseFactor(pos) )
+  {
+    return false;
+  }
+  char op = this->Peek(pos);
+  while ( op == '-' || op == '^' )
+  {
+    pos++;
+    if ( ! this->ParseFactor(pos) )
+    {
+      return false;
+    }
+    Instruction instruction = { ( op == '-' ) ? DIFFERENCE : XOR, 0 };
+    m_Program.push_back(instruction);
+    op = this->Peek(pos);
+  }
+  return true;
+}
+
+
+bool MaskExpression::ParseFactor(std::string::size_type& pos)
+{
+  if ( ! this->ParsePrimary(pos) )
+  {
+    return false;
+  }
+  while ( this->Peek(pos) == '&' )
+  {
+    pos++;
+    if ( ! this->ParsePrimary(pos) )
+    {
+      return false;
+    }
+    Instruction instruction = { INTERSECTION, 0 };
+    m_Program.push_back(instruction);
+  }
+  return true;
+}
+
+
+bool MaskExpression::ParsePrimary(std::string::size_type& pos)
+{
+  const char c = this->Peek(pos);
+
+  if ( c == '(' )
+  {
+    pos++;
+    if ( ! this->ParseExpression(pos) )
+    {
+      return false;
+    }
+    if ( this->Peek(pos) != ')' )
+    {
+      m_Error = "missing ')'";
+      return false;
+    }
+    pos++;
+    return true;
+  }
+
+  if ( c == 'm' || c == 'M' )
+  {
+    pos++;
+    const std::string::size_type begin = pos;
+    while ( pos < m_Text.length() && isdigit( static_cast<unsigned char>( m_Text[pos] ) ) )
+    {
+      pos++;
+    }
+    const unsigned int number =
+      static_cast<unsigned int>( atoi( m_Text.substr(begin, pos - begin).c_str() ) );
+
+    if ( pos == begin || number == 0 || number > m_NumberOfMasks )
+    {
+      std::ostringstream msg;
+      msg << "mask operand at position " << begin
+          << " must be one of m1..m" << m_NumberOfMasks;
+      m_Error = msg.str();
+      return false;
+    }
+
+    Instruction instruction = { PUSH_MASK, number - 1 };
+    m_Program.push_back(instruction);
+    return true;
+  }
+
+  m_Error = ( c == '\0' ) ? std::string("unexpected end of expression")
+                          : std::string("a mask operand (m1, m2, ...) or '(' is expected");
+  return false;
+}
+
+
+const WordType*
+MaskExpression::EvaluateSlice(const std::vector<const WordType*>& maskSlices,
+                              unsigned long                       numberOfWords,
+                              WordType*                           result)
+{
+  std::vector<const WordType*> stack;
+  stack.reserve( m_MaxStackDepth );
+
+  for ( unsigned int i = 0; i < m_Program.size(); i++ )
+  {
+    const Instruction& instruction = m_Program[i];
+
+    if ( instruction.opCode == PUSH_MASK )
+    {
+      stack.push_back( maskSlices[instruction.maskIndex] );
+      continue;
+    }
+
+    const WordType* b = stack.back();
+    stack.pop_back();
+    const WordType* a = stack.back();
+    stack.pop_back();
+
+    // The result of an operation goes to the buffer owned by its stack
+    // level; the bottom level writes directly into "result".
+    const unsigned int level = stack.size();
+    WordType* out = result;
+    if ( level > 0 )
+    {
+      if ( m_Scratch[level].size() != numberOfWords )
+      {
+        m_Scratch[level].resize( numberOfWords );
+      }
+      out = &m_Scratch[level][0];
+    }
+
+    ApplyOperation( instruction.opCode, a, b, out, numberOfWords );
+    stack.push_back( out );
+  }
+
+  return stack.back();
+}
+
+
+void MaskExpression::ApplyOperation(OpCode          opCode,
+                                    const WordType* a,
+                                    const WordType* b,
+                                    WordType*       out,
+                                    unsigned long   numberOfWords)
+{
+  switch ( opCode )
+  {
+    case UNION:
+      ApplyWordWise<UnionOperation>(a, b, out, numberOfWords);
+      break;
+    case INTERSECTION:
+      ApplyWordWise<IntersectionOperation>(a, b, out, numberOfWords);
+      break;
+    case DIFFERENCE:
+      ApplyWordWise<DifferenceOperation>(a, b, out, numberOfWords);
+      break;
+    case XOR:
+      ApplyWordWise<XorOperation>(a, b, out, numberOfWords);
+      break;
+    default:
+      break;
+  }
+}
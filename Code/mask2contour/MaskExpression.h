@@ -0,0 +1,89 @@
+#ifndef __MaskExpression_h
+#define __MaskExpression_h
+
+#include <string>
+#include <vector>
+
+#include "BitPackedMask.h"
+
+// -------------------------------------------------------------
+// MaskExpression: a small boolean expression over several masks,
+// evaluated one packed slice at a time.
+//
+// Grammar (operands are numbered from 1, "m1" being the first mask):
+//
+//   expression := term    { '|' term }               union
+//   term       := factor  { ('-' | '^') factor }     difference, xor
+//   factor     := primary { '&' primary }            intersection
+//   primary    := 'm' <number>  |  '(' expression ')'
+//
+// i.e. '&' binds tighter than '-' and '^', which bind tighter than '|';
+// operators of the same level are evaluated from left to right.
+// Examples: "m1-m2" (body minus bones), "(m1|m2)&m3", "m2-m1" (ring).
+//
+// The expression is compiled into a postfix program. Each operation of the
+// program works on whole slices, 128 bits at a time with SSE2 when it is
+// available (and 64 bits at a time otherwise).
+// -------------------------------------------------------------
+class MaskExpression
+{
+public:
+  typedef BitPackedMask::WordType WordType;
+
+  MaskExpression();
+
+  // Compiles "expression". Returns false and fills "error" if the
+  // expression is not valid or refers to a mask beyond "numberOfMasks".
+  bool Parse(const std::string& expression,
+             unsigned int       numberOfMasks,
+             std::string&       error);
+
+  // Evaluates the expression on one slice. "maskSlices[i]" is the slice of
+  // mask "m<i+1>"; all of them, as well as "result", are "numberOfWords"
+  // words long. The returned pointer is either "result" or, when the
+  // expression is a single operand, the slice of that operand.
+  const WordType* EvaluateSlice(const std::vector<const WordType*>& maskSlices,
+                                unsigned long                       numberOfWords,
+                                WordType*                           result);
+
+private:
+  enum OpCode
+  {
+    PUSH_MASK,
+    UNION,
+    INTERSECTION,
+    DIFFERENCE,
+    XOR
+  };
+
+  struct Instruction
+  {
+    OpCode       opCode;
+    unsigned int maskIndex; // only for PUSH_MASK
+  };
+
+  // Recursive descent parser.
+  bool ParseExpression(std::string::size_type& pos);
+  bool ParseTerm(std::string::size_type& pos);
+  bool ParseFactor(std::string::size_type& pos);
+  bool ParsePrimary(std::string::size_type& pos);
+  char Peek(std::string::size_type& pos) const;
+
+  static void ApplyOperation(OpCode          opCode,
+                             const WordType* a,
+                             const WordType* b,
+                             WordType*       out,
+                             unsigned long   numberOfWords);
+
+  std::string              m_Text;
+  std::string              m_Error;
+  unsigned int             m_NumberOfMasks;
+  unsigned int             m_MaxStackDepth;
+  std::vector<Instruction> m_Program;
+
+  // One scratch slice per stack level, except the bottom one which is the
+  // "result" buffer given by the caller.
+  std::vector< std::vector<WordType> > m_Scratch;
+};
+
+#endif // __MaskExpression_h
@@ -0,0 +1,209 @@
+#include "MaskSlabCache.h"
+
+#include "itkImageIOFactory.h"
+
+#include <iostream>
+
+
+MaskSlabCache::MaskSlabCache()
+  : m_Threshold(0), m_SizeZ(0), m_SlabDepth(1), m_MaximumNumberOfSlabs(1),
+    m_Clock(0), m_NumberOfSlabReads(0), m_WholeReadReported(false)
+{
+  m_Spacing[0] = m_Spacing[1] = m_Spacing[2] = 1.0;
+}
+
+
+bool MaskSlabCache::Open(const std::string& fileName,
+                         unsigned long      memoryBudget,
+                         unsigned char      threshold,
+                         std::string&       error)
+{
+  itk::ImageIOBase::Pointer imageIO =
+    itk::ImageIOFactory::CreateImageIO(fileName.c_str(), itk::ImageIOFactory::ReadMode);
+
+  if ( ! imageIO )
+  {
+    error = "Unable to find a reader for the image:  " + fileName;
+    return false;
+  }
+
+  try
+  {
+    // The ImageIOs of ITK (e.g. MetaImageIO) only read the requested
+    // region when they are asked to stream; they read the whole image
+    // otherwise.
+    imageIO->SetUseStreamedReading(true);
+    imageIO->SetFileName(fileName.c_str());
+    imageIO->ReadImageInformation();
+  }
+  catch( itk::ExceptionObject & err )
+  {
+    error = "Unable to read the header of " + fileName + ": " + err.GetDescription();
+    return false;
+  }
+
+  if ( imageIO->GetNumberOfDimensions() != 3 )
+  {
+    error = "A 3D image is expected:  " + fileName;
+    return false;
+  }
+
+  m_Threshold = threshold;
+  m_SizeZ     = imageIO->GetDimensions(2);
+  for ( unsigned int i = 0; i < 3; i++ )
+  {
+    m_Spacing[i] = imageIO->GetSpacing(i);
+  }
+  m_Layout.Allocate( imageIO->GetDimensions(0), imageIO->GetDimensions(1), 0 );
+
+  // A quarter of the budget for the unpacked slab being read, the rest
+  // for the packed slabs (at least one slice and one slab in any case).
+  const unsigned long unpackedSliceBytes =
+    static_cast<unsigned long>( m_Layout.GetSizeX() ) * m_Layout.GetSizeY();
+  const unsigned long packedSliceBytes =
+    m_Layout.GetWordsPerSlice() * sizeof(WordType);
+
+  m_SlabDepth = 1;
+  if ( unpackedSliceBytes > 0 && memoryBudget / 4 / unpackedSliceBytes > 1 )
+  {
+    m_SlabDepth = memoryBudget / 4 / unpackedSliceBytes;
+  }
+  if ( m_SlabDepth > m_SizeZ && m_SizeZ > 0 )
+  {
+    m_SlabDepth = m_SizeZ;
+  }
+
+  const unsigned long slabBytes     = m_SlabDepth * packedSliceBytes;
+  const unsigned long readingBytes  = m_SlabDepth * unpackedSliceBytes;
+  m_MaximumNumberOfSlabs = 1;
+  if ( slabBytes > 0 && memoryBudget > readingBytes + slabBytes )
+  {
+    m_MaximumNumberOfSlabs = ( memoryBudget - readingBytes ) / slabBytes;
+  }
+
+  // Reserved once, so that the slabs never move.
+  m_Slabs.clear();
+  m_Slabs.reserve(m_MaximumNumberOfSlabs);
+  m_Clock             = 0;
+  m_NumberOfSlabReads = 0;
+  m_WholeReadReported = false;
+  m_FileName          = fileName;
+
+  m_Reader = ReaderType::New();
+  m_Reader->SetFileName(fileName.c_str());
+  m_Reader->SetImageIO(imageIO);
+
+  if ( ! imageIO->CanStreamRead() )
+  {
+    std::cerr << "Warning: " << fileName << " can not be read by parts;"
+              << " the whole image is read for each slab." << std::endl;
+  }
+  return true;
+}
+
+
+const MaskSlabCache::WordType* MaskSlabCache::GetSliceWords(unsigned int z)
+{
+  const unsigned int index = z / m_SlabDepth;
+
+  Slab* slab = 0;
+  for ( unsigned int i = 0; i < m_Slabs.size(); i++ )
+  {
+    if ( m_Slabs[i].index == index )
+    {
+      slab = &m_Slabs[i];
+      break;
+    }
+  }
+
+  if ( ! slab )
+  {
+    if ( m_Slabs.size() < m_MaximumNumberOfSlabs )
+    {
+      m_Slabs.push_back( Slab() );
+      slab = &m_Slabs.back();
+    } else
+    {
+      // Replace the least recently used slab.
+      slab = &m_Slabs[0];
+      for ( unsigned int i = 1; i < m_Slabs.size(); i++ )
+      {
+        if ( m_Slabs[i].lastUse < slab->lastUse )
+        {
+          slab = &m_Slabs[i];
+        }
+      }
+    }
+    this->ReadSlab(index, *slab);
+  }
+
+  slab->lastUse = ++m_Clock;
+  return slab->mask.GetSliceWords( z - index * m_SlabDepth );
+}
+
+
+void MaskSlabCache::ReadSlab(unsigned int index, Slab& slab)
+{
+  const unsigned int zBegin = index * m_SlabDepth;
+  unsigned int       depth  = m_SlabDepth;
+  if ( zBegin + depth > m_SizeZ )
+  {
+    depth = m_SizeZ - zBegin;
+  }
+
+  ImageType::IndexType regionIndex;
+  regionIndex[0] = 0;
+  regionIndex[1] = 0;
+  regionIndex[2] = zBegin;
+
+  ImageType::SizeType regionSize;
+  regionSize[0] = m_Layout.GetSizeX();
+  regionSize[1] = m_Layout.GetSizeY();
+  regionSize[2] = depth;
+
+  ImageType::RegionType region;
+  region.SetIndex(regionIndex);
+  region.SetSize(regionSize);
+
+  m_Reader->UpdateOutputInformation();
+  m_Reader->GetOutput()->SetRequestedRegion(region);
+  m_Reader->Update();
+
+  // The reader may have buffered more than the slab (when it can not
+  // stream), which breaks the memory budget: this is reported once, and
+  // the slab is located inside the buffered region.
+  const ImageType*             image    = m_Reader->GetOutput();
+  const ImageType::RegionType& buffered = image->GetBufferedRegion();
+  if ( ! buffered.IsInside(region) )
+  {
+    throw itk::ExceptionObject( __FILE__, __LINE__,
+                                "The reader did not read the slab requested.",
+                                "MaskSlabCache::ReadSlab" );
+  }
+  if ( ! ( buffered == region ) && ! m_WholeReadReported )
+  {
+    std::cerr << "Warning: " << m_FileName << " is read beyond the slabs requested ("
+              << buffered.GetSize()[2] << " slices instead of " << depth
+              << "): the memory budget is exceeded." << std::endl;
+    m_WholeReadReported = true;
+  }
+
+  const unsigned long  perSlice = static_cast<unsigned long>( regionSize[0] ) * regionSize[1];
+  const unsigned char* pixels   = image->GetBufferPointer() +
+    ( zBegin - buffered.GetIndex()[2] ) * perSlice;
+
+  slab.index = index;
+  if ( slab.mask.GetSizeZ() != m_SlabDepth )
+  {
+    slab.mask.Allocate( m_Layout.GetSizeX(), m_Layout.GetSizeY(), m_SlabDepth );
+  }
+  for ( unsigned int z = 0; z < depth; z++ )
+  {
+    slab.mask.PackSlice( z, pixels + z * perSlice, m_Threshold );
+  }
+
+  // Release the unpacked slab.
+  m_Reader->GetOutput()->ReleaseData();
+
+  m_NumberOfSlabReads++;
+}
@@ -0,0 +1,81 @@
+#ifndef __MaskSlabCache_h
+#define __MaskSlabCache_h
+
+#include <string>
+#include <vector>
+
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+
+#include "MaskSliceSource.h"
+
+// -------------------------------------------------------------
+// MaskSlabCache: gives access to the packed slices of a mask that is
+// too large to be read into memory at once.
+//
+// The mask is read from the disk as slabs of consecutive slices, each
+// slab being packed as soon as it has been read. The packed slabs are
+// kept in a least-recently-used cache; the slab depth and the number of
+// cached slabs are chosen so that the unpacked slab being read plus the
+// cached packed slabs stay within the given memory budget.
+//
+// A slab is read by requesting only its region from the image reader:
+// image formats whose ImageIO can stream (e.g. uncompressed MetaImage)
+// then read just the slab from the file. Other formats are still read
+// correctly, but whole, for every slab (which is reported on cerr).
+// -------------------------------------------------------------
+class MaskSlabCache : public MaskSliceSource
+{
+public:
+  typedef BitPackedMask::WordType WordType;
+
+  typedef itk::Image<unsigned char, 3>             ImageType;
+  typedef itk::ImageFileReader<ImageType>          ReaderType;
+
+  MaskSlabCache();
+
+  // Reads the header of the mask and sizes the cache for "memoryBudget"
+  // bytes. A voxel is inside the mask when its value is above "threshold".
+  // Returns false and fills "error" on failure.
+  bool Open(const std::string& fileName,
+            unsigned long      memoryBudget,
+            unsigned char      threshold,
+            std::string&       error);
+
+  const BitPackedMask& GetLayout() const { return m_Layout; }
+  unsigned int  GetSizeZ() const          { return m_SizeZ; }
+  const double* GetSpacing() const        { return m_Spacing; }
+
+  unsigned int GetSlabDepth() const            { return m_SlabDepth; }
+  unsigned int GetNumberOfCachedSlabs() const  { return m_Slabs.size(); }
+  unsigned long GetNumberOfSlabReads() const   { return m_NumberOfSlabReads; }
+
+  const WordType* GetSliceWords(unsigned int z);
+
+private:
+  struct Slab
+  {
+    unsigned int  index;   // slab number (first slice / slab depth)
+    unsigned long lastUse;
+    BitPackedMask mask;
+  };
+
+  void ReadSlab(unsigned int index, Slab& slab);
+
+  ReaderType::Pointer m_Reader;
+  std::string         m_FileName;
+  unsigned char       m_Threshold;
+
+  BitPackedMask       m_Layout;
+  unsigned int        m_SizeZ;
+  double              m_Spacing[3];
+
+  unsigned int        m_SlabDepth;
+  unsigned int        m_MaximumNumberOfSlabs;
+  std::vector<Slab>   m_Slabs;
+  unsigned long       m_Clock;
+  unsigned long       m_NumberOfSlabReads;
+  bool                m_WholeReadReported;
+};
+
+#endif // __MaskSlabCache_h
@@ -0,0 +1,27 @@
+#ifndef __MaskSliceSource_h
+#define __MaskSliceSource_h
+
+#include "BitPackedMask.h"
+
+// -------------------------------------------------------------
+// MaskSliceSource: a mask whose packed slices are produced on demand,
+// in increasing z order, instead of being held in memory all at once.
+// -------------------------------------------------------------
+class MaskSliceSource
+{
+public:
+  virtual ~MaskSliceSource() {}
+
+  // A mask with the x/y layout of the slices (and no slice), to use the
+  // slice functions of BitPackedMask on the slices returned below.
+  virtual const BitPackedMask& GetLayout() const = 0;
+
+  virtual unsigned int  GetSizeZ() const = 0;
+  virtual const double* GetSpacing() const = 0;
+
+  // Packed words of slice z, valid until the next call.
+  // Throws itk::ExceptionObject if the slice can not be read.
+  virtual const BitPackedMask::WordType* GetSliceWords(unsigned int z) = 0;
+};
+
+#endif // __MaskSliceSource_h
@@ -0,0 +1,553 @@
+#include "MeshSlicer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+// -------------------------------------------------------------
+// TriangleMesh
+// -------------------------------------------------------------
+
+bool TriangleMesh::Read(const std::string& fileName, std::string& error)
+{
+  m_Points.clear();
+  m_Triangles.clear();
+  m_PointIndex.clear();
+
+  std::string extension;
+  const std::string::size_type dot = fileName.rfind('.');
+  if ( dot != std::string::npos )
+  {
+    extension = fileName.substr(dot + 1);
+    for ( std::string::size_type i = 0; i < extension.length(); i++ )
+    {
+      extension[i] = static_cast<char>( tolower( extension[i] ) );
+    }
+  }
+
+  bool ok;
+  if ( extension == "stl" )
+  {
+    ok = this->ReadSTL(fileName, error);
+  } else if ( extension == "obj" )
+  {
+    ok = this->ReadOBJ(fileName, error);
+  } else
+  {
+    error = "Unknown mesh format (.stl or .obj expected): " + fileName;
+    ok = false;
+  }
+
+  // The point index is only needed while reading.
+  m_PointIndex.clear();
+
+  if ( ok && m_Triangles.empty() )
+  {
+    error = "The mesh does not contain any triangle: " + fileName;
+    ok = false;
+  }
+  return ok;
+}
+
+
+unsigned int TriangleMesh::AddPoint(double x, double y, double z)
+{
+  PointKey key;
+  key.x = x;
+  key.y = y;
+  key.z = z;
+
+  std::map<PointKey, unsigned int>::const_iterator it = m_PointIndex.find(key);
+  if ( it != m_PointIndex.end() )
+  {
+    return it->second;
+  }
+
+  const unsigned int index = static_cast<unsigned int>( m_Points.size() / 3 );
+  m_Points.push_back(x);
+  m_Points.push_back(y);
+  m_Points.push_back(z);
+  m_PointIndex[key] = index;
+  return index;
+}
+
+
+void TriangleMesh::AddTriangle(unsigned int a, unsigned int b, unsigned int c)
+{
+  // Degenerate triangles (after merging the vertices) do not cut any plane
+  // in a useful way.
+  if ( a == b || b == c || c == a )
+  {
+    return;
+  }
+  m_Triangles.push_back(a);
+  m_Triangles.push_back(b);
+  m_Triangles.push_back(c);
+}
+
+
+// Reads a little-endian 32-bit value, independently of the host byte order.
+static unsigned int ReadLittleEndian32(const unsigned char* bytes)
+{
+  return   static_cast<unsigned int>( bytes[0] )
+         | ( static_cast<unsigned int>( bytes[1] ) << 8 )
+         | ( static_cast<unsigned int>( bytes[2] ) << 16 )
+         | ( static_cast<unsigned int>( bytes[3] ) << 24 );
+}
+
+
+bool TriangleMesh::ReadSTL(const std::string& fileName, std::string& error)
+{
+  std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+  if ( ! file.is_open() )
+  {
+    error = "Unable to open the mesh file: " + fileName;
+    return false;
+  }
+
+  file.seekg(0, std::ios::end);
+  const unsigned long fileSize = static_cast<unsigned long>( file.tellg() );
+  file.seekg(0, std::ios::beg);
+
+  // A binary STL is an 80 byte header, a triangle count and 50 bytes per
+  // triangle. Anything else is read as an ASCII STL.
+  unsigned char header[84];
+  bool binary = false;
+  unsigned int numberOfTriangles = 0;
+
+  if ( fileSize >= 84 && file.read(reinterpret_cast<char*>(header), 84) )
+  {
+    numberOfTriangles = ReadLittleEndian32(header + 80);
+    binary = ( fileSize == 84 + 50 * static_cast<unsigned long>( numberOfTriangles ) );
+  }
+
+  if ( binary )
+  {
+    unsigned char record[50];
+    for ( unsigned int t = 0; t < numberOfTriangles; t++ )
+    {
+      if ( ! file.read(reinterpret_cast<char*>(record), 50) )
+      {
+        error = "Truncated binary STL file: " + fileName;
+        return false;
+      }
+
+      // record: normal (3 floats), 3 vertices (3 floats each), attribute.
+      unsigned int vertex[3];
+      for ( unsigned int v = 0; v < 3; v++ )
+      {
+        float coordinates[3];
+        for ( unsigned int c = 0; c < 3; c++ )
+        {
+          const unsigned int bits = ReadLittleEndian32(record + 12 + 12 * v + 4 * c);
+          memcpy(&coordinates[c], &bits, sizeof(float));
+        }
+        vertex[v] = this->AddPoint(coordinates[0], coordinates[1], coordinates[2]);
+      }
+      this->AddTriangle(vertex[0], vertex[1], vertex[2]);
+    }
+    return true;
+  }
+
+  // ASCII STL: only the "vertex x y z" lines matter, three per facet.
+  file.clear();
+  file.seekg(0, std::ios::beg);
+
+  std::string  token;
+  unsigned int vertex[3];
+  unsigned int numberOfVertices = 0;
+
+  while ( file >> token )
+  {
+    if ( token != "vertex" )
+    {
+      continue;
+    }
+
+    double x, y, z;
+    if ( ! ( file >> x >> y >> z ) )
+    {
+      error = "Invalid vertex in the ASCII STL file: " + fileName;
+      return false;
+    }
+
+    vertex[numberOfVertices++] = this->AddPoint(x, y, z);
+    if ( numberOfVertices == 3 )
+    {
+      this->AddTriangle(vertex[0], vertex[1], vertex[2]);
+      numberOfVertices = 0;
+    }
+  }
+  return true;
+}
+
+
+bool TriangleMesh::ReadOBJ(const std::string& fileName, std::string& error)
+{
+  std::ifstream file(fileName.c_str());
+  if ( ! file.is_open() )
+  {
+    error = "Unable to open the mesh file: " + fileName;
+    return false;
+  }
+
+  // OBJ vertex number (from 1) -> merged vertex index.
+  std::vector<unsigned int> objVertices;
+
+  std::string line;
+  while ( std::getline(file, line) )
+  {
+    std::istringstream stream(line);
+    std::string        keyword;
+    stream >> keyword;
+
+    if ( keyword == "v" )
+    {
+      double x, y, z;
+      if ( ! ( stream >> x >> y >> z ) )
+      {
+        error = "Invalid vertex in the OBJ file: " + fileName;
+        return false;
+      }
+      objVertices.push_back( this->AddPoint(x, y, z) );
+    } else if ( keyword == "f" )
+    {
+      // Faces are "f v1 v2 v3 ...", each entry possibly "v/vt/vn";
+      // negative numbers are relative to the last vertex read.
+      std::vector<unsigned int> face;
+      std::string entry;
+      while ( stream >> entry )
+      {
+        const long number = atol( entry.c_str() );
+        const long index  = ( number < 0 ) ? static_cast<long>( objVertices.size() ) + number
+                                           : number - 1;
+        if ( number == 0 || index < 0 || index >= static_cast<long>( objVertices.size() ) )
+        {
+          error = "Invalid face in the OBJ file: " + fileName;
+          return false;
+        }
+        face.push_back( objVertices[index] );
+      }
+
+      // Polygonal faces are split into a fan of triangles.
+      for ( unsigned int i = 2; i < face.size(); i++ )
+      {
+        this->AddTriangle(face[0], face[i-1], face[i]);
+      }
+    }
+  }
+  return true;
+}
+
+
+void TriangleMesh::TransformToIndexSpace(const double origin[3],
+                                         const double spacing[3])
+{
+  for ( unsigned long i = 0; i < m_Points.size(); i += 3 )
+  {
+    for ( unsigned int c = 0; c < 3; c++ )
+    {
+      m_Points[i + c] = ( m_Points[i + c] - origin[c] ) / spacing[c];
+    }
+  }
+}
+
+
+// -------------------------------------------------------------
+// MeshSlicer
+// -------------------------------------------------------------
+
+namespace
+{
+
+// An intersection segment of one triangle with the plane. Its end points
+// lie on two edges of the triangle; the edges are identified by the
+// (ordered) indices of their vertices, which are shared with the
+// neighbouring triangles.
+struct Segment
+{
+  unsigned long long startEdge;
+  unsigned long long endEdge;
+  double             start[2];
+  double             end[2];
+};
+
+typedef std::pair<unsigned long long, unsigned long> EdgeEntry;
+
+unsigned long long EdgeKey(unsigned int a, unsigned int b)
+{
+  if ( a > b )
+  {
+    std::swap(a, b);
+  }
+  return ( static_cast<unsigned long long>( a ) << 32 ) | b;
+}
+
+// Index of the first unused segment starting on "edge", or "none".
+unsigned long FindUnusedSegment(const std::vector<EdgeEntry>& startEdges,
+                                const std::vector<bool>&      used,
+                                unsigned long long            edge,
+                                unsigned long                 none)
+{
+  std::vector<EdgeEntry>::const_iterator it =
+    std::lower_bound( startEdges.begin(), startEdges.end(), EdgeEntry(edge, 0) );
+
+  for ( ; it != startEdges.end() && it->first == edge; ++it )
+  {
+    if ( ! used[it->second] )
+    {
+      return it->second;
+    }
+  }
+  return none;
+}
+
+} // end anonymous namespace
+
+
+MeshSlicer::MeshSlicer()
+  : m_Mesh(0), m_NumberOfSlices(0), m_NumberOfThreads(1)
+{
+}
+
+
+void MeshSlicer::BinTriangles()
+{
+  const unsigned long numberOfTriangles = m_Mesh->GetNumberOfTriangles();
+
+  // Plane k is crossed by a triangle when  zmin < k <= zmax : a vertex
+  // lying exactly on a plane is considered to be above it.
+  std::vector<int> firstPlane(numberOfTriangles);
+  std::vector<int> lastPlane(numberOfTriangles);
+
+  m_BinStart.assign( m_NumberOfSlices + 1, 0 );
+
+  for ( unsigned long t = 0; t < numberOfTriangles; t++ )
+  {
+    const unsigned int* triangle = m_Mesh->GetTriangle(t);
+
+    double zMin = m_Mesh->GetPoint( triangle[0] )[2];
+    double zMax = zMin;
+    for ( unsigned int v = 1; v < 3; v++ )
+    {
+      const double z = m_Mesh->GetPoint( triangle[v] )[2];
+      zMin = std::min(zMin, z);
+      zMax = std::max(zMax, z);
+    }
+
+    int kMin = static_cast<int>( floor(zMin) ) + 1;
+    int kMax = static_cast<int>( floor(zMax) );
+    kMin = std::max(kMin, 0);
+    kMax = std::min(kMax, static_cast<int>( m_NumberOfSlices ) - 1);
+
+    firstPlane[t] = kMin;
+    lastPlane[t]  = kMax;
+
+    for ( int k = kMin; k <= kMax; k++ )
+    {
+      m_BinStart[k + 1]++;
+    }
+  }
+
+  // Counts -> offsets, then fill the bins.
+  for ( unsigned int k = 0; k < m_NumberOfSlices; k++ )
+  {
+    m_BinStart[k + 1] += m_BinStart[k];
+  }
+
+  m_BinTriangles.resize( m_BinStart[m_NumberOfSlices] );
+  std::vector<unsigned long> fill( m_BinStart.begin(), m_BinStart.end() - 1 );
+
+  for ( unsigned long t = 0; t < numberOfTriangles; t++ )
+  {
+    for ( int k = firstPlane[t]; k <= lastPlane[t]; k++ )
+    {
+      m_BinTriangles[ fill[k]++ ] = t;
+    }
+  }
+}
+
+
+void MeshSlicer::Update()
+{
+  m_Slices.clear();
+  m_Slices.resize( m_NumberOfSlices );
+
+  if ( m_Mesh == 0 || m_NumberOfSlices == 0 )
+  {
+    return;
+  }
+
+  this->BinTriangles();
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  if ( m_NumberOfThreads > 0 )
+  {
+    threader->SetNumberOfThreads( m_NumberOfThreads );
+  }
+  threader->SetSingleMethod( MeshSlicer::SliceThreadCallback, this );
+  threader->SingleMethodExecute();
+}
+
+
+ITK_THREAD_RETURN_TYPE MeshSlicer::SliceThreadCallback(void* arg)
+{
+  itk::MultiThreader::ThreadInfoStruct* info =
+    static_cast<itk::MultiThreader::ThreadInfoStruct*>( arg );
+  MeshSlicer* self = static_cast<MeshSlicer*>( info->UserData );
+
+  // Interleaved planes: the cost of the planes varies a lot along z.
+  for ( unsigned int k = info->ThreadID; k < self->m_NumberOfSlices;
+        k += info->NumberOfThreads )
+  {
+    self->SliceOnePlane(k);
+  }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+void MeshSlicer::SliceOnePlane(unsigned int slice)
+{
+  const double z = slice;
+
+  std::vector<Segment> segments;
+  segments.reserve( m_BinStart[slice + 1] - m_BinStart[slice] );
+
+  for ( unsigned long b = m_BinStart[slice]; b < m_BinStart[slice + 1]; b++ )
+  {
+    const unsigned int* triangle = m_Mesh->GetTriangle( m_BinTriangles[b] );
+
+    bool above[3];
+    for ( unsigned int v = 0; v < 3; v++ )
+    {
+      above[v] = ( m_Mesh->GetPoint( triangle[v] )[2] >= z );
+    }
+
+    // Walking around the triangle in its winding order, the segment starts
+    // on the edge going upwards and ends on the edge going downwards. For
+    // counter-clockwise (outward) winding, this orients the outer
+    // boundaries like the contour extractor does.
+    Segment segment;
+    unsigned int numberOfCrossings = 0;
+
+    for ( unsigned int v = 0; v < 3; v++ )
+    {
+      const unsigned int a = triangle[v];
+      const unsigned int c = triangle[(v + 1) % 3];
+      if ( above[v] == above[(v + 1) % 3] )
+      {
+        continue;
+      }
+
+      const double* pa = m_Mesh->GetPoint(a);
+      const double* pc = m_Mesh->GetPoint(c);
+      const double  t  = ( z - pa[2] ) / ( pc[2] - pa[2] );
+
+      double* point = above[v] ? segment.end : segment.start;
+      point[0] = pa[0] + t * ( pc[0] - pa[0] );
+      point[1] = pa[1] + t * ( pc[1] - pa[1] );
+
+      if ( above[v] )
+      {
+        segment.endEdge = EdgeKey(a, c);
+      } else
+      {
+        segment.startEdge = EdgeKey(a, c);
+      }
+      numberOfCrossings++;
+    }
+
+    if ( numberOfCrossings == 2 )
+    {
+      segments.push_back(segment);
+    }
+  }
+
+  // Link the segments: the end edge of a segment is the start edge of the
+  // next one (in the neighbouring triangle).
+  const unsigned long none = segments.size();
+
+  std::vector<EdgeEntry> startEdges( segments.size() );
+  std::vector<unsigned long long> endEdges( segments.size() );
+  for ( unsigned long i = 0; i < segments.size(); i++ )
+  {
+    startEdges[i] = EdgeEntry( segments[i].startEdge, i );
+    endEdges[i]   = segments[i].endEdge;
+  }
+  std::sort( startEdges.begin(), startEdges.end() );
+  std::sort( endEdges.begin(), endEdges.end() );
+
+  // Open chains (holes in the mesh) are followed from their first segment,
+  // i.e. one whose start edge is not the end of any other segment; the
+  // remaining segments form closed loops.
+  std::vector<unsigned long> order;
+  order.reserve( segments.size() );
+  for ( unsigned long i = 0; i < segments.size(); i++ )
+  {
+    if ( ! std::binary_search( endEdges.begin(), endEdges.end(), segments[i].startEdge ) )
+    {
+      order.push_back(i);
+    }
+  }
+  for ( unsigned long i = 0; i < segments.size(); i++ )
+  {
+    order.push_back(i);
+  }
+
+  std::vector<bool> used( segments.size(), false );
+  SlicePolygons&    polygons = m_Slices[slice];
+
+  for ( unsigned long o = 0; o < order.size(); o++ )
+  {
+    const unsigned long first = order[o];
+    if ( used[first] )
+    {
+      continue;
+    }
+
+    Polygon polygon;
+    polygon.closed = false;
+
+    unsigned long current = first;
+    while ( true )
+    {
+      used[current] = true;
+      const Segment& segment = segments[current];
+
+      // Skip the repeated points of degenerate segments.
+      const unsigned long n = polygon.xy.size();
+      if ( n < 2 || polygon.xy[n-2] != segment.start[0] || polygon.xy[n-1] != segment.start[1] )
+      {
+        polygon.xy.push_back( segment.start[0] );
+        polygon.xy.push_back( segment.start[1] );
+      }
+
+      const unsigned long next =
+        FindUnusedSegment( startEdges, used, segment.endEdge, none );
+
+      if ( next == none )
+      {
+        if ( segment.endEdge == segments[first].startEdge )
+        {
+          polygon.closed = true;
+        } else
+        {
+          polygon.xy.push_back( segment.end[0] );
+          polygon.xy.push_back( segment.end[1] );
+        }
+        break;
+      }
+      current = next;
+    }
+
+    const unsigned long numberOfPoints = polygon.xy.size() / 2;
+    if ( numberOfPoints >= ( polygon.closed ? 3u : 2u ) )
+    {
+      polygons.push_back(polygon);
+    }
+  }
+}
@@ -0,0 +1,115 @@
+#ifndef __MeshSlicer_h
+#define __MeshSlicer_h
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "itkMultiThreader.h"
+
+// -------------------------------------------------------------
+// TriangleMesh: an indexed triangle mesh read from an STL (ASCII or
+// binary) or a Wavefront OBJ file. Vertices that share the same
+// coordinates are merged while reading, so that the slicer can link the
+// intersection segments of neighbouring triangles.
+// -------------------------------------------------------------
+class TriangleMesh
+{
+public:
+  // Reads an ".stl" or ".obj" file (chosen from the file extension).
+  // Returns false and fills "error" on failure.
+  bool Read(const std::string& fileName, std::string& error);
+
+  // Maps the physical coordinates to continuous index coordinates of an
+  // image with the given origin and spacing (identity direction),
+  // i.e. x' = (x - origin) / spacing.
+  void TransformToIndexSpace(const double origin[3], const double spacing[3]);
+
+  unsigned long GetNumberOfVertices() const  { return m_Points.size() / 3; }
+  unsigned long GetNumberOfTriangles() const { return m_Triangles.size() / 3; }
+
+  const double*       GetPoint(unsigned long i) const    { return &m_Points[3 * i]; }
+  const unsigned int* GetTriangle(unsigned long i) const { return &m_Triangles[3 * i]; }
+
+private:
+  bool ReadSTL(const std::string& fileName, std::string& error);
+  bool ReadOBJ(const std::string& fileName, std::string& error);
+
+  // Returns the index of the vertex at (x,y,z), adding it if needed.
+  unsigned int AddPoint(double x, double y, double z);
+  void         AddTriangle(unsigned int a, unsigned int b, unsigned int c);
+
+  std::vector<double>       m_Points;    // x,y,z of each vertex
+  std::vector<unsigned int> m_Triangles; // 3 vertex indices per triangle
+
+  // Used only while reading, to merge duplicated vertices.
+  struct PointKey
+  {
+    double x, y, z;
+    bool operator<(const PointKey& o) const
+      {
+      if ( x != o.x ) { return x < o.x; }
+      if ( y != o.y ) { return y < o.y; }
+      return z < o.z;
+      }
+  };
+  std::map<PointKey, unsigned int> m_PointIndex;
+};
+
+
+// -------------------------------------------------------------
+// MeshSlicer: intersects a triangle mesh, given in index coordinates,
+// with the planes z = 0, 1, ..., numberOfSlices-1 and links the
+// intersection segments of each plane into polygons.
+//
+// The triangles are first binned by the range of planes they cross,
+// so that each plane only visits the triangles that actually cut it.
+// The planes are then processed in parallel.
+//
+// The polygons are oriented like the contours of
+// ContourExtractor2DImageFilter with ReverseContourOrientationOn():
+// outer boundaries have a negative signed area and holes a positive one
+// (for a mesh whose triangles are wound counter-clockwise seen from the
+// outside).
+// -------------------------------------------------------------
+class MeshSlicer
+{
+public:
+  struct Polygon
+  {
+    std::vector<double> xy;     // x0,y0, x1,y1, ... (not repeated at the end)
+    bool                closed;
+  };
+  typedef std::vector<Polygon> SlicePolygons;
+
+  MeshSlicer();
+
+  void SetMesh(const TriangleMesh* mesh)        { m_Mesh = mesh; }
+  void SetNumberOfSlices(unsigned int n)        { m_NumberOfSlices = n; }
+  void SetNumberOfThreads(unsigned int n)       { m_NumberOfThreads = n; }
+
+  // Slices the mesh.
+  void Update();
+
+  const SlicePolygons& GetSlicePolygons(unsigned int slice) const
+    { return m_Slices[slice]; }
+
+private:
+  void BinTriangles();
+  void SliceOnePlane(unsigned int slice);
+
+  static ITK_THREAD_RETURN_TYPE SliceThreadCallback(void* arg);
+
+  const TriangleMesh* m_Mesh;
+  unsigned int        m_NumberOfSlices;
+  unsigned int        m_NumberOfThreads;
+
+  // Triangles crossing plane k are
+  // m_BinTriangles[ m_BinStart[k] ... m_BinStart[k+1]-1 ].
+  std::vector<unsigned long> m_BinStart;
+  std::vector<unsigned long> m_BinTriangles;
+
+  std::vector<SlicePolygons> m_Slices;
+};
+
+#endif // __MeshSlicer_h
@@ -0,0 +1,131 @@
+#ifndef __SliceContourCache_h
+#define __SliceContourCache_h
+
+#include <algorithm>
+#include <vector>
+
+#include "BitPackedMask.h"
+
+// -------------------------------------------------------------
+// SliceContourCache: remembers the contours extracted from the last
+// distinct packed slices, so that a slice identical to one of them (as in
+// the long runs of identical slices of extrapolated or padded masks) does
+// not go through the contour extractor again.
+//
+// The contours are kept in index coordinates of the slice, so they are
+// valid for any slice with the same content: only the z coordinate,
+// computed when they are written, differs.
+//
+// A slice is looked up by a hash of its words; a hit is always confirmed
+// by comparing the words themselves. When the cache is full, the oldest
+// entry is replaced.
+//
+// TSlicePolylines is the (copyable) container of the contours of a slice.
+// -------------------------------------------------------------
+template <class TSlicePolylines>
+class SliceContourCache
+{
+public:
+  typedef BitPackedMask::WordType WordType;
+  typedef unsigned long long      HashType;
+
+  explicit SliceContourCache(unsigned int maximumNumberOfSlices = 64)
+    : m_MaximumNumberOfSlices(maximumNumberOfSlices), m_Oldest(0),
+      m_NumberOfHits(0) {}
+
+  static HashType Hash(const WordType* words, unsigned long numberOfWords);
+
+  // Returns the contours of a slice identical to "words", or 0.
+  const TSlicePolylines* Find(const WordType* words,
+                              unsigned long   numberOfWords,
+                              HashType        hash);
+
+  void Insert(const WordType*        words,
+              unsigned long          numberOfWords,
+              HashType               hash,
+              const TSlicePolylines& polylines);
+
+  unsigned long GetNumberOfHits() const { return m_NumberOfHits; }
+
+private:
+  struct Entry
+  {
+    HashType              hash;
+    std::vector<WordType> words;
+    TSlicePolylines       polylines;
+  };
+
+  unsigned int       m_MaximumNumberOfSlices;
+  unsigned int       m_Oldest;
+  unsigned long      m_NumberOfHits;
+  std::vector<Entry> m_Entries;
+};
+
+
+template <class TSlicePolylines>
+typename SliceContourCache<TSlicePolylines>::HashType
+SliceContourCache<TSlicePolylines>::Hash(const WordType* words,
+                                         unsigned long   numberOfWords)
+{
+  // FNV-1a over whole words, followed by a final avalanche.
+  HashType hash = 0xcbf29ce484222325ULL;
+  for ( unsigned long i = 0; i < numberOfWords; i++ )
+  {
+    hash = ( hash ^ words[i] ) * 0x100000001b3ULL;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+
+template <class TSlicePolylines>
+const TSlicePolylines*
+SliceContourCache<TSlicePolylines>::Find(const WordType* words,
+                                         unsigned long   numberOfWords,
+                                         HashType        hash)
+{
+  for ( unsigned int i = 0; i < m_Entries.size(); i++ )
+  {
+    const Entry& entry = m_Entries[i];
+    if ( entry.hash == hash &&
+         entry.words.size() == numberOfWords &&
+         std::equal( entry.words.begin(), entry.words.end(), words ) )
+    {
+      m_NumberOfHits++;
+      return &entry.polylines;
+    }
+  }
+  return 0;
+}
+
+
+template <class TSlicePolylines>
+void SliceContourCache<TSlicePolylines>::Insert(const WordType*        words,
+                                                unsigned long          numberOfWords,
+                                                HashType               hash,
+                                                const TSlicePolylines& polylines)
+{
+  if ( m_MaximumNumberOfSlices == 0 )
+  {
+    return;
+  }
+
+  Entry* entry;
+  if ( m_Entries.size() < m_MaximumNumberOfSlices )
+  {
+    m_Entries.push_back( Entry() );
+    entry = &m_Entries.back();
+  } else
+  {
+    entry    = &m_Entries[m_Oldest];
+    m_Oldest = ( m_Oldest + 1 ) % m_MaximumNumberOfSlices;
+  }
+
+  entry->hash = hash;
+  entry->words.assign( words, words + numberOfWords );
+  entry->polylines = polylines;
+}
+
+#endif // __SliceContourCache_h
@@ -1,24 +1,56 @@
 #include "itkImage.h"
 #include "itkImageFileReader.h"
 
-//To extract axial slices of the 3D image
-#include "itkExtractImageFilter.h"
-
 //To extract contours from axial slices
 #include "itkContourExtractor2DImageFilter.h"
 
+//The mask is kept in memory with one bit per voxel
+#include "BitPackedMask.h"
+
+//Boolean algebra over several masks
+#include "MaskExpression.h"
+
+//Contours of a triangle mesh, instead of a mask
+#include "MeshSlicer.h"
+#include "itkImageIOFactory.h"
+
+//Splitting of a mask into its connected components
+#include "ConnectedComponents.h"
+
+//Outer/inner nesting of the contours of a slice
+#include "ContourNesting.h"
+
+//Reuse of the contours of identical slices
+#include "SliceContourCache.h"
+
+//Masks read by slabs, within a memory budget
+#include "MaskSlabCache.h"
+
+//Chunked compressed masks, inflated in parallel
+#include "ChunkedMaskFile.h"
+
+//Coordinates written as DICOM Decimal Strings (shared with export2RTSTRUCT)
+#include "DecimalStringEncoder.h"
+
+#include "itkMultiThreader.h"
+
 #include <cmath> // for using fabs()
 #include <fstream>
 #include <iostream>
 #include <iomanip> //format manipulation
+#include <sstream>
 #include <stdio.h> // for deleting a temporary text file
+#include <algorithm>
+#include <utility>
 #include <vector>
 
 using std::cerr;
+using std::cout;
 using std::endl;
 using std::ios;
 using std::ifstream;
 using std::ofstream;
+using std::ostream;
 using std::string;
 
 
@@ -37,15 +69,28 @@ const string CLOSED_PLANAR( "CLOSED_PLANAR" );
 // Any deviation below the FLOAT_EPSILON value is neglected.
 const float FLOAT_EPSILON = 0.0001;
 
-// The following is the precision used while writing
-// the coordinates of the contours to a text file.
+// The following is the precision (number of significant digits) used
+// while writing the statistics of the contours to a text file.
 const unsigned int precision = 16;
 
+// The coordinates of the contours are written as DICOM Decimal Strings
+// (at most 16 characters), rounded by default to 0.001 mm (see -precision).
+const double defaultCoordinatePrecision = 0.001;
+
 //Set the contour value to be extracted. 
 const double contourValue = 100.0;
 
-// Global variable to count the total number of contours
-unsigned int TOTAL_NUMBER_OF_CONTOURS = 0;
+// While packing the mask, a voxel is considered to be inside the
+// structure if its value is above the contour value.
+const PixelType maskThreshold = static_cast<PixelType>( contourValue );
+
+// Value given to the inside voxels when a packed slice is expanded
+// again for the contour extractor (the background is set to 0).
+const PixelType maskOnValue = 255;
+
+// Number of slices of the slabs of the chunked mask files written with
+// -write-chunked (each slab is compressed, and later inflated, on its own).
+const unsigned int chunkedMaskSlabDepth = 8;
 
 // -------------------------------------------------------------
 
@@ -53,39 +98,145 @@ unsigned int TOTAL_NUMBER_OF_CONTOURS = 0;
 typedef itk::Image<PixelType, ImageDimension>  InputImageType;
 typedef itk::Image<PixelType, SliceDimension>  ImageSliceType;
 
-typedef itk::ExtractImageFilter<InputImageType, ImageSliceType> SliceExtractorType;
 typedef itk::ContourExtractor2DImageFilter<ImageSliceType>      ContourExtractorType;
 
 typedef ContourExtractorType::VertexType VertexType;
 
+// The contours of one slice, with their vertices in index coordinates.
+// As for the contour extractor outputs, the last vertex of a closed
+// contour repeats its first vertex.
+typedef std::vector<VertexType>   PolylineType;
+typedef std::vector<PolylineType> SlicePolylinesType;
+
 typedef itk::ImageFileReader<InputImageType> ImageReaderType;
+
+// Geometry of one written contour (in mm, in the coordinates written to
+// the output file), kept for the -stats sidecar file.
+struct ContourStatisticsType
+{
+  unsigned int slice;
+  bool         closed;
+  unsigned int numberOfPoints;
+  double       area;           // 0 for an open contour
+  bool         hole;           // closed contour bounding a hole
+  double       perimeter;      // length of the polyline for an open contour
+  double       centroid[3];
+  double       boundingBox[4]; // x-min, x-max, y-min, y-max
+};
+typedef std::vector<ContourStatisticsType> StructureStatisticsType;
+
+typedef ContourNesting<PolylineType> ContourNestingType;
+
+typedef SliceContourCache<SlicePolylinesType> SliceContourCacheType;
+
+// The masks read slice by slice, deleted with the list.
+struct MaskSliceSourceList
+{
+  std::vector<MaskSliceSource*> items;
+
+  ~MaskSliceSourceList()
+  {
+    for ( unsigned int i = 0; i < items.size(); i++ )
+    {
+      delete items[i];
+    }
+  }
+};
+
+// The contours of the components (-components), deleted with the list.
+struct ComponentContourList
+{
+  std::vector<std::ostringstream*> items;
+
+  ~ComponentContourList()
+  {
+    for ( unsigned int i = 0; i < items.size(); i++ )
+    {
+      delete items[i];
+    }
+  }
+};
 // -------------------------------------------------------------
 
 // Forward declaration of the functions.
 // -------------------------------------------------------------
-void WriteContourVertices(ofstream&                     file1,
-                          ContourExtractorType::Pointer contourExtractFilter,
-                          const unsigned int            currentSlice,
-                          const int                     offset_index[],
-                          const double                  spacing[]);
+void PrintUsage(const char* programName);
+
+bool ReadMask(const char*    fileName,
+              BitPackedMask& mask,
+              double         spacing[],
+              unsigned int   numberOfThreads);
+
+bool ReadImageGeometry(const char*   fileName,
+                       unsigned int  size[],
+                       double        spacing[],
+                       double        origin[]);
+
+void PackInputImage(const InputImageType* image, BitPackedMask& mask);
+
+void ExtractSliceContours(const BitPackedMask&            mask,
+                          const BitPackedMask::WordType*  sliceWords,
+                          ImageSliceType*                 sliceImage,
+                          ContourExtractorType*           contourExtractFilter,
+                          SliceContourCacheType&          cache,
+                          SlicePolylinesType&             polylines);
+
+void ConvertMeshPolygons(const MeshSlicer::SlicePolygons& polygons,
+                         SlicePolylinesType&              polylines);
+
+void WriteContourVertices(ostream&                    file1,
+                          const SlicePolylinesType&   polylines,
+                          const unsigned int          currentSlice,
+                          const int                   offset_index[],
+                          const double                spacing[],
+                          const DecimalStringEncoder& encoder,
+                          unsigned int&               numberOfContours,
+                          StructureStatisticsType*    statistics,
+                          ContourNestingType*         nesting);
+
+void ComputeContourStatistics(const PolylineType&    vertices,
+                              const unsigned int     numPoints,
+                              const bool             closed,
+                              const unsigned int     currentSlice,
+                              const int              offset_index[],
+                              const double           spacing[],
+                              const double           zValue,
+                              ContourStatisticsType& stats);
+
+bool WriteStatisticsFile(const string&                  fileName,
+                         const StructureStatisticsType& statistics,
+                         const double                   spacing[]);
 
 void WriteCommonData(const unsigned int sliceNumber,
                      const unsigned int numContourPoints,
                      const string       geometricType,
-                     ofstream&          file1);
-
-void WriteVertexCoordinates(const        VertexType vertex, 
-                            const int    offset_index[],
-                            const double spacing[],
-                            const double zValue,
-                            ofstream&    file1);
-
-void WriteLastVertexCoordinates(const        VertexType vertex, 
-                                const int    offset_index[],
-                                const double spacing[],
-                                const double zValue,
-                                ofstream&    file1);
-void AppendTextFile(const char* file1, const char* outputFile);
+                     const int          parentContour,
+                     ostream&           file1);
+
+void WriteVertexCoordinates(const VertexType            vertex,
+                            const int                   offset_index[],
+                            const double                spacing[],
+                            const double                zValue,
+                            const DecimalStringEncoder& encoder,
+                            ostream&                    file1);
+
+void WriteLastVertexCoordinates(const VertexType            vertex,
+                                const int                   offset_index[],
+                                const double                spacing[],
+                                const double                zValue,
+                                const DecimalStringEncoder& encoder,
+                                ostream&                    file1);
+void AppendTextFile(const char*  file1,
+                    const char*  outputFile,
+                    unsigned int numberOfContours);
+
+string ComponentFileName(const string& outputFileName, unsigned int component);
+
+bool WriteComponentFiles(const string&                         outputFileName,
+                         const std::vector<std::ostringstream*>& contours,
+                         const std::vector<unsigned int>&        numberOfContours);
+
+bool WriteIndexFile(const string& contourFileName, unsigned int numberOfSlices);
 // -------------------------------------------------------------
 
 int main(int argc, char *argv[])
@@ -93,9 +244,7 @@ int main(int argc, char *argv[])
   if( argc < 6 )
   {
     cerr << "Missing Parameters... " << endl;
-    cerr << "Usage: " << argv[0];
-    cerr << " <input-image>  <output-file>";
-    cerr << " <x-offset-index>  <y-offset-index> <z-offset-index>" << endl;
+    PrintUsage(argv[0]);
     return EXIT_FAILURE;
   }
 
@@ -103,71 +252,494 @@ int main(int argc, char *argv[])
   const char* outputFileName  = argv[2];
   const int   offset_index[3] = { atoi(argv[3]), atoi(argv[4]), atoi(argv[5]) };
 
-  const char* tempFileName   = "temp_junk_file.txt";
+  // Optional arguments.
+  // <input-image> is always the first mask ("m1") of the expression.
+  std::vector<string> maskFileNames(1, inputFileName);
+  string              expressionText;
+  string              meshFileName;
+  string              statisticsFileName;
+  string              chunkedFileName;
+  unsigned int        numberOfThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+  bool                splitComponents = false;
+  bool                fullyConnected  = false;
+  bool                writeNesting    = false;
+  bool                writeIndex      = false;
+  unsigned long       memoryBudgetMB  = 0;
+  double              coordinatePrecision = defaultCoordinatePrecision;
+
+  for ( int arg = 6; arg < argc; arg++ )
+  {
+    const string option = argv[arg];
 
-  // Make sure that the <output-file> can be opened. 
-  ofstream file1(tempFileName, ios::trunc);
-  if ( ! file1.is_open() )
+    if ( option == "-mask" && arg + 1 < argc )
+    {
+      maskFileNames.push_back( argv[++arg] );
+    } else if ( option == "-expr" && arg + 1 < argc )
+    {
+      expressionText = argv[++arg];
+    } else if ( option == "-mesh" && arg + 1 < argc )
+    {
+      meshFileName = argv[++arg];
+    } else if ( option == "-threads" && arg + 1 < argc )
+    {
+      // ITK runs ITK_MAX_THREADS threads at most.
+      numberOfThreads = std::min( std::max( 1, atoi( argv[++arg] ) ), ITK_MAX_THREADS );
+    } else if ( option == "-stats" && arg + 1 < argc )
+    {
+      statisticsFileName = argv[++arg];
+    } else if ( option == "-precision" && arg + 1 < argc )
+    {
+      coordinatePrecision = atof( argv[++arg] );
+      if ( ! DecimalStringEncoder::IsValidPrecision( coordinatePrecision ) )
+      {
+        cerr << "The precision must be a positive number: " << argv[arg] << endl;
+        return EXIT_FAILURE;
+      }
+    } else if ( option == "-memory" && arg + 1 < argc )
+    {
+      memoryBudgetMB = atol( argv[++arg] );
+    } else if ( option == "-write-chunked" && arg + 1 < argc )
+    {
+      chunkedFileName = argv[++arg];
+    } else if ( option == "-nesting" )
+    {
+      writeNesting = true;
+    } else if ( option == "-index" )
+    {
+      writeIndex = true;
+    } else if ( option == "-components" )
+    {
+      splitComponents = true;
+    } else if ( option == "-fully-connected" )
+    {
+      fullyConnected = true;
+    } else
+    {
+      cerr << "Unknown or incomplete option: " << option << endl;
+      PrintUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if ( maskFileNames.size() > 1 && expressionText.empty() )
   {
-    cerr << "Unable to open the text file:  "
-         << outputFileName << endl;
+    cerr << "Several masks are given: -expr is required to combine them." << endl;
     return EXIT_FAILURE;
   }
 
-  ImageReaderType::Pointer reader = ImageReaderType::New();
-  reader->SetFileName(inputFileName);
+  const bool useMesh = ! meshFileName.empty();
+  if ( useMesh && maskFileNames.size() > 1 )
+  {
+    cerr << "-mesh can not be combined with -mask/-expr." << endl;
+    return EXIT_FAILURE;
+  }
+  if ( useMesh && splitComponents )
+  {
+    cerr << "-components can only be used with masks." << endl;
+    return EXIT_FAILURE;
+  }
 
-  try 
-  { 
-    reader->Update();
-  } 
-  catch( itk::ExceptionObject & err ) 
-  { 
-    cerr << "ExceptionObject caught !" << endl; 
-    cerr << err << endl; 
+  if ( useMesh && ! chunkedFileName.empty() )
+  {
+    cerr << "-write-chunked can only be used with masks." << endl;
     return EXIT_FAILURE;
-  } 
+  }
+
+  // With -memory, the masks are never held in memory as a whole.
+  const bool outOfCore = ( memoryBudgetMB > 0 ) && ! useMesh;
+  if ( outOfCore && splitComponents )
+  {
+    cerr << "-components needs the whole mask and can not be used with -memory." << endl;
+    return EXIT_FAILURE;
+  }
+  if ( outOfCore && ! chunkedFileName.empty() &&
+       ! ChunkedMaskFile::IsChunkedMaskFileName(inputFileName) )
+  {
+    cerr << "-write-chunked needs the whole mask and can not be used with -memory." << endl;
+    return EXIT_FAILURE;
+  }
+
+  MaskExpression expression;
+  const bool     useExpression = ! expressionText.empty();
+  if ( useExpression )
+  {
+    string error;
+    if ( ! expression.Parse(expressionText, maskFileNames.size(), error) )
+    {
+      cerr << error << endl;
+      return EXIT_FAILURE;
+    }
+  }
 
-  const InputImageType::SpacingType& spacing = reader->GetOutput()->GetSpacing();
+  const char* tempFileName   = "temp_junk_file.txt";
+
+  // Make sure that the <output-file> can be opened. 
+  // With -components, the contours of each component are kept in memory
+  // until they are written to their own file.
+  ofstream file1;
+  if ( ! splitComponents )
+  {
+    file1.open(tempFileName, ios::trunc);
+    if ( ! file1.is_open() )
+    {
+      cerr << "Unable to open the text file:  "
+           << outputFileName << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  unsigned int numberOfContours = 0;
+
+  // Geometry of the contours, computed while they are written.
+  const bool              computeStatistics = ! statisticsFileName.empty();
+  StructureStatisticsType statistics;
+
+  DecimalStringEncoder coordinateEncoder(coordinatePrecision);
+
+  ContourNestingType  contourNesting;
+  ContourNestingType* nesting = writeNesting ? &contourNesting : 0;
 
   //"space" will be latter used as multiplication factor to coordinates of vertices.
   //It is found that the vertices returned by the contour extractor are in terms of index.
   //Hence those values are multiplied with spacing while writing to output file.
-  const double space[] = {spacing[0], spacing[1], spacing[2]};
+  //The spacing of the first mask is used.
+  double space[3];
 
-  ContourExtractorType::Pointer contourExtractFilter = ContourExtractorType::New();
-  contourExtractFilter->SetContourValue(contourValue);
-  contourExtractFilter->ReverseContourOrientationOn();
+  // Keep only bit-packed copies of the masks: each unsigned char volume
+  // read from the disk is released as soon as it has been packed.
+  std::vector<BitPackedMask> masks;
 
-  InputImageType::RegionType inputRegion = 
-                        reader->GetOutput()->GetLargestPossibleRegion();
-  InputImageType::SizeType size = inputRegion.GetSize();
-  const unsigned int numberOfSlices = size[2];
-  size[2] = 0; //only one axial slice at a time is considered;
+  // The masks read slice by slice instead (chunked mask files, and all
+  // the masks with -memory); "sources[i]" is 0 for a mask held by
+  // "masks[i]".
+  MaskSliceSourceList sources;
 
-  InputImageType::RegionType sliceRegion;
-  sliceRegion.SetSize(size);
-  InputImageType::IndexType start = inputRegion.GetIndex();
+  // With -mesh, <input-image> only gives the slice geometry.
+  TriangleMesh mesh;
+  MeshSlicer   meshSlicer;
 
-  SliceExtractorType::Pointer sliceExtractFilter = SliceExtractorType::New();
+  unsigned int numberOfSlices;
+  unsigned int sliceSizeXY[2];
+
+  if ( useMesh )
+  {
+    unsigned int size[3];
+    double       origin[3];
+    if ( ! ReadImageGeometry(inputFileName, size, space, origin) )
+    {
+      return EXIT_FAILURE;
+    }
+
+    string error;
+    if ( ! mesh.Read(meshFileName, error) )
+    {
+      cerr << error << endl;
+      return EXIT_FAILURE;
+    }
+
+    // The mesh is sliced in the index space of <input-image>, so that its
+    // polygons are written exactly like the contours of a mask.
+    mesh.TransformToIndexSpace(origin, space);
+
+    meshSlicer.SetMesh(&mesh);
+    meshSlicer.SetNumberOfSlices(size[2]);
+    meshSlicer.SetNumberOfThreads(numberOfThreads);
+    meshSlicer.Update();
+
+    numberOfSlices = size[2];
+    sliceSizeXY[0] = size[0];
+    sliceSizeXY[1] = size[1];
+  } else
+  {
+    masks.resize( maskFileNames.size() );
+    sources.items.resize( maskFileNames.size(), 0 );
+  }
+
+  // A chunked mask file is inflated slab by slab while it is contoured,
+  // unless the whole mask is needed (-components, -write-chunked).
+  std::vector<bool> streamed( masks.size(), false );
+  unsigned int      numberOfSlabCaches = 0;
+  for ( unsigned int i = 0; i < masks.size(); i++ )
+  {
+    const bool wholeMask = splitComponents || ( i == 0 && ! chunkedFileName.empty() );
+    if ( ChunkedMaskFile::IsChunkedMaskFileName(maskFileNames[i]) )
+    {
+      streamed[i] = ! wholeMask;
+    } else if ( outOfCore )
+    {
+      streamed[i] = true;
+      numberOfSlabCaches++;
+    }
+  }
+
+  // The budget in bytes must fit in an unsigned long (32 bits on some
+  // platforms).
+  const unsigned long maximumBudgetMB = static_cast<unsigned long>(-1) / ( 1024 * 1024 );
+  const unsigned long memoryBudget    =
+    std::min( memoryBudgetMB, maximumBudgetMB ) * 1024 * 1024;
+
+  for ( unsigned int i = 0; i < masks.size(); i++ )
+  {
+    const double* maskSpacing;
+    double        readSpacing[3];
+
+    if ( streamed[i] )
+    {
+      string error;
+      if ( ChunkedMaskFile::IsChunkedMaskFileName(maskFileNames[i]) )
+      {
+        ChunkedMaskReader* reader = new ChunkedMaskReader;
+        sources.items[i] = reader;
+        reader->SetNumberOfThreads(numberOfThreads);
+        if ( ! reader->Open(maskFileNames[i], error) )
+        {
+          cerr << error << endl;
+          return EXIT_FAILURE;
+        }
+      } else
+      {
+        MaskSlabCache* slabCache = new MaskSlabCache;
+        sources.items[i] = slabCache;
+        if ( ! slabCache->Open(maskFileNames[i], memoryBudget / numberOfSlabCaches,
+                               maskThreshold, error) )
+        {
+          cerr << error << endl;
+          return EXIT_FAILURE;
+        }
+      }
+      maskSpacing = sources.items[i]->GetSpacing();
+    } else
+    {
+      if ( ! ReadMask(maskFileNames[i].c_str(), masks[i], readSpacing, numberOfThreads) )
+      {
+        return EXIT_FAILURE;
+      }
+      maskSpacing = readSpacing;
+    }
+
+    const BitPackedMask& maskLayout =
+      sources.items[i] ? sources.items[i]->GetLayout() : masks[i];
+    const unsigned int   maskSizeZ  =
+      sources.items[i] ? sources.items[i]->GetSizeZ() : masks[i].GetSizeZ();
+
+    if ( i == 0 )
+    {
+      space[0] = maskSpacing[0];
+      space[1] = maskSpacing[1];
+      space[2] = maskSpacing[2];
+
+      numberOfSlices = maskSizeZ;
+      sliceSizeXY[0] = maskLayout.GetSizeX();
+      sliceSizeXY[1] = maskLayout.GetSizeY();
+    } else if ( maskLayout.GetSizeX() != sliceSizeXY[0] ||
+                maskLayout.GetSizeY() != sliceSizeXY[1] ||
+                maskSizeZ != numberOfSlices )
+    {
+      cerr << "The size of " << maskFileNames[i]
+           << " is different from the size of " << inputFileName << endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // The conversion to a chunked mask file is done on the packed mask,
+  // before the contours are extracted.
+  if ( ! chunkedFileName.empty() )
+  {
+    string error;
+    if ( ! ChunkedMaskFile::Write(chunkedFileName, masks[0], space,
+                                  chunkedMaskSlabDepth, numberOfThreads, error) )
+    {
+      cerr << error << endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Slices of the masks, and the slice where the expression is evaluated.
+  // All the masks share the same layout; the first one is used to
+  // compute the statistics and expand the slices.
+  const BitPackedMask* layout = 0;
+  if ( ! useMesh )
+  {
+    layout = sources.items[0] ? &sources.items[0]->GetLayout() : &masks[0];
+  }
+
+  std::vector<const BitPackedMask::WordType*> maskSlices( useMesh ? 0 : maskFileNames.size() );
+  std::vector<BitPackedMask::WordType>        expressionSlice;
+  if ( useExpression )
+  {
+    expressionSlice.resize( layout->GetWordsPerSlice() );
+  }
+
+  // With -components, the mask (or the result of the expression) is
+  // labelled once, and the runs of each component are then drawn into a
+  // scratch slice to be contoured on their own.
+  ConnectedComponents                  components;
+  BitPackedMask                        combinedMask;
+  std::vector<BitPackedMask::WordType> componentSlice;
+  ComponentContourList                 componentContours;
+  std::vector<unsigned int>            componentNumberOfContours;
+  std::vector<StructureStatisticsType> componentStatistics;
+  std::vector< std::pair<unsigned int, unsigned int> > sliceComponentRuns;
+
+  if ( splitComponents )
+  {
+    const BitPackedMask* labelledMask = &masks[0];
+    if ( useExpression )
+    {
+      combinedMask.Allocate( masks[0].GetSizeX(), masks[0].GetSizeY(), masks[0].GetSizeZ() );
+      for ( unsigned int z = 0; z < numberOfSlices; z++ )
+      {
+        for ( unsigned int i = 0; i < masks.size(); i++ )
+        {
+          maskSlices[i] = masks[i].GetSliceWords(z);
+        }
+        const BitPackedMask::WordType* result =
+          expression.EvaluateSlice(maskSlices, combinedMask.GetWordsPerSlice(),
+                                   combinedMask.GetSliceWords(z));
+        if ( result != combinedMask.GetSliceWords(z) )
+        {
+          // A single operand: the expression returns the mask itself.
+          std::copy( result, result + combinedMask.GetWordsPerSlice(),
+                     combinedMask.GetSliceWords(z) );
+        }
+      }
+      labelledMask = &combinedMask;
+    }
+
+    components.SetFullyConnected(fullyConnected);
+    components.SetNumberOfThreads(numberOfThreads);
+    components.Compute(*labelledMask);
+
+    componentSlice.resize( masks[0].GetWordsPerSlice(), 0 );
+    componentContours.items.resize( components.GetNumberOfComponents(), 0 );
+    componentNumberOfContours.resize( components.GetNumberOfComponents(), 0 );
+    componentStatistics.resize( components.GetNumberOfComponents() );
+
+    const double voxelVolume = space[0] * space[1] * space[2];
+    for ( unsigned int c = 0; c < components.GetNumberOfComponents(); c++ )
+    {
+      componentContours.items[c] = new std::ostringstream;
+      cout << "Component " << c + 1 << ": "
+           << components.GetComponentVolume(c) << " voxels ("
+           << components.GetComponentVolume(c) * voxelVolume << " mm3) -> "
+           << ComponentFileName(outputFileName, c) << endl;
+    }
+  }
+
+  SlicePolylinesType polylines;
+
+  // Contours of the last distinct slices, reused for identical slices.
+  SliceContourCacheType sliceContourCache;
+
+  // A single 2D slice buffer is shared by all the slices; only the
+  // bounding box of the current slice is expanded into it.
+  ImageSliceType::SizeType sliceSize;
+  sliceSize[0] = sliceSizeXY[0];
+  sliceSize[1] = sliceSizeXY[1];
+
+  ImageSliceType::IndexType sliceStart;
+  sliceStart.Fill(0);
+
+  ImageSliceType::RegionType sliceRegion;
+  sliceRegion.SetSize(sliceSize);
+  sliceRegion.SetIndex(sliceStart);
+
+  ImageSliceType::Pointer sliceImage = ImageSliceType::New();
+  sliceImage->SetRegions(sliceRegion);
+  sliceImage->Allocate();
+  sliceImage->FillBuffer(0);
+
+  ContourExtractorType::Pointer contourExtractFilter = ContourExtractorType::New();
+  contourExtractFilter->SetContourValue(contourValue);
+  contourExtractFilter->ReverseContourOrientationOn();
+  contourExtractFilter->SetInput(sliceImage);
 
   for ( unsigned int currentSlice = 0;
         currentSlice < numberOfSlices;
         currentSlice++ )
   {
-    start[0] = 0;
-    start[1] = 0;
-    start[2] = currentSlice;
+    if ( useMesh )
+    {
+      ConvertMeshPolygons(meshSlicer.GetSlicePolygons(currentSlice), polylines);
+      WriteContourVertices(file1, polylines, currentSlice, offset_index, space,
+                           coordinateEncoder, numberOfContours,
+                           computeStatistics ? &statistics : 0, nesting);
+      continue;
+    }
 
-    sliceRegion.SetIndex(start);
+    const BitPackedMask& mask = *layout;
 
-    sliceExtractFilter->SetExtractionRegion(sliceRegion);
-    sliceExtractFilter->SetInput(reader->GetOutput());
-    contourExtractFilter->SetInput(sliceExtractFilter->GetOutput());
+    if ( splitComponents )
+    {
+      // Group the runs of the slice by component.
+      const ConnectedComponents::SliceRuns& runs = components.GetSliceRuns(currentSlice);
+      sliceComponentRuns.resize( runs.size() );
+      for ( unsigned int i = 0; i < runs.size(); i++ )
+      {
+        sliceComponentRuns[i] = std::make_pair( runs[i].component, i );
+      }
+      std::sort( sliceComponentRuns.begin(), sliceComponentRuns.end() );
+
+      unsigned int first = 0;
+      while ( first < sliceComponentRuns.size() )
+      {
+        const unsigned int component = sliceComponentRuns[first].first;
+        unsigned int       last      = first;
+        for ( ; last < sliceComponentRuns.size() &&
+                sliceComponentRuns[last].first == component; last++ )
+        {
+          const ConnectedComponents::Run& run = runs[ sliceComponentRuns[last].second ];
+          mask.SetRowRun( &componentSlice[0], run.y, run.x0, run.x1 );
+        }
+
+        try 
+        { 
+          ExtractSliceContours(mask, &componentSlice[0], sliceImage,
+                               contourExtractFilter, sliceContourCache, polylines);
+        } 
+        catch( itk::ExceptionObject & err ) 
+        { 
+          cerr << "ExceptionObject caught!" << endl; 
+          cerr << err << endl; 
+          return EXIT_FAILURE;
+        }
+        WriteContourVertices(*componentContours.items[component], polylines, currentSlice,
+                             offset_index, space, coordinateEncoder,
+                             componentNumberOfContours[component],
+                             computeStatistics ? &componentStatistics[component] : 0,
+                             nesting);
+
+        // Leave the scratch slice empty for the next component.
+        for ( unsigned int i = first; i < last; i++ )
+        {
+          const ConnectedComponents::Run& run = runs[ sliceComponentRuns[i].second ];
+          mask.ClearRowWords( &componentSlice[0], run.y, run.x0, run.x1 );
+        }
+        first = last;
+      }
+      continue;
+    }
 
     try 
     { 
-      contourExtractFilter->Update();
+      // With -memory or a chunked mask file, the slabs are read (in z
+      // order) as the slices are needed.
+      for ( unsigned int i = 0; i < maskSlices.size(); i++ )
+      {
+        maskSlices[i] = sources.items[i] ? sources.items[i]->GetSliceWords(currentSlice)
+                                         : masks[i].GetSliceWords(currentSlice);
+      }
+
+      const BitPackedMask::WordType* sliceWords = maskSlices[0];
+      if ( useExpression )
+      {
+        // The expression is evaluated only for the current slice, just
+        // before it is contoured: no combined volume is ever built.
+        sliceWords = expression.EvaluateSlice(maskSlices, mask.GetWordsPerSlice(),
+                                              &expressionSlice[0]);
+      }
+
+      ExtractSliceContours(mask, sliceWords, sliceImage,
+                           contourExtractFilter, sliceContourCache, polylines);
     } 
     catch( itk::ExceptionObject & err ) 
     { 
@@ -175,31 +747,350 @@ int main(int argc, char *argv[])
       cerr << err << endl; 
       return EXIT_FAILURE;
     }
-    WriteContourVertices(file1, contourExtractFilter, 
-                         currentSlice, offset_index, space);
+    WriteContourVertices(file1, polylines, currentSlice, offset_index, space,
+                         coordinateEncoder, numberOfContours,
+                         computeStatistics ? &statistics : 0, nesting);
   } 
+
+  if ( splitComponents )
+  {
+    bool written = WriteComponentFiles(outputFileName, componentContours.items,
+                                       componentNumberOfContours);
+    for ( unsigned int c = 0; written && computeStatistics && c < componentStatistics.size(); c++ )
+    {
+      written = WriteStatisticsFile(ComponentFileName(statisticsFileName, c),
+                                    componentStatistics[c], space);
+    }
+    for ( unsigned int c = 0; written && writeIndex && c < componentContours.items.size(); c++ )
+    {
+      written = WriteIndexFile(ComponentFileName(outputFileName, c), numberOfSlices);
+    }
+    return written ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
   file1.close();
 
-  AppendTextFile(tempFileName, outputFileName);
+  AppendTextFile(tempFileName, outputFileName, numberOfContours);
+
+  if ( writeIndex && ! WriteIndexFile(outputFileName, numberOfSlices) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  if ( computeStatistics &&
+       ! WriteStatisticsFile(statisticsFileName, statistics, space) )
+  {
+    return EXIT_FAILURE;
+  }
   return EXIT_SUCCESS;
 }
 // -------------------------------------------------------------
 
 
-void WriteContourVertices(ofstream&                     file1,
-                          ContourExtractorType::Pointer contourExtractFilter,
-                          const unsigned int            currentSlice,
-                          const int                     offset_index[],
-                          const double                  spacing[])
+void PrintUsage(const char* programName)
+{
+  cerr << "Usage: " << programName;
+  cerr << " <input-image>  <output-file>";
+  cerr << " <x-offset-index>  <y-offset-index> <z-offset-index>";
+  cerr << " [options]" << endl;
+  cerr << "Options:" << endl;
+  cerr << "  -mask <image>       additional mask (m2, m3, ... in the order given)" << endl;
+  cerr << "  -expr <expression>  contour a boolean combination of the masks," << endl;
+  cerr << "                      <input-image> being m1. Operators: | (union)," << endl;
+  cerr << "                      & (intersection), - (difference), ^ (xor)," << endl;
+  cerr << "                      e.g. \"m1-m2\" or \"(m1|m2)&m3\"" << endl;
+  cerr << "  -mesh <file>        contour an STL/OBJ triangle mesh (physical" << endl;
+  cerr << "                      coordinates) at the slices of <input-image>," << endl;
+  cerr << "                      which then only gives the slice geometry" << endl;
+  cerr << "  -components         write each 3D connected component of the mask" << endl;
+  cerr << "                      (or of the expression) to its own file, the" << endl;
+  cerr << "                      largest first: <output-file> \"a.txt\" gives" << endl;
+  cerr << "                      \"a_1.txt\", \"a_2.txt\", ..." << endl;
+  cerr << "  -fully-connected    with -components, voxels touching by an edge or" << endl;
+  cerr << "                      a corner are connected (default: faces only)" << endl;
+  cerr << "  -nesting            record, for each contour, the contour of the" << endl;
+  cerr << "                      same slice it is directly nested in" << endl;
+  cerr << "                      (\"[Parent Contour]\", 0 for an outermost one)" << endl;
+  cerr << "  -index              also write <output-file>.idx, the byte offsets" << endl;
+  cerr << "                      of the slices and of the contours in" << endl;
+  cerr << "                      <output-file> (read by export2RTSTRUCT, and" << endl;
+  cerr << "                      for reading only some slices)" << endl;
+  cerr << "  -stats <file>       also write the area, perimeter, centroid and" << endl;
+  cerr << "                      bounding box of each contour, the net area of" << endl;
+  cerr << "                      each slice and the volume of the structure" << endl;
+  cerr << "                      (in mm, mm2 and mm3) to <file>" << endl;
+  cerr << "  -memory <MB>        read the masks by slabs of slices, keeping at" << endl;
+  cerr << "                      most <MB> megabytes of mask data in memory" << endl;
+  cerr << "                      (for masks too large to be read at once)" << endl;
+  cerr << "  -write-chunked <file> also write <input-image> as a chunked mask" << endl;
+  cerr << "                      file (\".m2cz\"): the slabs of such a file are" << endl;
+  cerr << "                      compressed on their own and inflated in" << endl;
+  cerr << "                      parallel while the mask is contoured. Masks" << endl;
+  cerr << "                      named *.m2cz are read as chunked mask files" << endl;
+  cerr << "  -precision <mm>     round the coordinates to <mm> (default 0.001);" << endl;
+  cerr << "                      they are written as DICOM Decimal Strings of" << endl;
+  cerr << "                      at most 16 characters" << endl;
+  cerr << "  -threads <n>        number of threads used by the parallel steps" << endl;
+}
+
+
+// Reads a mask from the disk and packs it into "mask". A chunked mask
+// file is inflated directly into "mask", by "numberOfThreads" threads.
+// Returns false (after printing the reason) if the mask can not be read.
+bool ReadMask(const char*    fileName,
+              BitPackedMask& mask,
+              double         spacing[],
+              unsigned int   numberOfThreads)
+{
+  if ( ChunkedMaskFile::IsChunkedMaskFileName(fileName) )
+  {
+    ChunkedMaskReader chunkedReader;
+    chunkedReader.SetNumberOfThreads(numberOfThreads);
+
+    string error;
+    if ( ! chunkedReader.Open(fileName, error) )
+    {
+      cerr << error << endl;
+      return false;
+    }
+    try
+    {
+      chunkedReader.ReadAll(mask);
+    }
+    catch( itk::ExceptionObject & err )
+    {
+      cerr << "ExceptionObject caught !" << endl;
+      cerr << err << endl;
+      return false;
+    }
+    spacing[0] = chunkedReader.GetSpacing()[0];
+    spacing[1] = chunkedReader.GetSpacing()[1];
+    spacing[2] = chunkedReader.GetSpacing()[2];
+    return true;
+  }
+
+  ImageReaderType::Pointer reader = ImageReaderType::New();
+  reader->SetFileName(fileName);
+
+  try 
+  { 
+    reader->Update();
+  } 
+  catch( itk::ExceptionObject & err ) 
+  { 
+    cerr << "ExceptionObject caught !" << endl; 
+    cerr << err << endl; 
+    return false;
+  } 
+
+  const InputImageType::SpacingType& imageSpacing = reader->GetOutput()->GetSpacing();
+  spacing[0] = imageSpacing[0];
+  spacing[1] = imageSpacing[1];
+  spacing[2] = imageSpacing[2];
+
+  PackInputImage(reader->GetOutput(), mask);
+
+  // The reader, and the unpacked image with it, are released here.
+  return true;
+}
+
+
+// Reads only the header of an image to get its size, spacing and origin.
+// Returns false (after printing the reason) if the header can not be read.
+bool ReadImageGeometry(const char*   fileName,
+                       unsigned int  size[],
+                       double        spacing[],
+                       double        origin[])
+{
+  itk::ImageIOBase::Pointer imageIO =
+    itk::ImageIOFactory::CreateImageIO(fileName, itk::ImageIOFactory::ReadMode);
+
+  if ( ! imageIO )
+  {
+    cerr << "Unable to find a reader for the image:  " << fileName << endl;
+    return false;
+  }
+
+  try
+  {
+    imageIO->SetFileName(fileName);
+    imageIO->ReadImageInformation();
+  }
+  catch( itk::ExceptionObject & err ) 
+  { 
+    cerr << "ExceptionObject caught !" << endl; 
+    cerr << err << endl; 
+    return false;
+  } 
+
+  if ( imageIO->GetNumberOfDimensions() != ImageDimension )
+  {
+    cerr << "A 3D image is expected:  " << fileName << endl;
+    return false;
+  }
+
+  for ( unsigned int i = 0; i < ImageDimension; i++ )
+  {
+    size[i]    = imageIO->GetDimensions(i);
+    spacing[i] = imageIO->GetSpacing(i);
+    origin[i]  = imageIO->GetOrigin(i);
+  }
+  return true;
+}
+
+
+// Packs the whole input image into "mask", one slice at a time.
+void PackInputImage(const InputImageType* image, BitPackedMask& mask)
+{
+  const InputImageType::SizeType size = image->GetLargestPossibleRegion().GetSize();
+
+  mask.Allocate(size[0], size[1], size[2]);
+
+  const unsigned long pixelsPerSlice = size[0] * size[1];
+  const PixelType*    pixels         = image->GetBufferPointer();
+
+  for ( unsigned int z = 0; z < size[2]; z++ )
+  {
+    mask.PackSlice(z, pixels + z * pixelsPerSlice, maskThreshold);
+  }
+}
+
+
+// Runs the contour extractor on one packed slice and copies its contours
+// into "polylines". Only the bounding box of the slice (grown by one
+// background voxel on each side) is expanded and visited by the extractor.
+// The extractor is not run at all if the slice does not contain any voxel,
+// or if it is identical to a slice whose contours are still in "cache".
+void ExtractSliceContours(const BitPackedMask&            mask,
+                          const BitPackedMask::WordType*  sliceWords,
+                          ImageSliceType*                 sliceImage,
+                          ContourExtractorType*           contourExtractFilter,
+                          SliceContourCacheType&          cache,
+                          SlicePolylinesType&             polylines)
 {
-  unsigned int numOutputs = contourExtractFilter->GetNumberOfOutputs();
+  polylines.clear();
 
-  // update the "TOTAL_NUMBER_OF_CONTOURS" value
-  TOTAL_NUMBER_OF_CONTOURS += numOutputs;
+  BitPackedMask::SliceStatistics stats;
+  mask.ComputeSliceStatistics(sliceWords, stats);
+
+  if ( stats.IsEmpty() )
+  {
+    return;
+  }
+
+  const SliceContourCacheType::HashType hash =
+    SliceContourCacheType::Hash(sliceWords, mask.GetWordsPerSlice());
+
+  const SlicePolylinesType* cachedPolylines =
+    cache.Find(sliceWords, mask.GetWordsPerSlice(), hash);
+  if ( cachedPolylines )
+  {
+    polylines = *cachedPolylines;
+    return;
+  }
+
+  const unsigned int x0 = ( stats.xMin > 0 ) ? stats.xMin - 1 : 0;
+  const unsigned int y0 = ( stats.yMin > 0 ) ? stats.yMin - 1 : 0;
+  const unsigned int x1 = ( stats.xMax + 1 < mask.GetSizeX() ) ? stats.xMax + 1 : stats.xMax;
+  const unsigned int y1 = ( stats.yMax + 1 < mask.GetSizeY() ) ? stats.yMax + 1 : stats.yMax;
+
+  mask.UnpackSliceRegion(sliceWords, x0, y0, x1, y1,
+                         sliceImage->GetBufferPointer(), mask.GetSizeX(),
+                         maskOnValue, 0);
+  sliceImage->Modified();
+
+  ImageSliceType::IndexType regionIndex;
+  regionIndex[0] = x0;
+  regionIndex[1] = y0;
+
+  ImageSliceType::SizeType regionSize;
+  regionSize[0] = x1 - x0 + 1;
+  regionSize[1] = y1 - y0 + 1;
+
+  ImageSliceType::RegionType region;
+  region.SetIndex(regionIndex);
+  region.SetSize(regionSize);
+
+  contourExtractFilter->SetRequestedRegion(region);
+  contourExtractFilter->Update();
+
+  const unsigned int numOutputs = contourExtractFilter->GetNumberOfOutputs();
+  polylines.resize(numOutputs);
+
+  for (unsigned int i = 0; i < numOutputs; i++)
+  {
+    ContourExtractorType::VertexListConstPointer vertices =
+                          contourExtractFilter->GetOutput(i)->GetVertexList();
+
+    PolylineType& polyline = polylines[i];
+    polyline.resize( vertices->Size() );
+    for ( unsigned int j = 0; j < polyline.size(); j++ )
+    {
+      polyline[j] = vertices->ElementAt(j);
+    }
+  }
+
+  cache.Insert(sliceWords, mask.GetWordsPerSlice(), hash, polylines);
+}
+
+
+// Converts the polygons of a mesh slice to the polylines written to the
+// output file (a closed polygon gets its first vertex repeated at the end).
+void ConvertMeshPolygons(const MeshSlicer::SlicePolygons& polygons,
+                         SlicePolylinesType&              polylines)
+{
+  polylines.resize( polygons.size() );
+
+  for ( unsigned int i = 0; i < polygons.size(); i++ )
+  {
+    const std::vector<double>& xy = polygons[i].xy;
+    const unsigned int numPoints  = xy.size() / 2;
+
+    PolylineType& polyline = polylines[i];
+    polyline.resize( numPoints + ( polygons[i].closed ? 1 : 0 ) );
+
+    for ( unsigned int j = 0; j < polyline.size(); j++ )
+    {
+      polyline[j][0] = xy[ 2 * ( j % numPoints ) ];
+      polyline[j][1] = xy[ 2 * ( j % numPoints ) + 1 ];
+    }
+  }
+}
+
+
+void WriteContourVertices(ostream&                    file1,
+                          const SlicePolylinesType&   polylines,
+                          const unsigned int          currentSlice,
+                          const int                   offset_index[],
+                          const double                spacing[],
+                          const DecimalStringEncoder& encoder,
+                          unsigned int&               numberOfContours,
+                          StructureStatisticsType*    statistics,
+                          ContourNestingType*         nesting)
+{
+  unsigned int numOutputs = polylines.size();
+
+  // The contours of this slice are numbered from "firstContour" in the
+  // file (the first contour of the file being 1).
+  const unsigned int firstContour = numberOfContours + 1;
+
+  // update the total number of contours of the file
+  numberOfContours += numOutputs;
+
+  std::vector<bool> closed(numOutputs);
+  for (unsigned int i = 0; i < numOutputs; i++)
+  {
+    const PolylineType& vertices = polylines[i];
+    closed[i] = ( fabs(vertices.front()[0] - vertices.back()[0]) < FLOAT_EPSILON ) &&
+                ( fabs(vertices.front()[1] - vertices.back()[1]) < FLOAT_EPSILON );
+  }
+
+  if ( nesting )
+  {
+    nesting->Compute(polylines, closed);
+  }
 
   unsigned int numVertices;
-  VertexType   firstVertex;
-  VertexType   lastVertex;
 
   // Compute the z-value for this planar contour.
   const double zValue = ( currentSlice - offset_index[2] ) * (spacing[2]);
@@ -207,60 +1098,164 @@ void WriteContourVertices(ofstream&                     file1,
 
   for (unsigned int i = 0; i < numOutputs; i++)
   {
-    ContourExtractorType::VertexListConstPointer vertices =
-                          contourExtractFilter->GetOutput(i)->GetVertexList();
+    const PolylineType& vertices = polylines[i];
 
-    numVertices = vertices->Size();
+    numVertices = vertices.size();
 
-    firstVertex = vertices->ElementAt(0);
-    lastVertex  = vertices->ElementAt(numVertices-1);
+    // Number of the parent contour in the file (0 if none), or -1 if the
+    // nesting is not written.
+    int parentContour = -1;
+    if ( nesting )
+    {
+      const int parent = nesting->GetParent(i);
+      parentContour = ( parent < 0 ) ? 0 : firstContour + parent;
+    }
 
-    if ( (fabs(firstVertex[0] - lastVertex[0]) < FLOAT_EPSILON ) &&
-         (fabs(firstVertex[1] - lastVertex[1]) < FLOAT_EPSILON ) )
+    if ( closed[i] )
     {
       // It's a closed contour.
       // So, the last vertex won't be written as it is same as the 1st vertex.
       // Further, the last but one vertex is seperately handled to avoid the
       // "\" symbol at the end.
       //
-      WriteCommonData(currentSlice, numVertices-1, CLOSED_PLANAR, file1);
+      WriteCommonData(currentSlice, numVertices-1, CLOSED_PLANAR, parentContour, file1);
+
+      if ( statistics )
+      {
+        statistics->push_back( ContourStatisticsType() );
+        ComputeContourStatistics( vertices, numVertices-1, true, currentSlice,
+                                  offset_index, spacing, zValue, statistics->back() );
+      }
 
       for ( unsigned int j = 0; j < ( numVertices-2 ); j++ )
       {
-              WriteVertexCoordinates( vertices->ElementAt(j), offset_index,
-                                      spacing, zValue, file1 );
+              WriteVertexCoordinates( vertices[j], offset_index,
+                                      spacing, zValue, encoder, file1 );
       }
 
       // In order to avoid "\" symbol at the end of the vertices string,
       // the last verex is specially handled here.....
-      WriteLastVertexCoordinates( vertices->ElementAt( numVertices-2 ),
-                                 offset_index, spacing, zValue, file1 );
+      WriteLastVertexCoordinates( vertices[numVertices-2],
+                                 offset_index, spacing, zValue, encoder, file1 );
       file1 << endl << endl;
     } else
     {
       // "The contour is a open planar one.
-      WriteCommonData(currentSlice, numVertices, OPEN_PLANAR, file1);
+      WriteCommonData(currentSlice, numVertices, OPEN_PLANAR, parentContour, file1);
+
+      if ( statistics )
+      {
+        statistics->push_back( ContourStatisticsType() );
+        ComputeContourStatistics( vertices, numVertices, false, currentSlice,
+                                  offset_index, spacing, zValue, statistics->back() );
+      }
 
       for ( unsigned int j = 0; j < ( numVertices-1 ); j++ )
       {
-              WriteVertexCoordinates( vertices->ElementAt(j), offset_index,
-                                      spacing, zValue, file1 );
+              WriteVertexCoordinates( vertices[j], offset_index,
+                                      spacing, zValue, encoder, file1 );
       }
 
       // In order to avoid "\" symbol at the end of the vertices string,
       // the last verex is specially handled here.....
-      WriteLastVertexCoordinates( vertices->ElementAt( numVertices-1 ),
-                                  offset_index, spacing, zValue, file1 );
+      WriteLastVertexCoordinates( vertices[numVertices-1],
+                                  offset_index, spacing, zValue, encoder, file1 );
       file1 << endl << endl;
     }
   }
 }
 
 
+// Computes the geometry of the first "numPoints" vertices of a contour,
+// in the coordinates written to the output file.
+void ComputeContourStatistics(const PolylineType&    vertices,
+                              const unsigned int     numPoints,
+                              const bool             closed,
+                              const unsigned int     currentSlice,
+                              const int              offset_index[],
+                              const double           spacing[],
+                              const double           zValue,
+                              ContourStatisticsType& stats)
+{
+  stats.slice          = currentSlice;
+  stats.closed         = closed;
+  stats.numberOfPoints = numPoints;
+
+  double signedArea = 0.0; // twice the signed area (shoelace formula)
+  double perimeter  = 0.0;
+  double sumX = 0.0, sumY = 0.0;   // vertex sums
+  double areaX = 0.0, areaY = 0.0; // area-weighted sums
+
+  double xMin = 0.0, xMax = 0.0, yMin = 0.0, yMax = 0.0;
+
+  // Without closing segment, an open contour has one edge less.
+  const unsigned int numEdges = closed ? numPoints : numPoints - 1;
+
+  for ( unsigned int j = 0; j < numPoints; j++ )
+  {
+    const double x = ( vertices[j][0] - offset_index[0] ) * spacing[0];
+    const double y = ( vertices[j][1] - offset_index[1] ) * spacing[1];
+
+    if ( j == 0 )
+    {
+      xMin = xMax = x;
+      yMin = yMax = y;
+    } else
+    {
+      xMin = std::min(xMin, x);
+      xMax = std::max(xMax, x);
+      yMin = std::min(yMin, y);
+      yMax = std::max(yMax, y);
+    }
+    sumX += x;
+    sumY += y;
+
+    if ( j < numEdges )
+    {
+      const unsigned int k = ( j + 1 ) % numPoints;
+      const double nx = ( vertices[k][0] - offset_index[0] ) * spacing[0];
+      const double ny = ( vertices[k][1] - offset_index[1] ) * spacing[1];
+
+      const double cross = x * ny - nx * y;
+      signedArea += cross;
+      areaX      += ( x + nx ) * cross;
+      areaY      += ( y + ny ) * cross;
+      perimeter  += sqrt( ( nx - x ) * ( nx - x ) + ( ny - y ) * ( ny - y ) );
+    }
+  }
+
+  stats.perimeter      = perimeter;
+  stats.boundingBox[0] = xMin;
+  stats.boundingBox[1] = xMax;
+  stats.boundingBox[2] = yMin;
+  stats.boundingBox[3] = yMax;
+  stats.centroid[2]    = zValue;
+
+  if ( closed && fabs(signedArea) > FLOAT_EPSILON )
+  {
+    stats.area        = 0.5 * fabs(signedArea);
+    stats.centroid[0] = areaX / ( 3.0 * signedArea );
+    stats.centroid[1] = areaY / ( 3.0 * signedArea );
+
+    // The contours are extracted with a reversed orientation: outer
+    // boundaries have a negative signed area, holes a positive one.
+    stats.hole = ( signedArea > 0.0 );
+  } else
+  {
+    // Open or degenerate contour: mean of the vertices.
+    stats.area        = 0.0;
+    stats.centroid[0] = sumX / numPoints;
+    stats.centroid[1] = sumY / numPoints;
+    stats.hole        = false;
+  }
+}
+
+
 void WriteCommonData(const unsigned int sliceNumber,
                      const unsigned int numContourPoints,
                      const string       geometricType,
-                     ofstream&          file1)
+                     const int          parentContour,
+                     ostream&           file1)
 {
   file1 << "[Slice Number]" << endl;
   file1 << sliceNumber << endl << endl;
@@ -271,37 +1266,48 @@ void WriteCommonData(const unsigned int sliceNumber,
   file1 << "[Number of Contour Points]" << endl;
   file1 << numContourPoints << endl << endl;
 
+  if ( parentContour >= 0 )
+  {
+    file1 << "[Parent Contour]" << endl;
+    file1 << parentContour << endl << endl;
+  }
+
   file1 << "[Contour Data]" << endl;
 }
 
 
-void WriteVertexCoordinates(const        VertexType vertex, 
-                            const int    offset_index[],
-                            const double spacing[],
-                            const double zValue,
-                            ofstream&    file1)
+void WriteVertexCoordinates(const VertexType            vertex,
+                            const int                   offset_index[],
+                            const double                spacing[],
+                            const double                zValue,
+                            const DecimalStringEncoder& encoder,
+                            ostream&                    file1)
 {
-  file1 << std::setprecision(precision)
-        << ( (vertex[0]-offset_index[0]) * spacing[0] ) << "\\"
-        << ( (vertex[1]-offset_index[1]) * spacing[1] ) << "\\"
-        << zValue << "\\";
+  WriteLastVertexCoordinates( vertex, offset_index, spacing, zValue, encoder, file1 );
+  file1 << "\\";
 }
 
 
-void WriteLastVertexCoordinates(const        VertexType vertex, 
-                                const int    offset_index[],
-                                const double spacing[],
-                                const double zValue,
-                                ofstream&    file1)
+void WriteLastVertexCoordinates(const VertexType            vertex,
+                                const int                   offset_index[],
+                                const double                spacing[],
+                                const double                zValue,
+                                const DecimalStringEncoder& encoder,
+                                ostream&                    file1)
 {
-  file1 << std::setprecision(precision)
-        << ( (vertex[0]-offset_index[0]) * spacing[0] ) << "\\"
-        << ( (vertex[1]-offset_index[1]) * spacing[1] ) << "\\"
-        << zValue;
+  char buffer[DecimalStringEncoder::MaximumLength + 1];
+
+  file1.write( buffer, encoder.Encode( (vertex[0]-offset_index[0]) * spacing[0], buffer ) );
+  file1 << "\\";
+  file1.write( buffer, encoder.Encode( (vertex[1]-offset_index[1]) * spacing[1], buffer ) );
+  file1 << "\\";
+  file1.write( buffer, encoder.Encode( zValue, buffer ) );
 }
 
 
-void AppendTextFile(const char* fileName1, const char* outputFileName)
+void AppendTextFile(const char*  fileName1,
+                    const char*  outputFileName,
+                    unsigned int numberOfContours)
 {
   ifstream file1(fileName1);
   ofstream outputFile(outputFileName, ios::trunc);
@@ -321,7 +1327,7 @@ void AppendTextFile(const char* fileName1, const char* outputFileName)
     }
 
   outputFile << "[Total Number of Contours]" << endl;
-  outputFile << TOTAL_NUMBER_OF_CONTOURS << endl << endl;
+  outputFile << numberOfContours << endl << endl;
 
   char ch;
   while (file1.get(ch)) // copies all characters (including newline chars)
@@ -338,3 +1344,214 @@ void AppendTextFile(const char* fileName1, const char* outputFileName)
   }
   
 }
+
+
+// Name of the file of a component: "_<number>" is inserted before the
+// extension of <output-file> (components are numbered from 1).
+string ComponentFileName(const string& outputFileName, unsigned int component)
+{
+  std::ostringstream suffix;
+  suffix << "_" << component + 1;
+
+  const string::size_type slash = outputFileName.find_last_of("/\\");
+  const string::size_type dot   = outputFileName.rfind('.');
+
+  if ( dot == string::npos || ( slash != string::npos && dot < slash ) )
+  {
+    return outputFileName + suffix.str();
+  }
+  return outputFileName.substr(0, dot) + suffix.str() + outputFileName.substr(dot);
+}
+
+
+// Writes the contours of each component to its own file.
+bool WriteComponentFiles(const string&                           outputFileName,
+                         const std::vector<std::ostringstream*>& contours,
+                         const std::vector<unsigned int>&        numberOfContours)
+{
+  for ( unsigned int c = 0; c < contours.size(); c++ )
+  {
+    const string fileName = ComponentFileName(outputFileName, c);
+    ofstream     outputFile(fileName.c_str(), ios::trunc);
+
+    if ( ! outputFile.is_open() )
+    {
+      cerr << "Unable to open the text file:  "
+           << fileName << endl;
+      return false;
+    }
+
+    outputFile << "[Total Number of Contours]" << endl;
+    outputFile << numberOfContours[c] << endl << endl;
+    outputFile << contours[c]->str();
+  }
+  return true;
+}
+
+
+// Writes the index of a contour file to "<contourFileName>.idx":
+//
+//   [Total Number of Contours]  N
+//   [Data File Size]            size of the contour file, in bytes
+//   [Number of Slices]          Z
+//   [Slice Offsets]             Z lines "offset first-contour contours"
+//                               (slice 0 first; a slice without contours
+//                               gives the offset of the next contour)
+//   [Contour Offsets]           N lines "offset slice": the offset of the
+//                               "[Slice Number]" line of each contour
+//
+// The slice offsets come first, so that a reader of a single slice (e.g.
+// read_contour_slice() of export2RTSTRUCT) does not go through the
+// offsets of all the contours.
+//
+// The offsets are found by reading the contour file back, so that they
+// are the offsets of the bytes on the disk, whatever the line ends.
+bool WriteIndexFile(const string& contourFileName, unsigned int numberOfSlices)
+{
+  ifstream contourFile(contourFileName.c_str(), ios::in | ios::binary);
+  if ( ! contourFile.is_open() )
+  {
+    cerr << "Unable to open the text file:  "
+         << contourFileName << endl;
+    return false;
+  }
+
+  std::vector<std::streamoff> contourOffsets;
+  std::vector<unsigned int>   contourSlices;
+
+  string         line;
+  std::streamoff offset = 0;
+  while ( std::getline(contourFile, line) )
+  {
+    const std::streamoff lineOffset = offset;
+    offset += line.length() + 1;
+
+    if ( line.compare(0, 14, "[Slice Number]") == 0 )
+    {
+      unsigned int slice = 0;
+      if ( std::getline(contourFile, line) )
+      {
+        offset += line.length() + 1;
+        slice = atoi( line.c_str() );
+      }
+      contourOffsets.push_back( lineOffset );
+      contourSlices.push_back( slice );
+    }
+  }
+
+  // The last line may not end with a new line.
+  contourFile.clear();
+  contourFile.seekg(0, ios::end);
+  const std::streamoff fileSize = contourFile.tellg();
+
+  const string indexFileName = contourFileName + ".idx";
+  ofstream     indexFile(indexFileName.c_str(), ios::trunc);
+  if ( ! indexFile.is_open() )
+  {
+    cerr << "Unable to open the text file:  "
+         << indexFileName << endl;
+    return false;
+  }
+
+  indexFile << "[Total Number of Contours]" << endl;
+  indexFile << contourOffsets.size() << endl << endl;
+
+  indexFile << "[Data File Size]" << endl;
+  indexFile << fileSize << endl << endl;
+
+  indexFile << "[Number of Slices]" << endl;
+  indexFile << numberOfSlices << endl << endl;
+
+  // The contours are written in slice order.
+  indexFile << "[Slice Offsets]" << endl;
+  unsigned int contour = 0;
+  for ( unsigned int z = 0; z < numberOfSlices; z++ )
+  {
+    const unsigned int first = contour;
+    while ( contour < contourSlices.size() && contourSlices[contour] == z )
+    {
+      contour++;
+    }
+    indexFile << ( first < contourOffsets.size() ? contourOffsets[first] : fileSize )
+              << " " << first + 1 << " " << contour - first << endl;
+  }
+  indexFile << endl;
+
+  indexFile << "[Contour Offsets]" << endl;
+  for ( unsigned int i = 0; i < contourOffsets.size(); i++ )
+  {
+    indexFile << contourOffsets[i] << " " << contourSlices[i] << endl;
+  }
+
+  return true;
+}
+
+
+// Writes the geometry of the contours of a structure, followed by the net
+// area of each slice (outer areas minus hole areas) and the volume of the
+// structure (sum of the net areas times the slice thickness).
+bool WriteStatisticsFile(const string&                  fileName,
+                         const StructureStatisticsType& statistics,
+                         const double                   spacing[])
+{
+  ofstream file1(fileName.c_str(), ios::trunc);
+  if ( ! file1.is_open() )
+  {
+    cerr << "Unable to open the text file:  "
+         << fileName << endl;
+    return false;
+  }
+
+  file1 << std::setprecision(precision);
+
+  file1 << "[Total Number of Contours]" << endl;
+  file1 << statistics.size() << endl << endl;
+
+  file1 << "[Contour Statistics]" << endl;
+  file1 << "contour slice type points area perimeter"
+        << " centroid_x centroid_y centroid_z x_min x_max y_min y_max hole" << endl;
+
+  for ( unsigned int i = 0; i < statistics.size(); i++ )
+  {
+    const ContourStatisticsType& stats = statistics[i];
+
+    file1 << i + 1 << " " << stats.slice << " "
+          << ( stats.closed ? CLOSED_PLANAR : OPEN_PLANAR ) << " "
+          << stats.numberOfPoints << " "
+          << stats.area << " " << stats.perimeter << " "
+          << stats.centroid[0] << " " << stats.centroid[1] << " "
+          << stats.centroid[2] << " "
+          << stats.boundingBox[0] << " " << stats.boundingBox[1] << " "
+          << stats.boundingBox[2] << " " << stats.boundingBox[3] << " "
+          << ( stats.hole ? 1 : 0 ) << endl;
+  }
+  file1 << endl;
+
+  // The contours are written slice after slice, so the contours of a slice
+  // are consecutive.
+  file1 << "[Slice Statistics]" << endl;
+  file1 << "slice contours net_area" << endl;
+
+  double volume = 0.0;
+  unsigned int i = 0;
+  while ( i < statistics.size() )
+  {
+    const unsigned int slice   = statistics[i].slice;
+    unsigned int       count   = 0;
+    double             netArea = 0.0;
+
+    for ( ; i < statistics.size() && statistics[i].slice == slice; i++, count++ )
+    {
+      netArea += statistics[i].hole ? -statistics[i].area : statistics[i].area;
+    }
+
+    file1 << slice << " " << count << " " << netArea << endl;
+    volume += netArea * fabs(spacing[2]);
+  }
+  file1 << endl;
+
+  file1 << "[Structure Volume]" << endl;
+  file1 << volume << endl;
+
+  return true;
+}